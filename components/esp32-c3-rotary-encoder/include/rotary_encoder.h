@@ -42,7 +42,25 @@
  * 
  * The notification can be done in three ways: polling using the rotenc_get_state 
  * function, by callback using the rotenc_set_event_callback function, or by 
- * message queue using the rotenc_wait_event function.
+ * a lock-free single-producer/single-consumer ring of events using the 
+ * rotenc_wait_event or rotenc_wait_events functions. The ring does not lose 
+ * steps on fast rotations as long as it has room, and the consumer can 
+ * process all the pending events in one wakeup; when it's full the new 
+ * events are dropped and counted, and their steps are added to the next 
+ * event that fits.
+ * 
+ * With CONFIG_ROT_ENC_BACKEND_PCNT (chips with pulse counter) the quadrature 
+ * is decoded by the PCNT peripheral and its glitch filter, the CPU only takes
+ * an interrupt per detent; the event callback then runs in ISR context.
+ * 
+ * With CONFIG_ROT_ENC_BACKEND_TABLE both pins interrupt on any edge and a 
+ * Gray-code transition table decodes the steps inside the ISR, without 
+ * debounce timer: a bounce is a step forward and back that cancels out, and 
+ * the transitions that change both pins are rejected. The event callback 
+ * runs in ISR context too. It supports full, half and quarter resolution.
+ * 
+ * The steps and the overflows can be traced with a hook installed by 
+ * rotenc_set_trace_callback, the driver doesn't depend on a trace component.
  * 
  */
 
@@ -52,16 +70,22 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "sdkconfig.h"
 #include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
+#include "freertos/task.h"
 #include "esp_err.h"
 #include "driver/gpio.h"
 #include "esp_timer.h"
+#if CONFIG_ROT_ENC_BACKEND_PCNT
+#include "driver/pulse_cnt.h"
+#endif
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define ROTENC_DEFAULT_RING_DEPTH   16  ///< Depth of the ring created by rotenc_set_event_queue.
+
 /**
  * @brief Enum representing the direction of rotation.
  */
@@ -72,6 +96,17 @@ typedef enum
     ROTENC_CCW,                     ///< Counter clockwise, depends on the flip option.
 } rotenc_direction_t;
 
+/**
+ * @brief Enum representing the resolution, the value is the number of 
+ *        quadrature transitions (quarter steps) by event.
+ */
+typedef enum
+{
+    ROTENC_RES_QUARTER = 1,         ///< An event by each edge of any pin.
+    ROTENC_RES_HALF = 2,            ///< An event by each edge of the clock pin.
+    ROTENC_RES_FULL = 4,            ///< An event by complete cycle (one detent), default.
+} rotenc_resolution_t;
+
 /**
  * @brief Struct position and direction of last movement of the device.
  */
@@ -79,8 +114,24 @@ typedef struct
 {
     int32_t position;               ///< Numerical position since reset. 
     rotenc_direction_t direction;   ///< Direction of last movement. Set to NOT_SET on reset.
+    int64_t timestamp_us;           ///< Time of the last movement, from esp_timer_get_time.
+    uint32_t velocity;              ///< Smoothed speed of rotation in steps per second.
+    int32_t steps;                  ///< Steps after the acceleration curve, negative when CCW.
+    uint32_t cycles;                ///< CPU cycle count of the step, to measure the latency downstream.
+    uint32_t isr_cycles;            ///< CPU cycle count at the entry of the edge interrupt.
 } rotenc_event_t;
 
+/**
+ * @brief Struct contains the acceleration curve, the steps by event grow 
+ *        linearly from 1 at min_rate up to max_steps at max_rate.
+ */
+typedef struct
+{
+    uint32_t min_rate;              ///< Velocity in steps/s where the acceleration starts.
+    uint32_t max_rate;              ///< Velocity in steps/s where it reaches max_steps.
+    uint8_t max_steps;              ///< Steps by event at full speed, 1 disables the acceleration.
+} rotenc_accel_t;
+
 /**
  * @brief Position Event callback function type
  * @param event direction and numerical position. 
@@ -93,6 +144,23 @@ typedef void (*rotenc_event_cb_t)(rotenc_event_t event);
  */
 typedef void (*rotenc_button_cb_t)(void*);
 
+/**
+ * @brief Events of the driver reported to the trace hook.
+ */
+typedef enum
+{
+    ROTENC_TRACE_STEP = 0,              ///< Step decoded, the argument is the position.
+    ROTENC_TRACE_OVERFLOW,              ///< Event dropped by the ring, the argument is the overflows.
+} rotenc_trace_event_t;
+
+/**
+ * @brief Trace hook function type, it's called from the ISRs so it must be 
+ *        in IRAM and must not block.
+ * @param event Event of the driver.
+ * @param arg Argument of the event.
+ */
+typedef void (*rotenc_trace_cb_t)(rotenc_trace_event_t event, uint32_t arg);
+
 /**
  * @brief Struct contains information to control the button.
  */
@@ -106,13 +174,21 @@ typedef struct
 } rotenc_button_t;
 
 /**
- * @brief Struct contains information to the events by queue.
+ * @brief Struct contains the single-producer/single-consumer ring of events.
+ *        The producer only writes head and the consumer only writes tail, 
+ *        the indexes are free running and the depth is a power of two.
  */
 typedef struct 
 {
-    QueueHandle_t queue;                ///< Handle for event queue.
+    rotenc_event_t * events;            ///< Storage for depth events.
+    uint32_t depth;                     ///< Number of events, power of two.
+    volatile uint32_t head;             ///< Count of events written by the producer.
+    volatile uint32_t tail;             ///< Count of events read by the consumer.
+    volatile uint32_t overflows;        ///< Events dropped because the ring was full.
+    int32_t dropped_steps;              ///< Steps of the dropped events, added to the next event.
+    volatile TaskHandle_t consumer;     ///< Task to notify when there is a new event.
     uint32_t wait_ms;                   ///< Time in mS that waits for the reception of an event.
-} rotenc_queue_t;
+} rotenc_ring_t;
 
 /**
  * @brief Struct instance of the driver for a rotary encoder device.
@@ -121,7 +197,7 @@ typedef struct
 {
     gpio_num_t pin_clk;                 ///< GPIO for clock (A) from the rotary encoder device.
     gpio_num_t pin_dta;                 ///< GPIO for data (B) from the rotary encoder device.
-    rotenc_queue_t q_event;             ///< Information for events by queue.
+    rotenc_ring_t ring;                 ///< Information for events by ring.
     esp_timer_handle_t debounce_timer;  ///< Software timer to apply the anti-bounce.
     uint32_t debounce_us;               ///< Period in uS that the anti-bounce takes. 
     volatile rotenc_event_t state;      ///< Device state.
@@ -129,6 +205,17 @@ typedef struct
     rotenc_event_cb_t event_callback;   ///< Function to call when there is a new position event.
     int irq_data_level;                 ///< The value of the data pin when the irq enters.
     rotenc_button_t button;             ///< Button information.
+    rotenc_resolution_t resolution;     ///< Quarter steps by event.
+    rotenc_accel_t accel;               ///< Acceleration curve.
+#if CONFIG_ROT_ENC_BACKEND_TABLE
+    uint8_t table_state;                ///< Last pin levels, clock (A) in bit 1 and data (B) in bit 0.
+    int8_t table_accum;                 ///< Quarter steps accumulated since the last event.
+#endif
+#if CONFIG_ROT_ENC_BACKEND_PCNT
+    pcnt_unit_handle_t pcnt_unit;       ///< Pulse counter unit that decodes the quadrature.
+    pcnt_channel_handle_t pcnt_chan_a;  ///< Channel counting the clock (A) edges.
+    pcnt_channel_handle_t pcnt_chan_b;  ///< Channel counting the data (B) edges.
+#endif
 } rotenc_handle_t;
 
 /**
@@ -137,6 +224,7 @@ typedef struct
  * @param[in] pin_clk GPIO number for clock (A) (triggers the IRQ on a falling edge).
  * @param[in] pin_data GPIO number for data (B) (read only, to detect the direction of rotation).
  * @param[in] debounce_us Period in uS that the anti-bounce takes, by default 1000 uS.
+ *            With the PCNT backend the glitch filter is used instead.
  * @return ESP_OK if successful, ESP_FAIL or ESP_ERR_* if an error occurred.
  */
 esp_err_t rotenc_init(rotenc_handle_t * handle, gpio_num_t pin_a, gpio_num_t pin_b, uint32_t debounce_us);
@@ -148,6 +236,26 @@ esp_err_t rotenc_init(rotenc_handle_t * handle, gpio_num_t pin_a, gpio_num_t pin
  */
 esp_err_t rotenc_flip_direction(rotenc_handle_t * handle);
 
+/**
+ * @brief Set the number of quadrature transitions that generate an event.
+ *        Only the table backend supports other than ROTENC_RES_FULL.
+ * @param[in] handle Pointer to allocated rotary encoder instance.
+ * @param[in] resolution Full, half or quarter step.
+ * @return ESP_OK if successful, ESP_ERR_NOT_SUPPORTED by the backend, or ESP_ERR_* if an error occurred.
+ */
+esp_err_t rotenc_set_resolution(rotenc_handle_t * handle, rotenc_resolution_t resolution);
+
+/**
+ * @brief Configure the acceleration curve applied to the steps of the events.
+ * @param[in] handle Pointer to allocated rotary encoder instance.
+ * @param[in] min_rate Velocity in steps/s where the acceleration starts.
+ * @param[in] max_rate Velocity in steps/s where the steps reach max_steps, greater than min_rate.
+ * @param[in] max_steps Steps by event at full speed, 1 disables the acceleration.
+ * @return ESP_OK if successful, or ESP_ERR_* if an error occurred.
+ */
+esp_err_t rotenc_set_acceleration(rotenc_handle_t * handle, uint32_t min_rate, 
+                                  uint32_t max_rate, uint8_t max_steps);
+
 /**
  * @brief Uninitialize the handlers and driver resources.     
  * @param[in] handle Pointer to allocated rotary encoder instance.
@@ -156,7 +264,7 @@ esp_err_t rotenc_flip_direction(rotenc_handle_t * handle);
 esp_err_t rotenc_uninit(rotenc_handle_t * handle);
 
 /**
- * @brief Configure a queue to proccess the rotary event.
+ * @brief Configure a ring of ROTENC_DEFAULT_RING_DEPTH events to proccess the rotary event.
  *        Note: If the report is already done by callback, it returns a status error.
  * @param[in] handle Pointer to allocated rotary encoder instance.
  * @param[in] wait_time_ms Time in mS that waits for the reception of an event.
@@ -164,6 +272,16 @@ esp_err_t rotenc_uninit(rotenc_handle_t * handle);
  */
 esp_err_t rotenc_set_event_queue(rotenc_handle_t * handle, uint32_t wait_time_ms);
 
+/**
+ * @brief Configure a ring to proccess the rotary events.
+ *        Note: If the report is already done by callback, it returns a status error.
+ * @param[in] handle Pointer to allocated rotary encoder instance.
+ * @param[in] depth Number of events, rounded up to a power of two.
+ * @param[in] wait_time_ms Time in mS that waits for the reception of an event.
+ * @return ESP_OK if successful, or ESP_ERR_* if an error.
+ */
+esp_err_t rotenc_set_event_ring(rotenc_handle_t * handle, uint32_t depth, uint32_t wait_time_ms);
+
 /**
  * @brief Configure the callback function to proccess the rotary event.
  *        Note: If the report is already done by queue, it returns a status error.
@@ -174,13 +292,41 @@ esp_err_t rotenc_set_event_queue(rotenc_handle_t * handle, uint32_t wait_time_ms
 esp_err_t rotenc_set_event_callback(rotenc_handle_t * handle, rotenc_event_cb_t callback);
 
 /**
- * @brief Wait for FreeRtos queue events. 
+ * @brief Wait for an event of the ring. 
+ *        Note: Only one task can consume the events.
  * @param[in] handle Pointer to allocated rotary encoder instance.
  * @param[in] event Pointer of the struct to store the event.
  * @return ESP_OK if successful, ESP_TIMEOUT when event timeout expired. or ESP_ERR_* if an error occurred.
  */
 esp_err_t rotenc_wait_event(rotenc_handle_t * handle, rotenc_event_t* event);
 
+/**
+ * @brief Wait for events of the ring, and drain all the pending ones in one call.
+ *        Note: Only one task can consume the events.
+ * @param[in] handle Pointer to allocated rotary encoder instance.
+ * @param[out] events Array to store the events, in order of arrival.
+ * @param[in] max_events Size of the array.
+ * @param[out] count Number of events stored.
+ * @return ESP_OK if successful, ESP_TIMEOUT when event timeout expired. or ESP_ERR_* if an error occurred.
+ */
+esp_err_t rotenc_wait_events(rotenc_handle_t * handle, rotenc_event_t * events, 
+                             uint32_t max_events, uint32_t * count);
+
+/**
+ * @brief Get the number of events dropped because the ring was full.
+ * @param[in] handle Pointer to allocated rotary encoder instance.
+ * @return Number of events dropped since the ring was created.
+ */
+uint32_t rotenc_get_overflows(const rotenc_handle_t * handle);
+
+/**
+ * @brief Install a hook to trace the steps and the overflows of every 
+ *        instance, the driver doesn't depend on a trace implementation.
+ * @param[in] callback Function to call, NULL removes the hook.
+ * @return void
+ */
+void rotenc_set_trace_callback(rotenc_trace_cb_t callback);
+
 /**
  * @brief Poll the current position of the rotary encoder.
  * @param[in] handle Pointer to allocated rotary encoder instance.
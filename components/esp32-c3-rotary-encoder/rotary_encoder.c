@@ -29,10 +29,54 @@
 
 #include "rotary_encoder.h"
 
+#include <stdlib.h>
+
+#include "esp_cpu.h"
+
 #include "esp_log.h"
 
 #define TAG "rotenc"
 
+#define VELOCITY_IDLE_US        250000  ///< Longer intervals restart the velocity.
+
+#if CONFIG_ROT_ENC_BACKEND_PCNT
+#define PCNT_COUNTS_PER_DETENT  4   ///< Edges counted by both channels in one detent.
+#endif
+
+#if CONFIG_ROT_ENC_BACKEND_TABLE
+#define TABLE_STATE_REST        3   ///< Both pins high (pull-up), position of the detent.
+#define TABLE_STATE_HALF        0   ///< Both pins low, middle of the cycle.
+
+/**
+ * @brief Quarter steps by transition, indexed by (previous state << 2) | state,
+ *        where the state is (clock << 1) | data. The clockwise sequence is 
+ *        3 -> 1 -> 0 -> 2 -> 3 (the clock falls first, with the data high), 
+ *        no change and invalid transitions (both pins changed) count zero.
+ */
+static const DRAM_ATTR int8_t table_steps[16] = {
+     0, -1,  1,  0,
+     1,  0,  0, -1,
+    -1,  0,  0,  1,
+     0,  1, -1,  0,
+};
+#endif
+
+static rotenc_trace_cb_t trace_callback = NULL;
+
+/**
+ * @brief Report an event to the trace hook, when there is one installed.
+ * @param[in] event Event of the driver.
+ * @param[in] arg Argument of the event.
+ * @return void
+ */
+static void IRAM_ATTR rotenc_trace(rotenc_trace_event_t event, uint32_t arg)
+{
+    rotenc_trace_cb_t callback = trace_callback;
+    if (callback) {
+        callback(event, arg);
+    }
+}
+
 /**
  * @brief Toggle test pin to debug irqs events.
  * @param[in] void
@@ -45,6 +89,302 @@ static void rotenc_toggle_test_pin(void)
 #endif
 }
 
+/**
+ * @brief Push an event in the ring and wake up the consumer task. 
+ *        Only the producer (decoder ISR or debounce callback) writes the 
+ *        head index and the dropped steps.
+ * @param[in] ring Pointer to the ring of the rotary encoder instance.
+ * @param[in] event Pointer to the event to store.
+ * @return void
+ */
+static void IRAM_ATTR rotenc_ring_push(rotenc_ring_t * ring, const rotenc_event_t * event)
+{
+    uint32_t head = ring->head;
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    if ((head - tail) >= ring->depth) {
+        // The consumers sum the steps, so the steps of the dropped event
+        // are kept and added to the next one that fits in the ring.
+        ring->dropped_steps += event->steps;
+        ring->overflows++;
+        rotenc_trace(ROTENC_TRACE_OVERFLOW, ring->overflows);
+        return;
+    }
+
+    rotenc_event_t * slot = &ring->events[head & (ring->depth - 1)];
+    *slot = *event;
+    slot->steps += ring->dropped_steps;
+    ring->dropped_steps = 0;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+    TaskHandle_t consumer = ring->consumer;
+    if (consumer) {
+        if (xPortInIsrContext()) {
+            BaseType_t woken = pdFALSE;
+            vTaskNotifyGiveFromISR(consumer, &woken);
+            portYIELD_FROM_ISR(woken);
+        } else {
+            xTaskNotifyGive(consumer);
+        }
+    }
+}
+
+/**
+ * @brief Pop up to max_events from the ring without blocking.
+ *        Only the consumer task writes the tail index.
+ * @param[in] ring Pointer to the ring of the rotary encoder instance.
+ * @param[out] events Array to store the events.
+ * @param[in] max_events Size of the array.
+ * @return Number of events stored.
+ */
+static uint32_t rotenc_ring_pop(rotenc_ring_t * ring, rotenc_event_t * events, uint32_t max_events)
+{
+    uint32_t tail = ring->tail;
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t count = head - tail;
+
+    if (count > max_events) {
+        count = max_events;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        events[i] = ring->events[(tail + i) & (ring->depth - 1)];
+    }
+
+    __atomic_store_n(&ring->tail, tail + count, __ATOMIC_RELEASE);
+    return count;
+}
+
+/**
+ * @brief Apply the acceleration curve to the velocity.
+ * @param[in] accel Acceleration curve.
+ * @param[in] velocity Speed of rotation in steps per second.
+ * @return Steps for the event, from 1 to max_steps.
+ */
+static uint32_t IRAM_ATTR rotenc_accel_steps(const rotenc_accel_t * accel, uint32_t velocity)
+{
+    if ((accel->max_steps <= 1) || (velocity <= accel->min_rate)) {
+        return 1;
+    } else if (velocity >= accel->max_rate) {
+        return accel->max_steps;
+    }
+    return 1 + ((velocity - accel->min_rate) * (accel->max_steps - 1)) / 
+               (accel->max_rate - accel->min_rate);
+}
+
+/**
+ * @brief Update the position by one step, and notify the event by ring or callback.
+ * @param[in] handle Pointer to allocated rotary encoder instance.
+ * @param[in] forward True when the step is clockwise before applying the flip.
+ * @return void
+ */
+static void IRAM_ATTR rotenc_step(rotenc_handle_t * handle, bool forward)
+{
+    rotenc_direction_t last_direction = handle->state.direction;
+    int64_t now = esp_timer_get_time();
+    int64_t elapsed = now - handle->state.timestamp_us;
+
+    // Reverses rotation direction when flip is enabled.
+    if (forward == !handle->flip_direction) {
+        ++handle->state.position;
+        handle->state.direction = ROTENC_CW;
+    } else {
+        --handle->state.position;
+        handle->state.direction = ROTENC_CCW;
+    }
+
+    // Average the instant rate with the previous one to filter the jitter 
+    // between detents, a pause or a reversal restarts it.
+    uint32_t rate = (elapsed > 0) ? (uint32_t)(1000000 / elapsed) : 1000000;
+    if ((elapsed < VELOCITY_IDLE_US) && (last_direction == handle->state.direction)) {
+        handle->state.velocity = (handle->state.velocity + rate) / 2;
+    } else {
+        handle->state.velocity = rate;
+    }
+    handle->state.timestamp_us = now;
+    handle->state.cycles = esp_cpu_get_cycle_count();
+
+    int32_t steps = rotenc_accel_steps(&handle->accel, handle->state.velocity);
+    handle->state.steps = (handle->state.direction == ROTENC_CW) ? steps : -steps;
+    rotenc_trace(ROTENC_TRACE_STEP, handle->state.position);
+
+    rotenc_event_t event = {
+        .position = handle->state.position,
+        .direction = handle->state.direction,
+        .timestamp_us = handle->state.timestamp_us,
+        .velocity = handle->state.velocity,
+        .steps = handle->state.steps,
+        .cycles = handle->state.cycles,
+        .isr_cycles = handle->state.isr_cycles,
+    };
+    
+    if (handle->ring.events) {
+        rotenc_ring_push(&handle->ring, &event);
+    } else if (handle->event_callback) {
+        handle->event_callback(event);
+    }
+}
+
+#if CONFIG_ROT_ENC_BACKEND_PCNT
+/**
+ * @brief The pulse counter reached a watch point (one detent), the unit
+ *        clears the count by itself because the points are the limits.
+ * @param[in] unit Pulse counter unit.
+ * @param[in] edata Watch point reached.
+ * @param[in] user_ctx Pointer to allocated rotary encoder instance.
+ * @return false, the ring yields by itself when it wakes up a task.
+ */
+static bool IRAM_ATTR rotenc_pcnt_on_reach(pcnt_unit_handle_t unit, 
+                                           const pcnt_watch_event_data_t *edata, 
+                                           void *user_ctx)
+{
+    ((rotenc_handle_t *)user_ctx)->state.isr_cycles = esp_cpu_get_cycle_count();
+    rotenc_toggle_test_pin();
+    rotenc_step((rotenc_handle_t *)user_ctx, edata->watch_point_value > 0);
+    return false;
+}
+
+/**
+ * @brief Configure a pulse counter unit to decode the quadrature in 4x mode.
+ * @param[in] handle Pointer to allocated rotary encoder instance.
+ * @return ESP_OK if successful, or ESP_ERR_* if an error.
+ */
+static esp_err_t rotenc_init_pcnt(rotenc_handle_t * handle)
+{
+    const pcnt_unit_config_t unit_config = {
+        .high_limit = PCNT_COUNTS_PER_DETENT,
+        .low_limit = -PCNT_COUNTS_PER_DETENT,
+    };
+    ESP_ERROR_CHECK(pcnt_new_unit(&unit_config, &handle->pcnt_unit));
+
+    const pcnt_glitch_filter_config_t filter_config = {
+        .max_glitch_ns = CONFIG_ROT_ENC_PCNT_GLITCH_NS,
+    };
+    ESP_ERROR_CHECK(pcnt_unit_set_glitch_filter(handle->pcnt_unit, &filter_config));
+
+    const pcnt_chan_config_t chan_a_config = {
+        .edge_gpio_num = handle->pin_clk,
+        .level_gpio_num = handle->pin_dta,
+    };
+    ESP_ERROR_CHECK(pcnt_new_channel(handle->pcnt_unit, &chan_a_config, &handle->pcnt_chan_a));
+
+    const pcnt_chan_config_t chan_b_config = {
+        .edge_gpio_num = handle->pin_dta,
+        .level_gpio_num = handle->pin_clk,
+    };
+    ESP_ERROR_CHECK(pcnt_new_channel(handle->pcnt_unit, &chan_b_config, &handle->pcnt_chan_b));
+
+    // Both channels count every edge, the level of the other pin gives the direction.
+    pcnt_channel_set_edge_action(handle->pcnt_chan_a, 
+                                 PCNT_CHANNEL_EDGE_ACTION_DECREASE, PCNT_CHANNEL_EDGE_ACTION_INCREASE);
+    pcnt_channel_set_level_action(handle->pcnt_chan_a, 
+                                  PCNT_CHANNEL_LEVEL_ACTION_KEEP, PCNT_CHANNEL_LEVEL_ACTION_INVERSE);
+    pcnt_channel_set_edge_action(handle->pcnt_chan_b, 
+                                 PCNT_CHANNEL_EDGE_ACTION_INCREASE, PCNT_CHANNEL_EDGE_ACTION_DECREASE);
+    pcnt_channel_set_level_action(handle->pcnt_chan_b, 
+                                  PCNT_CHANNEL_LEVEL_ACTION_KEEP, PCNT_CHANNEL_LEVEL_ACTION_INVERSE);
+
+    gpio_set_pull_mode(handle->pin_clk, GPIO_PULLUP_ONLY);
+    gpio_set_pull_mode(handle->pin_dta, GPIO_PULLUP_ONLY);
+
+    ESP_ERROR_CHECK(pcnt_unit_add_watch_point(handle->pcnt_unit, PCNT_COUNTS_PER_DETENT));
+    ESP_ERROR_CHECK(pcnt_unit_add_watch_point(handle->pcnt_unit, -PCNT_COUNTS_PER_DETENT));
+
+    const pcnt_event_callbacks_t cbs = {
+        .on_reach = rotenc_pcnt_on_reach,
+    };
+    ESP_ERROR_CHECK(pcnt_unit_register_event_callbacks(handle->pcnt_unit, &cbs, handle));
+
+    ESP_ERROR_CHECK(pcnt_unit_enable(handle->pcnt_unit));
+    ESP_ERROR_CHECK(pcnt_unit_clear_count(handle->pcnt_unit));
+    return pcnt_unit_start(handle->pcnt_unit);
+}
+
+/**
+ * @brief Stop and release the pulse counter unit and its channels.
+ * @param[in] handle Pointer to allocated rotary encoder instance.
+ * @return void
+ */
+static void rotenc_uninit_pcnt(rotenc_handle_t * handle)
+{
+    if (handle->pcnt_unit) {
+        pcnt_unit_stop(handle->pcnt_unit);
+        pcnt_unit_disable(handle->pcnt_unit);
+        pcnt_del_channel(handle->pcnt_chan_a);
+        pcnt_del_channel(handle->pcnt_chan_b);
+        pcnt_del_unit(handle->pcnt_unit);
+        handle->pcnt_unit = NULL;
+    }
+}
+#endif
+
+#if CONFIG_ROT_ENC_BACKEND_TABLE
+/**
+ * @brief Read both pins and decode the transition from the previous state,
+ *        an event is generated when the accumulated quarter steps reach 
+ *        the resolution. Both pins share this handler.
+ * @param[in] args Pointer to allocated rotary encoder instance.
+ * @return void
+ */
+static void IRAM_ATTR rotenc_isr_table(void * args)
+{
+    rotenc_handle_t * handle = (rotenc_handle_t *)args;
+    handle->state.isr_cycles = esp_cpu_get_cycle_count();
+
+    uint8_t state = (gpio_get_level(handle->pin_clk) << 1) | gpio_get_level(handle->pin_dta);
+    int8_t quarter = table_steps[(handle->table_state << 2) | state];
+    handle->table_state = state;
+
+    if (quarter) {
+        rotenc_toggle_test_pin();
+
+        handle->table_accum += quarter;
+        if (handle->table_accum >= (int8_t)handle->resolution) {
+            handle->table_accum -= handle->resolution;
+            rotenc_step(handle, true);
+        } else if (handle->table_accum <= -(int8_t)handle->resolution) {
+            handle->table_accum += handle->resolution;
+            rotenc_step(handle, false);
+        }
+    }
+
+    // Realign to the detent, a missed edge must not shift the next events.
+    if ((state == TABLE_STATE_REST && handle->resolution != ROTENC_RES_QUARTER) ||
+        (state == TABLE_STATE_HALF && handle->resolution == ROTENC_RES_HALF)) {
+        handle->table_accum = 0;
+    }
+}
+
+/**
+ * @brief Configure both pins to interrupt on any edge for the table decoder.
+ * @param[in] handle Pointer to allocated rotary encoder instance.
+ * @return ESP_OK if successful, or ESP_ERR_* if an error.
+ */
+static esp_err_t rotenc_init_table(rotenc_handle_t * handle)
+{
+    gpio_reset_pin(handle->pin_clk);
+    gpio_set_pull_mode(handle->pin_clk, GPIO_PULLUP_ONLY);
+    gpio_set_direction(handle->pin_clk, GPIO_MODE_INPUT);
+    gpio_set_intr_type(handle->pin_clk, GPIO_INTR_ANYEDGE);
+
+    gpio_reset_pin(handle->pin_dta);
+    gpio_set_pull_mode(handle->pin_dta, GPIO_PULLUP_ONLY);
+    gpio_set_direction(handle->pin_dta, GPIO_MODE_INPUT);
+    gpio_set_intr_type(handle->pin_dta, GPIO_INTR_ANYEDGE);
+
+    handle->table_state = (gpio_get_level(handle->pin_clk) << 1) | gpio_get_level(handle->pin_dta);
+    handle->table_accum = 0;
+
+    // install interrupt handlers
+    esp_err_t err = gpio_isr_handler_add(handle->pin_clk, rotenc_isr_table, handle);
+    if (err == ESP_OK) {
+        err = gpio_isr_handler_add(handle->pin_dta, rotenc_isr_table, handle);
+    }
+    return err;
+}
+#endif
+
+#if !CONFIG_ROT_ENC_BACKEND_PCNT && !CONFIG_ROT_ENC_BACKEND_TABLE
 /**
  * @brief Enable clock IRQ and disable data IRQ.
  * @param[in] arg Pointer to allocated rotary encoder instance.
@@ -84,26 +424,7 @@ static void IRAM_ATTR rotenc_debounce_callback(void *arg)
         
         rotenc_toggle_test_pin();
         
-        // Reverses rotation direction when flip is enabled.
-        bool data_level = handle->irq_data_level ? true : false;
-        if (data_level == !handle->flip_direction) {
-            ++handle->state.position;
-            handle->state.direction = ROTENC_CW;
-        } else {
-            --handle->state.position;
-            handle->state.direction = ROTENC_CCW;
-        }
-
-        rotenc_event_t event = {
-            .position = handle->state.position,
-            .direction = handle->state.direction,
-        };
-        
-        if (handle->q_event.queue) {
-            xQueueOverwrite(handle->q_event.queue, &event);
-        } else if (handle->event_callback) {
-            handle->event_callback(event);
-        }
+        rotenc_step(handle, handle->irq_data_level ? true : false);
     } else { 
         rotenc_enable_clk_irq(handle);
     }
@@ -130,6 +451,7 @@ static void IRAM_ATTR rotenc_isr_dta(void * args)
 static void IRAM_ATTR rotenc_isr_clk(void * args)
 {
     rotenc_handle_t * handle = (rotenc_handle_t *)args;
+    handle->state.isr_cycles = esp_cpu_get_cycle_count();
     rotenc_disable_clk_irq(handle);
 
     rotenc_toggle_test_pin();
@@ -139,6 +461,7 @@ static void IRAM_ATTR rotenc_isr_clk(void * args)
     esp_timer_stop(handle->debounce_timer);
     ESP_ERROR_CHECK(esp_timer_start_once(handle->debounce_timer, handle->debounce_us));       
 }
+#endif
 
 /**
  * @brief When the anti-bounce timer expires, check if the button's callback function 
@@ -190,9 +513,22 @@ esp_err_t rotenc_init(rotenc_handle_t * handle,
         handle->state.direction = ROTENC_NOT_SET;
         handle->debounce_us = debounce_us;
         handle->flip_direction = false;
+        handle->resolution = ROTENC_RES_FULL;
+        handle->accel.max_steps = 1;
+        handle->state.timestamp_us = 0;
+        handle->state.velocity = 0;
+        handle->state.steps = 0;
         handle->event_callback = NULL;
-        handle->q_event.queue = NULL;
+        handle->ring.events = NULL;
+        handle->ring.consumer = NULL;
  
+        // The isr service is also used by the push button.
+        gpio_install_isr_service(ESP_INTR_FLAG_EDGE);
+#if CONFIG_ROT_ENC_BACKEND_PCNT
+        err = rotenc_init_pcnt(handle);
+#elif CONFIG_ROT_ENC_BACKEND_TABLE
+        err = rotenc_init_table(handle);
+#else
         const esp_timer_create_args_t debounce_timer_args = {
             .callback = &rotenc_debounce_callback,
             .arg = (void *)handle,
@@ -212,10 +548,10 @@ esp_err_t rotenc_init(rotenc_handle_t * handle,
         gpio_set_direction(handle->pin_dta, GPIO_MODE_INPUT);
         gpio_set_intr_type(handle->pin_dta, GPIO_INTR_ANYEDGE);
         
-        gpio_install_isr_service(ESP_INTR_FLAG_EDGE);
         // install interrupt handlers
         gpio_isr_handler_add(handle->pin_clk, rotenc_isr_clk, handle);
         gpio_isr_handler_add(handle->pin_dta, rotenc_isr_dta, handle);
+#endif
 #if CONFIG_TEST_PIN_ENABLE
         gpio_reset_pin(CONFIG_ROT_ENC_TEST_PIN_GPIO);
         gpio_set_direction(CONFIG_ROT_ENC_TEST_PIN_GPIO, GPIO_MODE_INPUT_OUTPUT);
@@ -275,16 +611,64 @@ esp_err_t rotenc_flip_direction(rotenc_handle_t * handle)
     return err;
 }
 
+esp_err_t rotenc_set_resolution(rotenc_handle_t * handle, rotenc_resolution_t resolution)
+{
+    esp_err_t err = ESP_OK;
+    if (handle && (resolution == ROTENC_RES_FULL || resolution == ROTENC_RES_HALF || 
+                   resolution == ROTENC_RES_QUARTER)) {
+#if CONFIG_ROT_ENC_BACKEND_TABLE
+        gpio_intr_disable(handle->pin_clk);
+        gpio_intr_disable(handle->pin_dta);
+        handle->resolution = resolution;
+        handle->table_accum = 0;
+        gpio_intr_enable(handle->pin_clk);
+        gpio_intr_enable(handle->pin_dta);
+#else
+        if (resolution != ROTENC_RES_FULL) {
+            ESP_LOGE(TAG, "the backend only supports full resolution");
+            err = ESP_ERR_NOT_SUPPORTED;
+        }
+#endif
+    } else {
+        ESP_LOGE(TAG, "handle is NULL or invalid resolution");
+        err = ESP_ERR_INVALID_ARG;
+    }
+    return err;
+}
+
+esp_err_t rotenc_set_acceleration(rotenc_handle_t * handle, uint32_t min_rate, 
+                                  uint32_t max_rate, uint8_t max_steps)
+{
+    esp_err_t err = ESP_OK;
+    if (handle && (max_rate > min_rate) && max_steps) {
+        handle->accel.min_rate = min_rate;
+        handle->accel.max_rate = max_rate;
+        handle->accel.max_steps = max_steps;
+    } else {
+        ESP_LOGE(TAG, "handle is NULL or invalid curve");
+        err = ESP_ERR_INVALID_ARG;
+    }
+    return err;
+}
+
 esp_err_t rotenc_uninit(rotenc_handle_t * handle)
 {
     esp_err_t err = ESP_OK;
     if (handle) {
+#if CONFIG_ROT_ENC_BACKEND_PCNT
+        rotenc_uninit_pcnt(handle);
+#else
         gpio_isr_handler_remove(handle->pin_clk);
         gpio_isr_handler_remove(handle->pin_dta);
+#if !CONFIG_ROT_ENC_BACKEND_TABLE
+        esp_timer_stop(handle->debounce_timer);
+#endif
+#endif
 
-        if (handle->q_event.queue) {
-            vQueueDelete(handle->q_event.queue);
-            handle->q_event.queue = NULL;
+        if (handle->ring.events) {
+            free(handle->ring.events);
+            handle->ring.events = NULL;
+            handle->ring.consumer = NULL;
         }
         
         gpio_reset_pin(handle->pin_clk);
@@ -309,10 +693,10 @@ esp_err_t rotenc_set_event_callback(rotenc_handle_t * handle, rotenc_event_cb_t
 esp_err_t err = ESP_OK;
 
     if (handle) {
-        if (!handle->q_event.queue) {
+        if (!handle->ring.events) {
             handle->event_callback = callback;
         } else {
-            ESP_LOGE(TAG, "could not be created because there is a queue created.");
+            ESP_LOGE(TAG, "could not be created because there is a ring created.");
             err = ESP_ERR_INVALID_STATE;
         }
     } else {
@@ -324,50 +708,96 @@ esp_err_t err = ESP_OK;
 
 esp_err_t rotenc_set_event_queue(rotenc_handle_t * handle, uint32_t wait_time_ms)
 {
-    esp_err_t err = ESP_OK;
+    return rotenc_set_event_ring(handle, ROTENC_DEFAULT_RING_DEPTH, wait_time_ms);
+}
 
-    if (handle) {
-        if (!handle->event_callback) {   
-            handle->q_event.queue = xQueueCreate(1, sizeof(rotenc_event_t));
+esp_err_t rotenc_set_event_ring(rotenc_handle_t * handle, uint32_t depth, uint32_t wait_time_ms)
+{
+    esp_err_t err = ESP_OK;
 
-            handle->q_event.wait_ms = wait_time_ms;
+    if (handle && depth) {
+        if (!handle->event_callback && !handle->ring.events) {   
+            // Round up to a power of two, the free running indexes are masked.
+            uint32_t size = 1;
+            while (size < depth) {
+                size <<= 1;
+            }
 
-            if (!handle->q_event.queue) {
-                ESP_LOGE(TAG, "queue could not be created");
+            handle->ring.events = calloc(size, sizeof(rotenc_event_t));
+            if (handle->ring.events) {
+                handle->ring.depth = size;
+                handle->ring.head = 0;
+                handle->ring.tail = 0;
+                handle->ring.overflows = 0;
+                handle->ring.dropped_steps = 0;
+                handle->ring.consumer = NULL;
+                handle->ring.wait_ms = wait_time_ms;
+            } else {
+                ESP_LOGE(TAG, "ring could not be created");
                 err = ESP_ERR_NO_MEM;
             }
         } else {
-            ESP_LOGE(TAG, "could not be created because there is a callback created.");
+            ESP_LOGE(TAG, "could not be created because there is a callback or ring created.");
             err = ESP_ERR_INVALID_STATE;
         }
     } else {
-        ESP_LOGE(TAG, "handle is NULL");
+        ESP_LOGE(TAG, "handle is NULL or depth is zero");
         err = ESP_ERR_INVALID_ARG;
     }
     return err;
 }
 
-esp_err_t rotenc_wait_event(rotenc_handle_t * handle, rotenc_event_t* event)
+esp_err_t rotenc_wait_events(rotenc_handle_t * handle, rotenc_event_t * events, 
+                             uint32_t max_events, uint32_t * count)
 {
     esp_err_t err = ESP_OK;
-    if (handle && handle->q_event.queue && event) {
-        if (xQueueReceive(handle->q_event.queue, event, 
-                          handle->q_event.wait_ms / portTICK_PERIOD_MS) != pdTRUE) {
-            err = ESP_ERR_TIMEOUT;
+    if (handle && handle->ring.events && events && max_events && count) {
+        // Register before checking the ring, so an event pushed in between
+        // leaves the notification pending and the take returns at once.
+        handle->ring.consumer = xTaskGetCurrentTaskHandle();
+
+        *count = rotenc_ring_pop(&handle->ring, events, max_events);
+        if (*count == 0) {
+            ulTaskNotifyTake(pdTRUE, handle->ring.wait_ms / portTICK_PERIOD_MS);
+            *count = rotenc_ring_pop(&handle->ring, events, max_events);
+            if (*count == 0) {
+                err = ESP_ERR_TIMEOUT;
+            }
         }
     } else {
-        ESP_LOGE(TAG, "handle and/or queue, event is NULL");
+        ESP_LOGE(TAG, "handle and/or ring, events is NULL");
         err = ESP_ERR_INVALID_ARG;
     }
     return err;
 }
 
+esp_err_t rotenc_wait_event(rotenc_handle_t * handle, rotenc_event_t* event)
+{
+    uint32_t count;
+    return rotenc_wait_events(handle, event, 1, &count);
+}
+
+void rotenc_set_trace_callback(rotenc_trace_cb_t callback)
+{
+    trace_callback = callback;
+}
+
+uint32_t rotenc_get_overflows(const rotenc_handle_t * handle)
+{
+    return handle ? handle->ring.overflows : 0;
+}
+
 esp_err_t rotenc_polling(const rotenc_handle_t * handle, rotenc_event_t * event)
 {
     esp_err_t err = ESP_OK;
     if (handle && event) {
         event->position = handle->state.position;
         event->direction = handle->state.direction;
+        event->timestamp_us = handle->state.timestamp_us;
+        event->velocity = handle->state.velocity;
+        event->steps = handle->state.steps;
+        event->cycles = handle->state.cycles;
+        event->isr_cycles = handle->state.isr_cycles;
     } else {
         ESP_LOGE(TAG, "handle and/or state is NULL");
         err = ESP_ERR_INVALID_ARG;
@@ -379,8 +809,15 @@ esp_err_t rotenc_reset(rotenc_handle_t * handle)
 {
     esp_err_t err = ESP_OK;
     if (handle) {
+#if CONFIG_ROT_ENC_BACKEND_PCNT
+        pcnt_unit_clear_count(handle->pcnt_unit);
+#elif CONFIG_ROT_ENC_BACKEND_TABLE
+        handle->table_accum = 0;
+#endif
         handle->state.position = 0;
         handle->state.direction = ROTENC_NOT_SET;
+        handle->state.velocity = 0;
+        handle->state.steps = 0;
     } else {
         ESP_LOGE(TAG, "handle is NULL");
         err = ESP_ERR_INVALID_ARG;
@@ -45,6 +45,33 @@
  * To obtain the temperature, the simplified Steniarth's equation is applied, 
  * which uses a logarithm of the coefficient provided by the manufacturer of 
  * the thermistor to linerize it.
+ *
+ * Since the ESP32-C3 has no FPU, the logarithm is expensive, so optionally 
+ * thermistor_init precomputes a table of centi-degrees for each step of mV 
+ * between 0 and vsource, and the conversion is reduced to a linear 
+ * interpolation between two entries of the table.
+ *
+ * The ADC can be read in two modes, selected in thermistor_init: oneshot, 
+ * where each reading takes a burst of blocking samples, or continuous, where 
+ * the DMA of the ADC converts in the background and each frame is averaged 
+ * in the conversion done isr into a ring buffer, so reading the temperature 
+ * takes constant time.
+ *
+ * Optionally, the samples go through the pipeline of thermistor_filter.h: 
+ * a sliding median on each raw sample, and an outlier gate plus an EMA on 
+ * each reading, which allows fewer samples per reading.
+ *
+ * Several thermistors can share one ADC unit through a thermistor_bus_t, 
+ * which owns the ADC and calibration handles and reads all the channels in 
+ * a single pass with thermistor_bus_scan. thermistor_init adds the 
+ * thermistor to an internal bus of ADC_UNIT_1, so it can be called once 
+ * for each thermistor.
+ *
+ * The beta model drifts away from the nominal temperature, so the full 
+ * Steinhart-Hart equation can be used instead, with the A, B, C coefficients 
+ * fitted from two or three reference points captured on the device, and 
+ * stored in NVS (see thermistor_calibrate). The table is rebuilt from the 
+ * coefficients, so the conversion keeps the same cost.
  */
 
 #ifndef __THERMISTOR_H__
@@ -57,32 +84,172 @@ extern "C" {
 #include "esp_adc/adc_cali.h"
 #include "esp_adc/adc_cali_scheme.h"
 #include "esp_adc/adc_oneshot.h"
+#include "esp_adc/adc_continuous.h"
+
+#include "thermistor_filter.h"
+
+#define THERMISTOR_LUT_MAX_ENTRIES  256     /**< Maximum number of entries of the conversion table. */
+#define THERMISTOR_RING_SIZE        16      /**< Number of frame averages kept in continuous mode. */
+#define THERMISTOR_MAX_DECIMATION_BITS  3   /**< Extra bits that the average of 64 samples can provide. */
+#define THERMISTOR_BUS_MAX_CHANNELS 4       /**< Maximum number of thermistors of a bus. */
+
+/**
+ * @brief Acquisition mode of the ADC.
+ */
+typedef enum
+{
+    THERMISTOR_MODE_ONESHOT = 0,    /**< Blocking burst of samples on each reading. */
+    THERMISTOR_MODE_CONTINUOUS,     /**< DMA conversions in background, averaged into a ring buffer. */
+} thermistor_mode_t;
+
+/**
+ * @brief Ring buffer with the average of the last frames converted by the DMA.
+ *
+ * @note Only the conversion done isr writes it, readers only access filtered_raw.
+ */
+typedef struct
+{
+    uint32_t frames[THERMISTOR_RING_SIZE];  /**< Average raw value of each frame, with 3 bits of fraction. */
+    uint32_t sum;                           /**< Sum of the valid frames. */
+    uint8_t idx;                            /**< Position of the next frame to write. */
+    uint8_t count;                          /**< Number of valid frames. */
+    volatile uint32_t filtered_raw;         /**< Average of the valid frames, 0 until the first frame. */
+} thermistor_ring_t;
+
+/**
+ * @brief Model used to convert the resistance to temperature.
+ */
+typedef enum
+{
+    THERMISTOR_MODEL_BETA = 0,          /**< Simplified equation with the beta coefficient. */
+    THERMISTOR_MODEL_STEINHART_HART,    /**< Steinhart-Hart equation with the A, B, C coefficients. */
+} thermistor_model_t;
+
+/**
+ * @brief Reference point to calibrate the Steinhart-Hart coefficients.
+ */
+typedef struct
+{
+    float celsius;                  /**< Reference temperature in degrees Celsius. */
+    float resistance;               /**< Resistance of the thermistor measured at the reference. */
+} thermistor_cal_point_t;
+
+struct thermistor_handle;
+
+/**
+ * @brief Structure to storing an ADC unit shared by several thermistors.
+ *
+ * @note Call thermistor_bus_init() to initialize the structure
+ */
+typedef struct
+{
+    thermistor_mode_t mode;         /**< Acquisition mode of the ADC. */
+    adc_unit_t unit;                /**< ADC unit of the channels. */
+    adc_oneshot_unit_handle_t adc_h;/**< ADC handle in oneshot mode. */
+    adc_continuous_handle_t adc_cont_h; /**< ADC handle in continuous mode. */
+    bool calibrated;                /**< The calibration ADC was succesfull. */  
+    adc_cali_handle_t adc_cali_h;   /**< Calibration information handle. */                       
+    bool running;                   /**< The continuous conversions are started. */
+    uint8_t count;                  /**< Number of thermistors added. */
+    struct thermistor_handle* channels[THERMISTOR_BUS_MAX_CHANNELS]; /**< Thermistors added. */
+} thermistor_bus_t;
 
 /**
  * @brief Structure to storing the thermistor instance.
  *
- * @note Call thermistor_init() to initialize the structure
+ * @note Call thermistor_init() or thermistor_bus_add() to initialize the structure
  */
-typedef struct  
+typedef struct thermistor_handle
 {
-    adc_oneshot_unit_handle_t adc_h;/**< ADC handle. */
+    thermistor_bus_t* bus;          /**< Bus that owns the ADC. */
+    thermistor_ring_t ring;         /**< Frames converted in continuous mode. */
     adc_channel_t channel;          /**< ADC channel pin where the thermistor is connected. */
     float serial_resistance;        /**< Value of the serial resistor connected to +3V. */
     float nominal_resistance;       /**< Nominal resistance at 25 degrees Celsius of thermistor. */
     float nominal_temperature;      /**< Nominal temperature of the thermistor, usually 25 degress Celsius. */
     float beta_val;                 /**< Beta coefficient of the thermistor. */
     float vsource;                  /**< Voltage to which the serial resistance is connected in mV, usually 3300.0. */
-    float t_resistance;             /**< Calculated thermistor resistance. */
+    float t_resistance;             /**< Calculated thermistor resistance, not updated by the table. */
+    thermistor_model_t model;       /**< Model of the conversion. */
+    double sh_a;                    /**< Steinhart-Hart A coefficient. */
+    double sh_b;                    /**< Steinhart-Hart B coefficient. */
+    double sh_c;                    /**< Steinhart-Hart C coefficient. */
     uint32_t vout;                  /**< Voltage in mV of thermistor channel. */ 
-    bool calibrated;                /**< The calibration ADC was succesfull. */  
-    adc_cali_handle_t adc_cali_h;   /**< Calibration information handle. */                       
+    uint8_t decimation_bits;        /**< Fraction bits of the average used to interpolate the calibration. */
+    bool filter_enabled;            /**< The samples go through the filter pipeline. */
+    thermistor_filter_t filter;     /**< State of the filter pipeline. */
+    uint16_t lut_step_mv;           /**< Step in mV between entries of the table, 0 = table disabled. */
+    uint16_t lut_entries;           /**< Number of valid entries of the table. */
+    int16_t lut[THERMISTOR_LUT_MAX_ENTRIES]; /**< Temperature in centi-degrees Celsius for each step of vout. */
 } thermistor_handle_t;
 
+/**
+ * @brief Initialize a bus that shares one ADC unit between several thermistors.
+ *
+ * This function creates the ADC unit in the selected mode, and calibrates 
+ * the reference voltage. In continuous mode, the conversions start when the 
+ * first thermistor is added.
+ *
+ * @param   bus Pointer to store the bus information.
+ * @param   unit ADC unit of the channels.
+ * @param   mode Acquisition mode of the ADC, oneshot or continuous (DMA).
+ *
+ * @return
+ *      - ESP_OK: Initialization OK.
+ */
+esp_err_t thermistor_bus_init(thermistor_bus_t* bus, adc_unit_t unit, thermistor_mode_t mode);
+
+/**
+ * @brief Add a thermistor to the bus, with its own coefficients.
+ *
+ * In continuous mode, the conversions are restarted with the new channel 
+ * in the pattern.
+ *
+ * @param   bus Pointer of the bus information.
+ * @param   th  Pointer to store the driver information.
+ * @param   channel ADC channel pin where the thermistor is connected.
+ * @param   serial_resistante Value of the serial resistor connected to +3V.
+ * @param   nominal_resistance Nominal resistance at 25 degrees Celsius of thermistor.
+ * @param   nominal_temperature Nominal temperature of the thermistor, usually 25 degress Celsius.
+ * @param   beta_val Beta coefficient of the thermistor.
+ * @param   vsource Voltage to which the series resistance is connected in mV, typically 3300.0.
+ * @param   lut_step_mv Resolution in mV of the conversion table, 0 to always use the 
+ *                      Steinhart equation.
+ *
+ * @return
+ *      - ESP_OK: Success.
+ *      - ESP_ERR_NO_MEM: The bus is full.
+ *      - ESP_ERR_INVALID_ARG: The table resolution is too fine for vsource.
+ */
+esp_err_t thermistor_bus_add(thermistor_bus_t* bus, thermistor_handle_t* th,
+                             adc_channel_t channel, float serie_resistance, 
+                             float nominal_resistance, float nominal_temperature, 
+                             float beta_val, float vsource, uint16_t lut_step_mv);
+
+/**
+ * @brief Read the vout of all the thermistors of the bus in a single pass.
+ *
+ * In oneshot mode, the samples of the channels are interleaved in the same 
+ * burst; in continuous mode the rings are read without blocking. The result 
+ * is stored in the vout field of each thermistor, convert it with 
+ * thermistor_vout_to_celsius.
+ *
+ * @param   bus Pointer of the bus information.
+ *
+ * @return
+ *      - ESP_OK: Success.
+ *      - ESP_FAIL: A sample could not be read, the vout are not updated.
+ *      - ESP_ERR_INVALID_STATE: The ADC is not calibrated, or in continuous 
+ *        mode a channel has no frame yet; the vout are not updated.
+ */
+esp_err_t thermistor_bus_scan(thermistor_bus_t* bus);
+
 /**
  * @brief Initialice the thermistor driver.
  *
- * This function configure the ADC, and calibrate the reference voltage
- * to read the vout from resitance divider.
+ * This function adds the thermistor to the internal bus of ADC_UNIT_1, 
+ * which configures the ADC and calibrates the reference voltage the first 
+ * time, to read the vout from resitance divider.
  *
  * @param   th  Pointer to store the driver information.
  * @param   channel ADC channel pin where the thermistor is connected.
@@ -91,20 +258,28 @@ typedef struct
  * @param   nominal_temperature Nominal temperature of the thermistor, usually 25 degress Celsius.
  * @param   beta_val Beta coefficient of the thermistor.
  * @param   vsource Voltage to which the series resistance is connected in mV, typically 3300.0.
+ * @param   lut_step_mv Resolution in mV of the conversion table, 0 to always use the 
+ *                      Steinhart equation. vsource / lut_step_mv + 2 must not exceed 
+ *                      THERMISTOR_LUT_MAX_ENTRIES.
+ * @param   mode Acquisition mode of the ADC, oneshot or continuous (DMA).
  *
  * @return
  *      - ESP_OK: Initialization OK.
+ *      - ESP_ERR_INVALID_ARG: The table resolution is too fine for vsource.
+ *      - ESP_ERR_INVALID_STATE: The internal bus was initialized in another mode.
  */
 esp_err_t thermistor_init(thermistor_handle_t* th,
                           adc_channel_t channel, float serie_resistance, 
                           float nominal_resistance, float nominal_temperature, 
-                          float beta_val, float vsource);
+                          float beta_val, float vsource, uint16_t lut_step_mv,
+                          thermistor_mode_t mode);
 
 /**
  * @brief Read the vout of the resistance divider in mV.
  *
  * This function reads the value from the ADC and converts it to voltage in mV, 
- * using the calibration information from the reference.
+ * using the calibration information from the reference. In continuous mode 
+ * it does not block, it converts the average of the ring buffer.
  *
  * @param   th  Pointer of the driver information.
  *
@@ -113,16 +288,133 @@ esp_err_t thermistor_init(thermistor_handle_t* th,
  */
 uint32_t thermistor_read_vout(thermistor_handle_t* th);
 
+/**
+ * @brief Set the number of extra bits obtained by oversampling.
+ *
+ * The samples are accumulated in integer, and the average keeps up to 
+ * THERMISTOR_MAX_DECIMATION_BITS of fraction, which are used to interpolate 
+ * between two codes of the ADC calibration. With 0 bits, the average is 
+ * rounded to the nearest code.
+ *
+ * @param   th  Pointer of the driver information.
+ * @param   bits Extra bits, 0 to THERMISTOR_MAX_DECIMATION_BITS.
+ *
+ * @return
+ *      - ESP_OK: Success.
+ *      - ESP_ERR_INVALID_ARG: Too many bits.
+ */
+esp_err_t thermistor_set_decimation(thermistor_handle_t* th, uint8_t bits);
+
+/**
+ * @brief Enable the filter pipeline of the samples.
+ *
+ * In oneshot mode each reading takes cfg->samples samples through the median, 
+ * in continuous mode the median is applied in the isr to each sample of the 
+ * frames. In both modes the outlier gate and the EMA are applied on each 
+ * reading. Call it before the first reading.
+ *
+ * @param   th  Pointer of the driver information.
+ * @param   cfg Configuration of the pipeline, NULL to disable it.
+ *
+ * @return
+ *      - ESP_OK: Success.
+ *      - ESP_ERR_INVALID_ARG: No samples per reading.
+ */
+esp_err_t thermistor_set_filter(thermistor_handle_t* th, const thermistor_filter_config_t* cfg);
+
+/**
+ * @brief Use the Steinhart-Hart equation, 1/T = A + B ln(R) + C ln(R)^3, 
+ *        and rebuild the table when it's enabled.
+ *
+ * @param   th  Pointer of the driver information.
+ * @param   a   A coefficient.
+ * @param   b   B coefficient, must be positive.
+ * @param   c   C coefficient.
+ *
+ * @return
+ *      - ESP_OK: Success.
+ *      - ESP_ERR_INVALID_ARG: Invalid coefficients.
+ */
+esp_err_t thermistor_set_steinhart_hart(thermistor_handle_t* th, double a, double b, double c);
+
+/**
+ * @brief Go back to the beta model of thermistor_init, and rebuild the 
+ *        table when it's enabled.
+ *
+ * @param   th  Pointer of the driver information.
+ */
+void thermistor_set_beta(thermistor_handle_t* th);
+
+/**
+ * @brief Read the thermistor to capture a calibration point.
+ *
+ * @param   th  Pointer of the driver information.
+ * @param   celsius Temperature of the reference thermometer.
+ * @param   point Pointer to store the captured point.
+ *
+ * @return
+ *      - ESP_OK: Success.
+ *      - ESP_ERR_INVALID_STATE: The vout is at one end of the divider.
+ */
+esp_err_t thermistor_capture_point(thermistor_handle_t* th, float celsius, 
+                                   thermistor_cal_point_t* point);
+
+/**
+ * @brief Fit the coefficients from the reference points, and apply them.
+ *
+ * With three points the A, B, C coefficients are solved exactly; with two 
+ * points C is 0 and A, B are equivalent to fitting the beta coefficient.
+ *
+ * @param   th  Pointer of the driver information.
+ * @param   points Reference points with different temperatures.
+ * @param   count Number of points, 2 or 3.
+ *
+ * @return
+ *      - ESP_OK: Success.
+ *      - ESP_ERR_INVALID_ARG: Wrong number of points, or points that do not 
+ *                             give a valid fit.
+ */
+esp_err_t thermistor_calibrate(thermistor_handle_t* th, 
+                               const thermistor_cal_point_t* points, uint8_t count);
+
+/**
+ * @brief Store the model and the coefficients in NVS.
+ *
+ * @param   th  Pointer of the driver information.
+ * @param   key NVS key of the thermistor, up to 15 characters.
+ *
+ * @return
+ *      - ESP_OK: Success.
+ *      - ESP_ERR_NVS_*: Error of the NVS.
+ */
+esp_err_t thermistor_save_calibration(const thermistor_handle_t* th, const char* key);
+
+/**
+ * @brief Load the model and the coefficients from NVS, and apply them.
+ *
+ * @param   th  Pointer of the driver information.
+ * @param   key NVS key of the thermistor, up to 15 characters.
+ *
+ * @return
+ *      - ESP_OK: Success.
+ *      - ESP_ERR_NVS_NOT_FOUND: The thermistor was never calibrated.
+ *      - ESP_ERR_NVS_*: Error of the NVS.
+ */
+esp_err_t thermistor_load_calibration(thermistor_handle_t* th, const char* key);
+
 /**
  * @brief Converts the output voltage of the divider to degrees Celsius.
  *
- * To linearize the thermistor output use the simplified Steniarth equation.
+ * To linearize the thermistor output use the simplified Steniarth equation, 
+ * or the interpolation of the precomputed table when it is enabled.
  *
  * @param   th  Pointer of the driver information.
  * @param   vout Output voltage of the resistive divider in mV.
  *
  * @return
  *      - Temperature in degrees Celsius.
+ *      - NAN: vout is 0 or not below vsource (short or open thermistor, 
+ *        or no reading).
  */
 float thermistor_vout_to_celsius(thermistor_handle_t* th, uint32_t vout);
 
@@ -136,6 +428,7 @@ float thermistor_vout_to_celsius(thermistor_handle_t* th, uint32_t vout);
  *
  * @return
  *      - Temperature in degrees Celsius.
+ *      - NAN: The reading failed or is out of the divider range.
  */
 float thermistor_get_celsius(thermistor_handle_t* th);
 
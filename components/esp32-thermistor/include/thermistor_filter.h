@@ -0,0 +1,128 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file thermistor_filter.h
+ * @brief Allocation-free filter pipeline for the thermistor samples.
+ *
+ * The ADC of the ESP32-C3 picks up spikes when the radio transmits, so a 
+ * plain average needs many samples to be steady. The pipeline has three 
+ * stages, each one can be disabled in the configuration:
+ * 
+ * - A sliding median over the last raw samples that removes isolated spikes.
+ * - An outlier gate that discards the average of a whole period when it 
+ *   jumps away from the filtered value (Wi-Fi bursts), unless the jump 
+ *   persists for several periods, so a real change is followed.
+ * - An exponential moving average across periods, in fixed point.
+ */
+
+#ifndef __THERMISTOR_FILTER_H__
+#define __THERMISTOR_FILTER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define THERMISTOR_FILTER_MEDIAN_MAX    9   /**< Maximum length of the median window. */
+#define THERMISTOR_FILTER_EMA_SHIFT_MAX 8   /**< Maximum shift of the EMA coefficient. */
+
+/**
+ * @brief Configuration of the filter pipeline.
+ */
+typedef struct
+{
+    uint8_t samples;            /**< Raw samples per period in oneshot mode. */
+    uint8_t median_len;         /**< Length of the median window, odd, 0 or 1 = disabled. */
+    uint8_t ema_shift;          /**< EMA coefficient as 1 / 2^ema_shift, 0 = disabled. */
+    uint8_t max_rejects;        /**< Consecutive periods rejected before accepting the jump. */
+    uint32_t outlier_gate;      /**< Maximum jump in ADC codes from the filtered value, 0 = disabled. */
+} thermistor_filter_config_t;
+
+/**
+ * @brief State of the filter pipeline.
+ *
+ * @note Call thermistor_filter_init() to initialize the structure.
+ */
+typedef struct
+{
+    thermistor_filter_config_t cfg;                 /**< Configuration. */
+    uint16_t window[THERMISTOR_FILTER_MEDIAN_MAX];  /**< Last raw samples of the median. */
+    uint8_t win_idx;                                /**< Position of the next sample in the window. */
+    uint8_t win_count;                              /**< Number of valid samples in the window. */
+    uint32_t ema_acc;                               /**< EMA accumulator, value << ema_shift. */
+    bool ema_valid;                                 /**< The EMA has been seeded. */
+    uint8_t rejects;                                /**< Consecutive periods rejected by the gate. */
+    uint32_t rejected_total;                        /**< Periods rejected by the gate since init. */
+} thermistor_filter_t;
+
+/**
+ * @brief Initialize the state of the filter.
+ *
+ * @param   f  Pointer to the filter state.
+ * @param   cfg Configuration of the pipeline, the median length is rounded 
+ *              down to odd and both limits are clamped to the maximum.
+ */
+void thermistor_filter_init(thermistor_filter_t* f, const thermistor_filter_config_t* cfg);
+
+/**
+ * @brief Discard the history of the filter, keeping the configuration.
+ *
+ * @param   f  Pointer to the filter state.
+ */
+void thermistor_filter_reset(thermistor_filter_t* f);
+
+/**
+ * @brief Push a raw sample into the median window.
+ *
+ * It's safe to call from isr, takes at most THERMISTOR_FILTER_MEDIAN_MAX^2 
+ * comparisons.
+ *
+ * @param   f  Pointer to the filter state.
+ * @param   raw Raw sample of the ADC.
+ *
+ * @return
+ *      - Median of the window, or raw when the median is disabled.
+ */
+uint32_t thermistor_filter_sample(thermistor_filter_t* f, uint32_t raw);
+
+/**
+ * @brief Apply the outlier gate and the EMA to the average of a period.
+ *
+ * @param   f  Pointer to the filter state.
+ * @param   value Average of the period, with fraction_bits of fraction.
+ * @param   fraction_bits Fraction bits of value, to scale the gate.
+ *
+ * @return
+ *      - Filtered value, with the same fraction bits.
+ */
+uint32_t thermistor_filter_period(thermistor_filter_t* f, uint32_t value, uint8_t fraction_bits);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __THERMISTOR_FILTER_H__ */
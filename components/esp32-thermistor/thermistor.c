@@ -30,58 +30,260 @@
 #include "thermistor.h"
 
 #include "math.h"
+#include <string.h>
 
 #include "esp_log.h"
 static const char* TAG = "drv_thr";
 
 #define DEFAULT_VREF    1100        // Use adc2_vref_to_gpio() to obtain a better estimate
 #define NO_OF_SAMPLES   64          // Amount suggested by espresif for multiple samples.
+#define OVERSAMPLE_BITS 3           // Fraction bits of the averages, 64 samples give 3 extra bits.
+#define ADC_MAX_CODE    4095        // Maximum code of 12 bits.
+
+#define CONV_FRAME_SAMPLES  64          // Samples of each DMA frame, averaged in the isr.
+#define CONV_FRAME_SIZE     (CONV_FRAME_SAMPLES * SOC_ADC_DIGI_RESULT_BYTES)
+#define CONV_SAMPLE_FREQ    SOC_ADC_SAMPLE_FREQ_THRES_LOW   // Slowest rate, the temperature changes slowly.
+
+#if CONFIG_IDF_TARGET_ESP32 || CONFIG_IDF_TARGET_ESP32S2
+    #define CONV_OUTPUT_TYPE            ADC_DIGI_OUTPUT_FORMAT_TYPE1
+    #define CONV_GET_CHANNEL(p_data)    ((p_data)->type1.channel)
+    #define CONV_GET_DATA(p_data)       ((p_data)->type1.data)
+#else
+    #define CONV_OUTPUT_TYPE            ADC_DIGI_OUTPUT_FORMAT_TYPE2
+    #define CONV_GET_CHANNEL(p_data)    ((p_data)->type2.channel)
+    #define CONV_GET_DATA(p_data)       ((p_data)->type2.data)
+#endif
 
 static bool adc_calibration_init(adc_unit_t unit, adc_atten_t atten, adc_cali_handle_t *out_handle);
+static esp_err_t thermistor_build_lut(thermistor_handle_t* th, uint16_t step_mv);
 
-esp_err_t thermistor_init(thermistor_handle_t* th,
-                          adc_channel_t channel, float serial_resistance, 
-                          float nominal_resistance, float nominal_temperature, 
-                          float beta_val, float vsource)
+// Bus of ADC_UNIT_1 used by thermistor_init.
+static thermistor_bus_t default_bus;
+static bool default_bus_inited = false;
+
+/**
+ * @brief Invoked from isr each time the DMA completes a frame, averages the 
+ *        samples of each channel and pushes the result into its ring buffer.
+ */
+static bool IRAM_ATTR thermistor_conv_done_cb(adc_continuous_handle_t handle, 
+                                              const adc_continuous_evt_data_t *edata, 
+                                              void *user_data)
 {
-    adc_oneshot_unit_handle_t adc_handle;
-    adc_oneshot_unit_init_cfg_t init_config = {
-        .unit_id = ADC_UNIT_1,
-    };
+    thermistor_bus_t* bus = (thermistor_bus_t*) user_data;
+    uint32_t sum[THERMISTOR_BUS_MAX_CHANNELS] = { 0 };
+    uint32_t count[THERMISTOR_BUS_MAX_CHANNELS] = { 0 };
+
+    for (uint32_t i = 0; i < edata->size; i += SOC_ADC_DIGI_RESULT_BYTES) {
+        adc_digi_output_data_t *p = (adc_digi_output_data_t*)&edata->conv_frame_buffer[i];
+        uint32_t channel = CONV_GET_CHANNEL(p);
+
+        for (uint8_t n = 0; n < bus->count; n++) {
+            thermistor_handle_t* th = bus->channels[n];
+            if (th->channel == channel) {
+                uint32_t raw = CONV_GET_DATA(p);
+                if (th->filter_enabled) {
+                    raw = thermistor_filter_sample(&th->filter, raw);
+                }
+                sum[n] += raw;
+                count[n]++;
+                break;
+            }
+        }
+    }
+
+    for (uint8_t n = 0; n < bus->count; n++) {
+        thermistor_ring_t* ring = &bus->channels[n]->ring;
+        
+        if (count[n] > 0) {
+            uint32_t frame = ((sum[n] << OVERSAMPLE_BITS) + (count[n] / 2)) / count[n];
+
+            ring->sum -= ring->frames[ring->idx];
+            ring->frames[ring->idx] = frame;
+            ring->sum += frame;
+            ring->idx = (ring->idx + 1) % THERMISTOR_RING_SIZE;
+            if (ring->count < THERMISTOR_RING_SIZE) {
+                ring->count++;
+            }
+            ring->filtered_raw = ring->sum / ring->count;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Configure the pattern of the continuous mode with all the channels 
+ *        of the bus, and (re)start the conversions.
+ */
+static esp_err_t thermistor_bus_configure_continuous(thermistor_bus_t* bus)
+{
+    esp_err_t err = ESP_OK;
+    adc_digi_pattern_config_t pattern[THERMISTOR_BUS_MAX_CHANNELS];
+
+    if (bus->running) {
+        err = adc_continuous_stop(bus->adc_cont_h);
+        bus->running = false;
+    }
+
+    for (uint8_t n = 0; n < bus->count; n++) {
+        pattern[n].atten = ADC_ATTEN_DB_12;
+        pattern[n].channel = bus->channels[n]->channel;
+        pattern[n].unit = bus->unit;
+        pattern[n].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+    }
 
-    esp_err_t err = adc_oneshot_new_unit(&init_config, &adc_handle);
-    
     if (err == ESP_OK) {
+        adc_continuous_config_t config = {
+            .pattern_num = bus->count,
+            .adc_pattern = pattern,
+            .sample_freq_hz = CONV_SAMPLE_FREQ,
+            .conv_mode = (bus->unit == ADC_UNIT_1) ? ADC_CONV_SINGLE_UNIT_1 : ADC_CONV_SINGLE_UNIT_2,
+            .format = CONV_OUTPUT_TYPE,
+        };
+        err = adc_continuous_config(bus->adc_cont_h, &config);
+    }
+
+    if (err == ESP_OK) {
+        err = adc_continuous_start(bus->adc_cont_h);
+        bus->running = (err == ESP_OK);
+    }
+
+    return err;
+}
+
+esp_err_t thermistor_bus_init(thermistor_bus_t* bus, adc_unit_t unit, thermistor_mode_t mode)
+{
+    esp_err_t err;
+
+    memset(bus, 0, sizeof(thermistor_bus_t));
+    bus->mode = mode;
+    bus->unit = unit;
+
+    if (mode == THERMISTOR_MODE_CONTINUOUS) {
+        adc_continuous_handle_cfg_t handle_config = {
+            .max_store_buf_size = CONV_FRAME_SIZE * 4,
+            .conv_frame_size = CONV_FRAME_SIZE,
+        };
+
+        err = adc_continuous_new_handle(&handle_config, &bus->adc_cont_h);
+
+        if (err == ESP_OK) {
+            adc_continuous_evt_cbs_t cbs = {
+                .on_conv_done = thermistor_conv_done_cb,
+            };
+            err = adc_continuous_register_event_callbacks(bus->adc_cont_h, &cbs, bus);
+        }
+    } else {
+        adc_oneshot_unit_init_cfg_t init_config = {
+            .unit_id = unit,
+        };
+
+        err = adc_oneshot_new_unit(&init_config, &bus->adc_h);
+    }
+
+    if (err == ESP_OK) {
+        bus->calibrated = adc_calibration_init(unit, ADC_ATTEN_DB_12, &bus->adc_cali_h);
+    }
+
+    return err;
+}
+
+esp_err_t thermistor_bus_add(thermistor_bus_t* bus, thermistor_handle_t* th,
+                             adc_channel_t channel, float serial_resistance, 
+                             float nominal_resistance, float nominal_temperature, 
+                             float beta_val, float vsource, uint16_t lut_step_mv)
+{
+    esp_err_t err = ESP_OK;
+
+    if (bus->count >= THERMISTOR_BUS_MAX_CHANNELS) {
+        ESP_LOGE(TAG, "bus full, max %d thermistors", THERMISTOR_BUS_MAX_CHANNELS);
+        return ESP_ERR_NO_MEM;
+    }
+
+    th->bus = bus;
+    th->channel = channel;
+    memset(&th->ring, 0, sizeof(th->ring));
+    th->serial_resistance = serial_resistance; 
+    th->nominal_resistance = nominal_resistance;
+    th->nominal_temperature = nominal_temperature;
+    th->beta_val = beta_val;
+    th->vsource = vsource;
+    th->t_resistance = 0;
+    th->vout = 0;
+    th->lut_step_mv = 0;
+    th->lut_entries = 0;
+    th->decimation_bits = 0;
+    th->filter_enabled = false;
+    th->model = THERMISTOR_MODEL_BETA;
+    th->sh_a = 0;
+    th->sh_b = 0;
+    th->sh_c = 0;
+
+    if (lut_step_mv > 0) {
+        err = thermistor_build_lut(th, lut_step_mv);
+    }
+
+    if ((err == ESP_OK) && (bus->mode == THERMISTOR_MODE_ONESHOT)) {
         adc_oneshot_chan_cfg_t config = {
                     .bitwidth = ADC_BITWIDTH_12, 
                     .atten = ADC_ATTEN_DB_12,
         };
         
-        err = adc_oneshot_config_channel(adc_handle, channel, &config);
-
-        adc_cali_handle_t adc_cali_handle = NULL;
-        th->calibrated = adc_calibration_init(ADC_UNIT_1, ADC_ATTEN_DB_12, &adc_cali_handle);
-        th->channel = channel;
-        th->adc_h = adc_handle;
-        th->adc_cali_h = adc_cali_handle;
-        th->serial_resistance = serial_resistance; 
-        th->nominal_resistance = nominal_resistance;
-        th->nominal_temperature = nominal_temperature;
-        th->beta_val = beta_val;
-        th->vsource = vsource;
-        th->t_resistance = 0;
+        err = adc_oneshot_config_channel(bus->adc_h, channel, &config);
     }
-    
+
+    if (err == ESP_OK) {
+        bus->channels[bus->count++] = th;
+
+        if (bus->mode == THERMISTOR_MODE_CONTINUOUS) {
+            err = thermistor_bus_configure_continuous(bus);
+        }
+    }
+
     return err;
 }
 
-float thermistor_vout_to_celsius(thermistor_handle_t* th, uint32_t vout)
+esp_err_t thermistor_init(thermistor_handle_t* th,
+                          adc_channel_t channel, float serial_resistance, 
+                          float nominal_resistance, float nominal_temperature, 
+                          float beta_val, float vsource, uint16_t lut_step_mv,
+                          thermistor_mode_t mode)
+{
+    if (!default_bus_inited) {
+        esp_err_t err = thermistor_bus_init(&default_bus, ADC_UNIT_1, mode);
+        if (err != ESP_OK) {
+            return err;
+        }
+        default_bus_inited = true;
+    } else if (default_bus.mode != mode) {
+        ESP_LOGE(TAG, "ADC_UNIT_1 already used in another mode");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    return thermistor_bus_add(&default_bus, th, channel, serial_resistance, 
+                              nominal_resistance, nominal_temperature, 
+                              beta_val, vsource, lut_step_mv);
+}
+
+/**
+ * @brief Apply the simplified Steinhart equation, or the full Steinhart-Hart 
+ *        equation when it's calibrated, it's the reference used to build the 
+ *        table.
+ */
+static float thermistor_steinhart(thermistor_handle_t* th, uint32_t vout)
 {
     float steinhart;
        
     // Rt = R1 * Vout / (Vs - Vout);
     th->t_resistance =  (th->serial_resistance * vout) / (th->vsource - vout); 
 
+    if (th->model == THERMISTOR_MODEL_STEINHART_HART) {
+        // 1/T = A + B * ln(R) + C * ln(R)^3
+        double ln_r = log(th->t_resistance);
+        double inv_t = th->sh_a + (th->sh_b * ln_r) + (th->sh_c * ln_r * ln_r * ln_r);
+        return (1.0 / inv_t) - 273.15;
+    }
+
     steinhart = th->t_resistance / th->nominal_resistance;  // (R/Ro)
     steinhart = log(steinhart);                             // ln(R/Ro)
     steinhart /= th->beta_val;                              // 1/B * ln(R/Ro)
@@ -92,49 +294,311 @@ float thermistor_vout_to_celsius(thermistor_handle_t* th, uint32_t vout)
     return steinhart; 
 }
 
+/**
+ * @brief Fill the table with the temperature in centi-degrees of each step 
+ *        of mV, from 0 to vsource. The ends of the divider (short or open 
+ *        thermistor) are clamped to the range of the int16_t.
+ */
+static esp_err_t thermistor_build_lut(thermistor_handle_t* th, uint16_t step_mv)
+{
+    uint32_t vmax = (uint32_t)th->vsource;
+    uint32_t entries = (vmax / step_mv) + 2;
+
+    if (entries > THERMISTOR_LUT_MAX_ENTRIES) {
+        ESP_LOGE(TAG, "lut step %u mV needs %lu entries, max %d", 
+                 step_mv, (unsigned long)entries, THERMISTOR_LUT_MAX_ENTRIES);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (uint32_t i = 0; i < entries; i++) {
+        uint32_t vout = i * step_mv;
+
+        // Keep the divider inside the open interval (0, vsource).
+        if (vout == 0) {
+            vout = 1;
+        } else if (vout >= vmax) {
+            vout = vmax - 1;
+        }
+
+        float centi = thermistor_steinhart(th, vout) * 100.0f;
+        if (centi > INT16_MAX) {
+            centi = INT16_MAX;
+        } else if (centi < INT16_MIN) {
+            centi = INT16_MIN;
+        }
+        th->lut[i] = (int16_t)lroundf(centi);
+    }
+
+    th->lut_entries = entries;
+    th->lut_step_mv = step_mv;
+    th->t_resistance = 0;
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Linear interpolation between the two entries of the table that 
+ *        contain vout, only uses integer math.
+ */
+static float thermistor_lut_lookup(const thermistor_handle_t* th, uint32_t vout)
+{
+    uint32_t idx = vout / th->lut_step_mv;
+    
+    if (idx >= (uint32_t)(th->lut_entries - 1)) {
+        return th->lut[th->lut_entries - 1] / 100.0f;
+    }
+
+    int32_t frac = vout - (idx * th->lut_step_mv);
+    int32_t t0 = th->lut[idx];
+    int32_t t1 = th->lut[idx + 1];
+    int32_t centi = t0 + ((t1 - t0) * frac) / th->lut_step_mv;
+
+    return centi / 100.0f;
+}
+
+float thermistor_vout_to_celsius(thermistor_handle_t* th, uint32_t vout)
+{
+    // The ends of the divider are a short or an open thermistor, or no reading.
+    if ((vout == 0) || (vout >= (uint32_t)th->vsource)) {
+        return NAN;
+    }
+
+    if (th->lut_step_mv > 0) {
+        return thermistor_lut_lookup(th, vout);
+    }
+
+    return thermistor_steinhart(th, vout);
+}
+
+/**
+ * @brief Converts an average with OVERSAMPLE_BITS of fraction to mV. The 
+ *        calibration only accepts integer codes, so the fraction kept by the 
+ *        decimation is used to interpolate between two consecutive codes.
+ */
+static uint32_t thermistor_raw_to_mv(thermistor_handle_t* th, uint32_t raw_ext)
+{
+    int v0 = 0;
+    int v1 = 0;
+    uint32_t bits = th->decimation_bits;
+    uint32_t drop = OVERSAMPLE_BITS - bits;
+
+    if (!th->bus->calibrated) {
+        return 0;
+    }
+
+    // Round away the fraction bits that are not used.
+    if (drop > 0) {
+        raw_ext = (raw_ext + (1U << (drop - 1))) >> drop;
+    }
+
+    uint32_t code = raw_ext >> bits;
+    uint32_t frac = raw_ext & ((1U << bits) - 1);
+
+    if (code > ADC_MAX_CODE) {
+        code = ADC_MAX_CODE;
+        frac = 0;
+    }
+
+    adc_cali_raw_to_voltage(th->bus->adc_cali_h, code, &v0);
+    if (frac == 0) {
+        return v0;
+    }
+
+    adc_cali_raw_to_voltage(th->bus->adc_cali_h, code + 1, &v1);
+
+    return v0 + (((v1 - v0) * (int)frac + (1 << (bits - 1))) >> bits);
+}
+
+/**
+ * @brief Filter the average of a reading and converts it to mV.
+ */
+static uint32_t thermistor_reading_to_mv(thermistor_handle_t* th, uint32_t raw_ext)
+{
+    if (th->filter_enabled) {
+        raw_ext = thermistor_filter_period(&th->filter, raw_ext, OVERSAMPLE_BITS);
+    }
+
+    return thermistor_raw_to_mv(th, raw_ext);
+}
+
+/**
+ * @brief Converts the average of the ring buffer to mV, without blocking.
+ */
+static uint32_t thermistor_read_vout_continuous(thermistor_handle_t* th)
+{
+    uint32_t raw_ext = th->ring.filtered_raw;
+
+    if (raw_ext == 0) {
+        return 0;
+    }
+
+    return thermistor_reading_to_mv(th, raw_ext);
+}
+
+/**
+ * @brief Number of raw samples of a reading in oneshot mode.
+ */
+static uint32_t thermistor_samples(const thermistor_handle_t* th)
+{
+    return th->filter_enabled ? th->filter.cfg.samples : NO_OF_SAMPLES;
+}
+
+/**
+ * @brief Read a raw sample in oneshot mode, through the median when enabled.
+ */
+static esp_err_t thermistor_read_sample(thermistor_handle_t* th, uint32_t* raw)
+{
+    int adc_raw;
+    esp_err_t err = adc_oneshot_read(th->bus->adc_h, th->channel, &adc_raw);
+
+    if (err == ESP_OK) {
+        *raw = adc_raw;
+        if (th->filter_enabled) {
+            *raw = thermistor_filter_sample(&th->filter, *raw);
+        }
+    }
+
+    return err;
+}
+
+/**
+ * @brief Averages a burst of blocking samples and converts it to mV.
+ *        The sum of 64 samples of 12 bits fits in 18 bits, so it is 
+ *        accumulated in an integer, and the average keeps OVERSAMPLE_BITS 
+ *        of fraction for the decimation.
+ */
+static uint32_t thermistor_read_vout_oneshot(thermistor_handle_t* th)
+{
+    uint32_t raw;
+    uint32_t sum = 0;
+    uint32_t samples = thermistor_samples(th);
+
+    for (uint32_t i = 0; i < samples; i++) {
+        if (thermistor_read_sample(th, &raw) != ESP_OK) {
+            return 0;
+        }
+        sum += raw;
+    }
+
+    return thermistor_reading_to_mv(th, ((sum << OVERSAMPLE_BITS) + (samples / 2)) / samples);
+}
+
 uint32_t thermistor_read_vout(thermistor_handle_t* th)
 {
-int adc_raw;
-int voltage = 0;
-esp_err_t err;
-   
-double sum = 0.0f;
-double c = 0.0f; // Variable to store the error
-double y;
-double t;
-int i;
-
-   // Use multiple samples to stabilize the measured value, and 
-   // implement the Kahan summation algorithm to reduce the int error.
-   for (i = 0; i < NO_OF_SAMPLES; i++) {
-      err = adc_oneshot_read(th->adc_h, th->channel, &adc_raw);
-      
-      if(err != ESP_OK) {
-         break;
-      }
-
-      y = adc_raw - c;
-      t = sum + y;
-         
-      // Algebraically, c is always 0
-      // when t is replaced by its
-      // value from the above expression.
-      // But, when there is a loss,
-      // the higher-order y is cancelled
-      // out by subtracting y from c and
-      // all that remains is the
-      // lower-order error in c
-      c = (t - sum) - y;
-      sum = t;
-   }
-   
-   adc_raw = (int)(sum/i);
-     
-   if ((err== ESP_OK) && (th->calibrated)) {
-      adc_cali_raw_to_voltage(th->adc_cali_h, adc_raw, &voltage);
-   }
-   
-   return voltage;
+    if (th->bus->mode == THERMISTOR_MODE_CONTINUOUS) {
+        return thermistor_read_vout_continuous(th);
+    }
+
+    return thermistor_read_vout_oneshot(th);
+}
+
+esp_err_t thermistor_bus_scan(thermistor_bus_t* bus)
+{
+    uint32_t sum[THERMISTOR_BUS_MAX_CHANNELS] = { 0 };
+    uint32_t samples = 0;
+    uint32_t raw;
+
+    // Without the calibration the codes can not be converted to mV.
+    if (!bus->calibrated) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (bus->mode == THERMISTOR_MODE_CONTINUOUS) {
+        for (uint8_t n = 0; n < bus->count; n++) {
+            if (bus->channels[n]->ring.count == 0) {
+                return ESP_ERR_INVALID_STATE;   // No frame yet.
+            }
+        }
+        for (uint8_t n = 0; n < bus->count; n++) {
+            bus->channels[n]->vout = thermistor_read_vout_continuous(bus->channels[n]);
+        }
+        return ESP_OK;
+    }
+
+    for (uint8_t n = 0; n < bus->count; n++) {
+        if (thermistor_samples(bus->channels[n]) > samples) {
+            samples = thermistor_samples(bus->channels[n]);
+        }
+    }
+
+    // Interleave the channels, so all of them see the same noise conditions.
+    for (uint32_t i = 0; i < samples; i++) {
+        for (uint8_t n = 0; n < bus->count; n++) {
+            thermistor_handle_t* th = bus->channels[n];
+            if (i < thermistor_samples(th)) {
+                if (thermistor_read_sample(th, &raw) != ESP_OK) {
+                    return ESP_FAIL;
+                }
+                sum[n] += raw;
+            }
+        }
+    }
+
+    for (uint8_t n = 0; n < bus->count; n++) {
+        thermistor_handle_t* th = bus->channels[n];
+        uint32_t count = thermistor_samples(th);
+        th->vout = thermistor_reading_to_mv(th, ((sum[n] << OVERSAMPLE_BITS) + (count / 2)) / count);
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t thermistor_set_steinhart_hart(thermistor_handle_t* th, double a, double b, double c)
+{
+    if (b <= 0) {
+        ESP_LOGE(TAG, "invalid Steinhart-Hart coefficients");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    th->sh_a = a;
+    th->sh_b = b;
+    th->sh_c = c;
+    th->model = THERMISTOR_MODEL_STEINHART_HART;
+
+    if (th->lut_step_mv > 0) {
+        return thermistor_build_lut(th, th->lut_step_mv);
+    }
+
+    return ESP_OK;
+}
+
+void thermistor_set_beta(thermistor_handle_t* th)
+{
+    th->model = THERMISTOR_MODEL_BETA;
+
+    if (th->lut_step_mv > 0) {
+        thermistor_build_lut(th, th->lut_step_mv);
+    }
+}
+
+esp_err_t thermistor_set_decimation(thermistor_handle_t* th, uint8_t bits)
+{
+    if (bits > THERMISTOR_MAX_DECIMATION_BITS) {
+        ESP_LOGE(TAG, "decimation %u bits, max %d", bits, THERMISTOR_MAX_DECIMATION_BITS);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    th->decimation_bits = bits;
+    return ESP_OK;
+}
+
+esp_err_t thermistor_set_filter(thermistor_handle_t* th, const thermistor_filter_config_t* cfg)
+{
+    if (!cfg) {
+        th->filter_enabled = false;
+        return ESP_OK;
+    }
+
+    if (cfg->samples == 0) {
+        ESP_LOGE(TAG, "filter needs at least one sample per reading");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    th->filter_enabled = false;
+    thermistor_filter_init(&th->filter, cfg);
+    th->filter_enabled = true;
+
+    return ESP_OK;
 }
 
 float thermistor_get_celsius(thermistor_handle_t* th)
@@ -0,0 +1,162 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file thermistor_cal.c
+ * @brief Calibration of the Steinhart-Hart coefficients of the thermistor, 
+ *        and their storage in NVS.
+ */
+
+#include "thermistor.h"
+
+#include "math.h"
+
+#include "nvs.h"
+
+#include "esp_log.h"
+static const char* TAG = "drv_thr_cal";
+
+#define NVS_NAMESPACE       "thermistor"
+#define KELVIN_OFFSET       273.15
+
+/**
+ * @brief Content stored in NVS for each thermistor.
+ */
+typedef struct
+{
+    uint32_t model;                 // thermistor_model_t
+    double a;
+    double b;
+    double c;
+} thermistor_cal_blob_t;
+
+esp_err_t thermistor_capture_point(thermistor_handle_t* th, float celsius, 
+                                   thermistor_cal_point_t* point)
+{
+    uint32_t vout = thermistor_read_vout(th);
+
+    if ((vout == 0) || (vout >= (uint32_t)th->vsource)) {
+        ESP_LOGE(TAG, "vout %lu mV out of the divider range", (unsigned long)vout);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Rt = R1 * Vout / (Vs - Vout);
+    point->resistance = (th->serial_resistance * vout) / (th->vsource - vout);
+    point->celsius = celsius;
+
+    ESP_LOGI(TAG, "point %.2f C, %.0f ohm", celsius, point->resistance);
+    return ESP_OK;
+}
+
+esp_err_t thermistor_calibrate(thermistor_handle_t* th, 
+                               const thermistor_cal_point_t* points, uint8_t count)
+{
+    double l[3];
+    double y[3];
+    double a, b, c;
+
+    if ((count < 2) || (count > 3)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (uint8_t i = 0; i < count; i++) {
+        if (points[i].resistance <= 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        l[i] = log(points[i].resistance);
+        y[i] = 1.0 / (points[i].celsius + KELVIN_OFFSET);
+    }
+
+    if (count == 2) {
+        // Beta fit: 1/T = 1/T1 + (ln(R) - ln(R1)) / beta.
+        if (l[0] == l[1]) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        b = (y[0] - y[1]) / (l[0] - l[1]);
+        c = 0;
+    } else {
+        // Exact solution of the 3x3 system.
+        if ((l[0] == l[1]) || (l[0] == l[2]) || (l[1] == l[2])) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        double g2 = (y[1] - y[0]) / (l[1] - l[0]);
+        double g3 = (y[2] - y[0]) / (l[2] - l[0]);
+        c = ((g3 - g2) / (l[2] - l[1])) / (l[0] + l[1] + l[2]);
+        b = g2 - c * ((l[0] * l[0]) + (l[0] * l[1]) + (l[1] * l[1]));
+    }
+    a = y[0] - ((b + (c * l[0] * l[0])) * l[0]);
+
+    ESP_LOGI(TAG, "fit A=%.6e B=%.6e C=%.6e", a, b, c);
+
+    return thermistor_set_steinhart_hart(th, a, b, c);
+}
+
+esp_err_t thermistor_save_calibration(const thermistor_handle_t* th, const char* key)
+{
+    nvs_handle_t handle;
+    thermistor_cal_blob_t blob = {
+        .model = th->model,
+        .a = th->sh_a,
+        .b = th->sh_b,
+        .c = th->sh_c,
+    };
+
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(handle, key, &blob, sizeof(blob));
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+
+    return err;
+}
+
+esp_err_t thermistor_load_calibration(thermistor_handle_t* th, const char* key)
+{
+    nvs_handle_t handle;
+    thermistor_cal_blob_t blob;
+    size_t size = sizeof(blob);
+
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (err == ESP_OK) {
+        err = nvs_get_blob(handle, key, &blob, &size);
+        nvs_close(handle);
+    }
+
+    if ((err == ESP_OK) && (size != sizeof(blob))) {
+        err = ESP_ERR_INVALID_SIZE;
+    }
+
+    if (err == ESP_OK) {
+        if (blob.model == THERMISTOR_MODEL_STEINHART_HART) {
+            err = thermistor_set_steinhart_hart(th, blob.a, blob.b, blob.c);
+        } else {
+            thermistor_set_beta(th);
+        }
+    }
+
+    return err;
+}
@@ -0,0 +1,129 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file thermistor_filter.c
+ * @brief Implementation of the filter pipeline for the thermistor samples.
+ */
+
+#include "thermistor_filter.h"
+
+#include <string.h>
+
+#include "esp_attr.h"
+
+void thermistor_filter_init(thermistor_filter_t* f, const thermistor_filter_config_t* cfg)
+{
+    f->cfg = *cfg;
+
+    if (f->cfg.median_len > THERMISTOR_FILTER_MEDIAN_MAX) {
+        f->cfg.median_len = THERMISTOR_FILTER_MEDIAN_MAX;
+    }
+    if ((f->cfg.median_len > 0) && ((f->cfg.median_len % 2) == 0)) {
+        f->cfg.median_len--;
+    }
+    if (f->cfg.ema_shift > THERMISTOR_FILTER_EMA_SHIFT_MAX) {
+        f->cfg.ema_shift = THERMISTOR_FILTER_EMA_SHIFT_MAX;
+    }
+
+    f->rejected_total = 0;
+    thermistor_filter_reset(f);
+}
+
+void thermistor_filter_reset(thermistor_filter_t* f)
+{
+    memset(f->window, 0, sizeof(f->window));
+    f->win_idx = 0;
+    f->win_count = 0;
+    f->ema_acc = 0;
+    f->ema_valid = false;
+    f->rejects = 0;
+}
+
+uint32_t IRAM_ATTR thermistor_filter_sample(thermistor_filter_t* f, uint32_t raw)
+{
+    uint16_t sorted[THERMISTOR_FILTER_MEDIAN_MAX];
+    uint8_t len = f->cfg.median_len;
+
+    if (len <= 1) {
+        return raw;
+    }
+
+    f->window[f->win_idx] = raw;
+    f->win_idx = (f->win_idx + 1) % len;
+    if (f->win_count < len) {
+        f->win_count++;
+    }
+
+    // Insertion sort of a copy, the window is short.
+    for (uint8_t i = 0; i < f->win_count; i++) {
+        uint16_t v = f->window[i];
+        int8_t j = i - 1;
+        while ((j >= 0) && (sorted[j] > v)) {
+            sorted[j + 1] = sorted[j];
+            j--;
+        }
+        sorted[j + 1] = v;
+    }
+
+    return sorted[f->win_count / 2];
+}
+
+uint32_t thermistor_filter_period(thermistor_filter_t* f, uint32_t value, uint8_t fraction_bits)
+{
+    uint8_t shift = f->cfg.ema_shift;
+
+    if (!f->ema_valid) {
+        f->ema_acc = value << shift;
+        f->ema_valid = true;
+        f->rejects = 0;
+        return value;
+    }
+
+    uint32_t ema = f->ema_acc >> shift;
+
+    if (f->cfg.outlier_gate > 0) {
+        uint32_t gate = f->cfg.outlier_gate << fraction_bits;
+        uint32_t diff = (value > ema) ? (value - ema) : (ema - value);
+
+        if (diff > gate) {
+            if (f->rejects < f->cfg.max_rejects) {
+                f->rejects++;
+                f->rejected_total++;
+                return ema;
+            }
+
+            // The jump persisted, it's a real change: restart from it.
+            f->ema_acc = value << shift;
+            f->rejects = 0;
+            return value;
+        }
+    }
+    f->rejects = 0;
+
+    // acc = acc * (1 - 1/2^shift) + value, so acc / 2^shift is the EMA.
+    f->ema_acc = f->ema_acc - ema + value;
+
+    return f->ema_acc >> shift;
+}
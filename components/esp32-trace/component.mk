@@ -0,0 +1 @@
+# Use defaults
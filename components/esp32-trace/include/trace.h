@@ -0,0 +1,118 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file trace.h
+ * @brief API definitions of the hot path trace.
+ *
+ * The trace is a ring of fixed size records (event id, CPU cycle count and 
+ * argument) in RAM. The writers only reserve a slot with an atomic increment 
+ * of the head, so they can run in ISRs, timer callbacks and tasks without 
+ * locks; when the ring is full the oldest records are overwritten.
+ *
+ * The TRACE macro is compiled out when CONFIG_TRACE_ENABLE is not set.
+ *
+ * trace_dump prints the ring on the console as base64 lines between the 
+ * TRACE_DUMP_BEGIN and TRACE_DUMP_END markers, tools/trace_decode.py 
+ * decodes them from a captured log. The event ids belong to the 
+ * application, 0 is reserved, and the decoder must know their names.
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <sdkconfig.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRACE_DUMP_BEGIN    "----- TRACE BEGIN -----"
+#define TRACE_DUMP_END      "----- TRACE END -----"
+#define TRACE_DUMP_MAGIC    0x31435254  ///< "TRC1" in little endian.
+
+/**
+ * @brief Record of the trace, 12 bytes in little endian.
+ */
+typedef struct {
+    uint32_t cycles;            ///< CPU cycle count.
+    uint16_t id;                ///< Event id of the application.
+    uint16_t core;              ///< Core that wrote the record.
+    uint32_t arg;               ///< Argument of the event.
+} trace_record_t;
+
+/**
+ * @brief Header of the dump, followed by the records from the oldest.
+ */
+typedef struct {
+    uint32_t magic;             ///< TRACE_DUMP_MAGIC.
+    uint32_t cpu_hz;            ///< CPU frequency to convert the cycles.
+    uint32_t total;             ///< Records written since the boot.
+    uint16_t record_size;       ///< sizeof(trace_record_t).
+    uint16_t count;             ///< Records in the dump.
+} trace_dump_header_t;
+
+#if CONFIG_TRACE_ENABLE
+#define TRACE(id, arg)      trace_record((id), (uint32_t)(arg))
+#else
+#define TRACE(id, arg)      do { } while (0)
+#endif
+
+/**
+ * @brief Writes a record in the ring, safe from ISRs and without locks.
+ * 
+ * @param[in] id Event id of the application, not 0.
+ * @param[in] arg Argument of the event.
+ * @return void
+ */
+void trace_record(uint16_t id, uint32_t arg);
+
+/**
+ * @brief Stops or resumes the recording, the dump stops it while printing.
+ * 
+ * @param[in] enable True to record.
+ * @return void
+ */
+void trace_enable(bool enable);
+
+/**
+ * @brief Prints the ring on the console in base64, it blocks while printing 
+ *        so it must not be called from an ISR or a timer callback.
+ * 
+ * @return
+ *      - ESP_OK: Success.
+ *      - ESP_ERR_NOT_SUPPORTED: CONFIG_TRACE_ENABLE is not set.
+ */
+esp_err_t trace_dump(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TRACE_H__ */
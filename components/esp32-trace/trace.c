@@ -0,0 +1,168 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file trace.c
+ * @brief Hot path trace: lock-free ring of records and dump in base64.
+ */
+
+#include "trace.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_private/esp_clk.h"
+#include "mbedtls/base64.h"
+
+#if CONFIG_TRACE_ENABLE
+
+#define TRACE_MASK          (CONFIG_TRACE_RECORDS - 1)
+#define TRACE_LINE_BYTES    48      /* Binary bytes by line, 64 chars of base64 */
+
+_Static_assert((CONFIG_TRACE_RECORDS & TRACE_MASK) == 0, "TRACE_RECORDS must be a power of two");
+_Static_assert(sizeof(trace_record_t) == 12, "the decoder expects records of 12 bytes");
+
+static DRAM_ATTR trace_record_t trace_ring[CONFIG_TRACE_RECORDS];
+static volatile uint32_t trace_head = 0;
+static volatile bool trace_enabled = true;
+
+/**
+ * @brief Line buffer of the dump, the bytes are printed in base64 when it's full.
+ */
+typedef struct {
+    uint8_t data[TRACE_LINE_BYTES];
+    size_t len;
+} trace_line_t;
+
+void IRAM_ATTR trace_record(uint16_t id, uint32_t arg)
+{
+    if (!trace_enabled) {
+        return;
+    }
+
+    // Reserving the slot is the only shared write, the rest is private.
+    uint32_t slot = __atomic_fetch_add(&trace_head, 1, __ATOMIC_RELAXED) & TRACE_MASK;
+    trace_record_t* rec = &trace_ring[slot];
+    rec->cycles = esp_cpu_get_cycle_count();
+    rec->id = id;
+    rec->core = esp_cpu_get_core_id();
+    rec->arg = arg;
+}
+
+void trace_enable(bool enable)
+{
+    trace_enabled = enable;
+}
+
+/**
+ * @brief Prints the line in base64 and empties it.
+ * @param line Line buffer.
+ */
+static void trace_flush_line(trace_line_t* line)
+{
+    unsigned char text[((TRACE_LINE_BYTES + 2) / 3) * 4 + 1];
+    size_t olen = 0;
+
+    if (line->len && 
+        (mbedtls_base64_encode(text, sizeof(text), &olen, line->data, line->len) == 0)) {
+        printf("%.*s\n", (int)olen, text);
+    }
+    line->len = 0;
+}
+
+/**
+ * @brief Appends bytes to the dump.
+ * @param line Line buffer.
+ * @param data Bytes to append.
+ * @param len Number of bytes.
+ */
+static void trace_emit(trace_line_t* line, const void* data, size_t len)
+{
+    const uint8_t* src = data;
+
+    while (len) {
+        size_t n = TRACE_LINE_BYTES - line->len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(&line->data[line->len], src, n);
+        line->len += n;
+        src += n;
+        len -= n;
+
+        if (line->len == TRACE_LINE_BYTES) {
+            trace_flush_line(line);
+        }
+    }
+}
+
+esp_err_t trace_dump(void)
+{
+    trace_line_t line = { .len = 0 };
+
+    // The writers that already reserved a slot finish long before the 
+    // oldest record is printed.
+    bool enabled = trace_enabled;
+    trace_enabled = false;
+
+    uint32_t total = trace_head;
+    uint32_t count = (total < CONFIG_TRACE_RECORDS) ? total : CONFIG_TRACE_RECORDS;
+    trace_dump_header_t header = {
+        .magic = TRACE_DUMP_MAGIC,
+        .cpu_hz = esp_clk_cpu_freq(),
+        .total = total,
+        .record_size = sizeof(trace_record_t),
+        .count = count,
+    };
+
+    printf("\n%s\n", TRACE_DUMP_BEGIN);
+    trace_emit(&line, &header, sizeof(header));
+    for (uint32_t i = total - count; i != total; i++) {
+        trace_emit(&line, &trace_ring[i & TRACE_MASK], sizeof(trace_record_t));
+    }
+    trace_flush_line(&line);
+    printf("%s\n", TRACE_DUMP_END);
+
+    trace_enabled = enabled;
+    return ESP_OK;
+}
+
+#else
+
+void trace_record(uint16_t id, uint32_t arg)
+{
+}
+
+void trace_enable(bool enable)
+{
+}
+
+esp_err_t trace_dump(void)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif
@@ -0,0 +1,281 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file adc.c
+ * @brief Host mock of the oneshot and continuous ADC drivers and of the 
+ *        calibration. The codes of each channel come from the source set 
+ *        by the tests, the calibration is linear over SIM_ADC_FULL_SCALE_MV.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "sim_kernel.h"
+#include "esp_adc/adc_oneshot.h"
+#include "esp_adc/adc_cali.h"
+#include "esp_adc/adc_cali_scheme.h"
+#include "esp_adc/adc_continuous.h"
+
+#define ADC_CHANNELS        10
+#define ADC_MAX_CODE        4095
+
+struct adc_oneshot_unit_ctx_t {
+    adc_unit_t unit;
+};
+
+struct adc_cali_scheme_t {
+    adc_unit_t unit;
+};
+
+struct adc_continuous_ctx_t {
+    uint32_t frame_size;
+    adc_digi_pattern_config_t pattern[SOC_ADC_PATT_LEN_MAX];
+    uint32_t pattern_num;
+    adc_continuous_evt_cbs_t cbs;
+    void* user_data;
+    bool started;
+    uint8_t* frame;
+};
+
+typedef struct {
+    sim_adc_source_t source;
+    void* ctx;
+    int raw;
+} adc_input_t;
+
+static adc_input_t inputs[ADC_CHANNELS];
+static bool calibrated = true;
+static struct adc_continuous_ctx_t* continuous;
+
+void sim_adc_set_raw(adc_channel_t channel, int raw)
+{
+    if (channel < ADC_CHANNELS) {
+        inputs[channel] = (adc_input_t){ .raw = raw };
+    }
+}
+
+void sim_adc_set_source(adc_channel_t channel, sim_adc_source_t source, void* ctx)
+{
+    if (channel < ADC_CHANNELS) {
+        inputs[channel] = (adc_input_t){ .source = source, .ctx = ctx };
+    }
+}
+
+void sim_adc_set_calibrated(bool value)
+{
+    calibrated = value;
+}
+
+/**
+ * @brief Converts a sample of a channel.
+ */
+static int adc_sample(adc_channel_t channel)
+{
+    if (channel >= ADC_CHANNELS) {
+        return 0;
+    }
+
+    int raw = inputs[channel].source ? inputs[channel].source(channel, inputs[channel].ctx) 
+                                     : inputs[channel].raw;
+    if (raw < 0) {
+        raw = 0;
+    } else if (raw > ADC_MAX_CODE) {
+        raw = ADC_MAX_CODE;
+    }
+    return raw;
+}
+
+esp_err_t adc_oneshot_new_unit(const adc_oneshot_unit_init_cfg_t* config, adc_oneshot_unit_handle_t* handle)
+{
+    struct adc_oneshot_unit_ctx_t* unit = calloc(1, sizeof(struct adc_oneshot_unit_ctx_t));
+    if (!unit) {
+        return ESP_ERR_NO_MEM;
+    }
+    unit->unit = config->unit_id;
+    *handle = unit;
+    return ESP_OK;
+}
+
+esp_err_t adc_oneshot_del_unit(adc_oneshot_unit_handle_t handle)
+{
+    free(handle);
+    return ESP_OK;
+}
+
+esp_err_t adc_oneshot_config_channel(adc_oneshot_unit_handle_t handle, adc_channel_t channel, 
+                                     const adc_oneshot_chan_cfg_t* config)
+{
+    return (handle && (channel < ADC_CHANNELS)) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t adc_oneshot_read(adc_oneshot_unit_handle_t handle, adc_channel_t channel, int* out_raw)
+{
+    if (!handle || (channel >= ADC_CHANNELS) || !out_raw) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // The conversion blocks the caller, a timer can preempt it.
+    sim_consume((uint64_t)SIM_ADC_READ_US * SIM_CYCLES_PER_US);
+    *out_raw = adc_sample(channel);
+    return ESP_OK;
+}
+
+esp_err_t adc_cali_create_scheme_curve_fitting(const adc_cali_curve_fitting_config_t* config, 
+                                               adc_cali_handle_t* handle)
+{
+    if (!calibrated) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    struct adc_cali_scheme_t* scheme = calloc(1, sizeof(struct adc_cali_scheme_t));
+    if (!scheme) {
+        return ESP_ERR_NO_MEM;
+    }
+    scheme->unit = config->unit_id;
+    *handle = scheme;
+    return ESP_OK;
+}
+
+esp_err_t adc_cali_delete_scheme_curve_fitting(adc_cali_handle_t handle)
+{
+    free(handle);
+    return ESP_OK;
+}
+
+esp_err_t adc_cali_raw_to_voltage(adc_cali_handle_t handle, int raw, int* voltage)
+{
+    if (!handle || !voltage) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *voltage = (raw * SIM_ADC_FULL_SCALE_MV + (ADC_MAX_CODE / 2)) / ADC_MAX_CODE;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_new_handle(const adc_continuous_handle_cfg_t* config, adc_continuous_handle_t* handle)
+{
+    struct adc_continuous_ctx_t* ctx = calloc(1, sizeof(struct adc_continuous_ctx_t));
+    if (!ctx) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    ctx->frame_size = config->conv_frame_size;
+    ctx->frame = calloc(1, ctx->frame_size);
+    if (!ctx->frame) {
+        free(ctx);
+        return ESP_ERR_NO_MEM;
+    }
+
+    continuous = ctx;
+    *handle = ctx;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_config(adc_continuous_handle_t handle, const adc_continuous_config_t* config)
+{
+    if (handle->started || (config->pattern_num > SOC_ADC_PATT_LEN_MAX)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    memcpy(handle->pattern, config->adc_pattern, config->pattern_num * sizeof(adc_digi_pattern_config_t));
+    handle->pattern_num = config->pattern_num;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_register_event_callbacks(adc_continuous_handle_t handle, 
+                                                  const adc_continuous_evt_cbs_t* cbs, void* user_data)
+{
+    handle->cbs = *cbs;
+    handle->user_data = user_data;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_start(adc_continuous_handle_t handle)
+{
+    if (handle->started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    handle->started = true;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_stop(adc_continuous_handle_t handle)
+{
+    if (!handle->started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    handle->started = false;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_deinit(adc_continuous_handle_t handle)
+{
+    if (continuous == handle) {
+        continuous = NULL;
+    }
+    free(handle->frame);
+    free(handle);
+    return ESP_OK;
+}
+
+/**
+ * @brief Runs the conversion done callback of the frame.
+ */
+static void adc_frame_isr(void* arg)
+{
+    adc_continuous_evt_data_t* edata = arg;
+    if (continuous->cbs.on_conv_done) {
+        continuous->cbs.on_conv_done(continuous, edata, continuous->user_data);
+    }
+}
+
+esp_err_t sim_adc_continuous_frame(uint32_t samples)
+{
+    if (!continuous || !continuous->started || (continuous->pattern_num == 0)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // The DMA interleaves the channels of the pattern.
+    uint32_t max = continuous->frame_size / SOC_ADC_DIGI_RESULT_BYTES;
+    uint32_t n = 0;
+    for (uint32_t s = 0; (s < samples) && (n < max); s++) {
+        for (uint32_t p = 0; (p < continuous->pattern_num) && (n < max); p++) {
+            adc_digi_output_data_t data = { .val = 0 };
+            data.type2.channel = continuous->pattern[p].channel;
+            data.type2.unit = continuous->pattern[p].unit;
+            data.type2.data = adc_sample(continuous->pattern[p].channel);
+            memcpy(&continuous->frame[n * SOC_ADC_DIGI_RESULT_BYTES], &data, sizeof(data));
+            n++;
+        }
+    }
+
+    adc_continuous_evt_data_t edata = {
+        .conv_frame_buffer = continuous->frame,
+        .size = n * SOC_ADC_DIGI_RESULT_BYTES,
+    };
+    sim_run_isr(adc_frame_isr, &edata);
+    return ESP_OK;
+}
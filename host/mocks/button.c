@@ -0,0 +1,152 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file button.c
+ * @brief Host mock of the button component, the callbacks of the presses 
+ *        injected by the tests run in the esp_timer task, like the polling 
+ *        timer of the component.
+ */
+
+#include <stdlib.h>
+
+#include "sim.h"
+#include "iot_button.h"
+#include "esp_timer.h"
+
+#define BUTTON_PRESS_CBS    4
+
+typedef struct {
+    uint32_t seconds;
+    button_cb cb;
+    void* arg;
+} press_cb_t;
+
+struct sim_button {
+    int gpio_num;
+    button_cb tap_cb;
+    void* tap_arg;
+    press_cb_t press[BUTTON_PRESS_CBS];
+    uint32_t press_count;
+    uint32_t held;              ///< Seconds of the pending press, 0 for a tap.
+    esp_timer_handle_t timer;
+    struct sim_button* next;
+};
+
+static struct sim_button* buttons;
+
+/**
+ * @brief Release of the pending press, runs its callbacks.
+ */
+static void button_release(void* arg)
+{
+    struct sim_button* btn = arg;
+
+    if (btn->held == 0) {
+        if (btn->tap_cb) {
+            btn->tap_cb(btn->tap_arg);
+        }
+        return;
+    }
+
+    for (uint32_t i = 0; i < btn->press_count; i++) {
+        if (btn->press[i].seconds <= btn->held) {
+            btn->press[i].cb(btn->press[i].arg);
+        }
+    }
+}
+
+button_handle_t iot_button_create(int gpio_num, int active_level)
+{
+    struct sim_button* btn = calloc(1, sizeof(struct sim_button));
+    if (!btn) {
+        return NULL;
+    }
+
+    esp_timer_create_args_t timer_conf = {
+        .callback = button_release,
+        .arg = btn,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "button",
+    };
+    if (esp_timer_create(&timer_conf, &btn->timer) != ESP_OK) {
+        free(btn);
+        return NULL;
+    }
+
+    btn->gpio_num = gpio_num;
+    btn->next = buttons;
+    buttons = btn;
+    return btn;
+}
+
+esp_err_t iot_button_set_evt_cb(button_handle_t btn, button_cb_type_t type, button_cb cb, void* arg)
+{
+    if (!btn) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (type == BUTTON_CB_TAP) {
+        btn->tap_cb = cb;
+        btn->tap_arg = arg;
+    }
+    return ESP_OK;
+}
+
+esp_err_t iot_button_add_on_press_cb(button_handle_t btn, uint32_t press_sec, button_cb cb, void* arg)
+{
+    if (!btn || (btn->press_count == BUTTON_PRESS_CBS)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    btn->press[btn->press_count++] = (press_cb_t){ .seconds = press_sec, .cb = cb, .arg = arg };
+    return ESP_OK;
+}
+
+esp_err_t iot_button_add_on_release_cb(button_handle_t btn, uint32_t press_sec, button_cb cb, void* arg)
+{
+    return iot_button_add_on_press_cb(btn, press_sec, cb, arg);
+}
+
+/**
+ * @brief Schedules the release of a press of a button.
+ */
+static void button_press(int gpio_num, uint32_t seconds)
+{
+    for (struct sim_button* btn = buttons; btn; btn = btn->next) {
+        if (btn->gpio_num == gpio_num) {
+            btn->held = seconds;
+            esp_timer_stop(btn->timer);
+            esp_timer_start_once(btn->timer, 0);
+        }
+    }
+}
+
+void sim_button_tap(int gpio_num)
+{
+    button_press(gpio_num, 0);
+}
+
+void sim_button_hold(int gpio_num, uint32_t seconds)
+{
+    button_press(gpio_num, seconds);
+}
@@ -0,0 +1,201 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file esp_timer.c
+ * @brief Host mock of the esp_timer: the callbacks run in a task with the 
+ *        priority of the IDF timer task, which sleeps until the earliest 
+ *        expiry of the virtual clock. Like the IDF, starting an active 
+ *        timer or stopping an idle one fails with ESP_ERR_INVALID_STATE.
+ */
+
+#include <stdlib.h>
+
+#include "sim.h"
+#include "sim_kernel.h"
+#include "esp_timer.h"
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void* arg;
+    const char* name;
+    uint64_t expiry;        ///< Cycle of the next expiry.
+    uint64_t period;        ///< Cycles of the period, 0 for a one-shot.
+    bool active;
+    struct esp_timer* next;
+};
+
+static struct esp_timer* timers;
+static TaskHandle_t timer_task;
+static int timer_wait;      /* Address of the wait of the timer task */
+
+/**
+ * @brief Active timer with the earliest expiry.
+ */
+static struct esp_timer* timer_earliest(void)
+{
+    struct esp_timer* earliest = NULL;
+
+    for (struct esp_timer* timer = timers; timer; timer = timer->next) {
+        if (timer->active && (!earliest || (timer->expiry < earliest->expiry))) {
+            earliest = timer;
+        }
+    }
+    return earliest;
+}
+
+/**
+ * @brief Sleeps the timer task until the earliest expiry, and lets it run 
+ *        at once when it's due and has more priority than the caller.
+ */
+static void timer_rearm(void)
+{
+    struct esp_timer* earliest = timer_earliest();
+    sim_set_deadline(timer_task, &timer_wait, earliest ? earliest->expiry : SIM_FOREVER);
+    if (!sim_in_isr()) {
+        sim_consume(0);
+    }
+}
+
+/**
+ * @brief Timer task, runs the callbacks in order of expiry.
+ */
+static void timer_task_fn(void* arg)
+{
+    while (true) {
+        struct esp_timer* timer = timer_earliest();
+
+        if (!timer || (timer->expiry > sim_cycles())) {
+            sim_block(&timer_wait, timer ? timer->expiry : SIM_FOREVER);
+            continue;
+        }
+
+        if (timer->period) {
+            timer->expiry += timer->period;
+        } else {
+            timer->active = false;
+        }
+        timer->callback(timer->arg);
+    }
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle)
+{
+    if (!args || !args->callback || !handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct esp_timer* timer = calloc(1, sizeof(struct esp_timer));
+    if (!timer) {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->callback = args->callback;
+    timer->arg = args->arg;
+    timer->name = args->name;
+    timer->next = timers;
+    timers = timer;
+
+    if (!timer_task) {
+        timer_task = sim_task_create(timer_task_fn, "esp_timer", NULL, SIM_TIMER_PRIORITY);
+    }
+
+    *handle = timer;
+    return ESP_OK;
+}
+
+/**
+ * @brief Arms a timer, it fails if it's already active.
+ */
+static esp_err_t timer_start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us)
+{
+    if (!timer) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    timer->expiry = sim_cycles() + timeout_us * SIM_CYCLES_PER_US;
+    timer->period = period_us * SIM_CYCLES_PER_US;
+    timer->active = true;
+    timer_rearm();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return timer_start(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    if (period_us == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return timer_start(timer, period_us, period_us);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (!timer) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    timer->active = false;
+    timer_rearm();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    if (!timer) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    struct esp_timer** link = &timers;
+    while (*link && (*link != timer)) {
+        link = &(*link)->next;
+    }
+    if (*link) {
+        *link = timer->next;
+    }
+    free(timer);
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    return timer && timer->active;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return sim_time_us();
+}
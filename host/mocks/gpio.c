@@ -0,0 +1,315 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file gpio.c
+ * @brief Host mock of the GPIO driver and registers: the outputs are kept 
+ *        in a model of GPIO_OUT with a log of the changes, the inputs are 
+ *        driven by sim_gpio_input() and run the ISR of the pin on its edges.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "sim_kernel.h"
+#include "driver/gpio.h"
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+
+#define GPIO_LOG_CHUNK      256
+
+typedef struct {
+    gpio_mode_t mode;
+    gpio_int_type_t intr_type;
+    bool intr_enabled;
+    gpio_isr_t isr;
+    void* arg;
+    int input;
+} sim_pin_t;
+
+static sim_pin_t pins[GPIO_NUM_MAX];
+static bool pins_ready;
+static bool isr_service;
+static uint32_t gpio_out;
+static sim_gpio_write_t* writes;
+static size_t writes_count;
+static size_t writes_size;
+
+/**
+ * @brief The inputs idle high, the encoder and the button have pull-ups.
+ */
+static void pins_init(void)
+{
+    if (!pins_ready) {
+        for (int i = 0; i < GPIO_NUM_MAX; i++) {
+            pins[i].input = 1;
+        }
+        pins_ready = true;
+    }
+}
+
+static bool pin_valid(gpio_num_t gpio_num)
+{
+    pins_init();
+    return (gpio_num >= 0) && (gpio_num < GPIO_NUM_MAX);
+}
+
+/**
+ * @brief Applies a change of the outputs and logs it.
+ */
+static void gpio_out_write(uint32_t set, uint32_t clear)
+{
+    gpio_out = (gpio_out | set) & ~clear;
+
+    if (writes_count == writes_size) {
+        size_t size = writes_size + GPIO_LOG_CHUNK;
+        sim_gpio_write_t* log = realloc(writes, size * sizeof(sim_gpio_write_t));
+        if (!log) {
+            return;
+        }
+        writes = log;
+        writes_size = size;
+    }
+    writes[writes_count++] = (sim_gpio_write_t){ .time_us = sim_time_us(), .set = set, .clear = clear };
+}
+
+void sim_reg_write(uint32_t reg, uint32_t value)
+{
+    switch (reg) {
+    case GPIO_OUT_REG:
+        gpio_out_write(value, ~value);
+        break;
+    case GPIO_OUT_W1TS_REG:
+        gpio_out_write(value, 0);
+        break;
+    case GPIO_OUT_W1TC_REG:
+        gpio_out_write(0, value);
+        break;
+    default:
+        break;
+    }
+}
+
+uint32_t sim_reg_read(uint32_t reg)
+{
+    uint32_t in = 0;
+
+    switch (reg) {
+    case GPIO_OUT_REG:
+        return gpio_out;
+    case GPIO_IN_REG:
+        pins_init();
+        for (int i = 0; i < GPIO_NUM_MAX; i++) {
+            in |= (uint32_t)(pins[i].input & 1) << i;
+        }
+        return in;
+    default:
+        return 0;
+    }
+}
+
+esp_err_t gpio_config(const gpio_config_t* config)
+{
+    for (gpio_num_t i = 0; i < GPIO_NUM_MAX; i++) {
+        if (config->pin_bit_mask & (1ULL << i)) {
+            pin_valid(i);
+            pins[i].mode = config->mode;
+            pins[i].intr_type = config->intr_type;
+            pins[i].intr_enabled = (config->intr_type != GPIO_INTR_DISABLE);
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t gpio_reset_pin(gpio_num_t gpio_num)
+{
+    if (!pin_valid(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pins[gpio_num].mode = GPIO_MODE_INPUT;
+    pins[gpio_num].intr_type = GPIO_INTR_DISABLE;
+    pins[gpio_num].intr_enabled = false;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode)
+{
+    if (!pin_valid(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pins[gpio_num].mode = mode;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_pull_mode(gpio_num_t gpio_num, gpio_pull_mode_t pull)
+{
+    return pin_valid(gpio_num) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    if (!pin_valid(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (gpio_num < 32) {
+        uint32_t bit = 1UL << gpio_num;
+        gpio_out_write(level ? bit : 0, level ? 0 : bit);
+    }
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    if (!pin_valid(gpio_num)) {
+        return 0;
+    }
+    if (pins[gpio_num].mode == GPIO_MODE_OUTPUT) {
+        return (gpio_out >> gpio_num) & 1;
+    }
+    return pins[gpio_num].input;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type)
+{
+    if (!pin_valid(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pins[gpio_num].intr_type = intr_type;
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t gpio_num)
+{
+    if (!pin_valid(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pins[gpio_num].intr_enabled = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio_num)
+{
+    if (!pin_valid(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pins[gpio_num].intr_enabled = false;
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int flags)
+{
+    if (isr_service) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    isr_service = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t handler, void* arg)
+{
+    if (!pin_valid(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!isr_service) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // As the IDF, adding the handler enables the interrupt.
+    pins[gpio_num].isr = handler;
+    pins[gpio_num].arg = arg;
+    pins[gpio_num].intr_enabled = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num)
+{
+    if (!pin_valid(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pins[gpio_num].isr = NULL;
+    pins[gpio_num].arg = NULL;
+    pins[gpio_num].intr_enabled = false;
+    return ESP_OK;
+}
+
+gpio_isr_t sim_gpio_isr(gpio_num_t gpio_num, void** arg)
+{
+    if (!pin_valid(gpio_num)) {
+        return NULL;
+    }
+    *arg = pins[gpio_num].arg;
+    return pins[gpio_num].isr;
+}
+
+void sim_gpio_input(gpio_num_t gpio_num, int level)
+{
+    if (!pin_valid(gpio_num)) {
+        return;
+    }
+
+    sim_pin_t* pin = &pins[gpio_num];
+    int old = pin->input;
+    pin->input = level ? 1 : 0;
+
+    bool edge = false;
+    switch (pin->intr_type) {
+    case GPIO_INTR_POSEDGE:
+        edge = !old && pin->input;
+        break;
+    case GPIO_INTR_NEGEDGE:
+        edge = old && !pin->input;
+        break;
+    case GPIO_INTR_ANYEDGE:
+        edge = old != pin->input;
+        break;
+    case GPIO_INTR_LOW_LEVEL:
+        edge = !pin->input;
+        break;
+    case GPIO_INTR_HIGH_LEVEL:
+        edge = pin->input;
+        break;
+    default:
+        break;
+    }
+
+    if (edge && pin->intr_enabled && pin->isr) {
+        sim_run_isr(pin->isr, pin->arg);
+    }
+}
+
+uint32_t sim_gpio_output(void)
+{
+    return gpio_out;
+}
+
+const sim_gpio_write_t* sim_gpio_writes(size_t* count)
+{
+    *count = writes_count;
+    return writes;
+}
+
+void sim_gpio_clear_writes(void)
+{
+    writes_count = 0;
+}
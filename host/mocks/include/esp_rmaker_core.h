@@ -0,0 +1,112 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file esp_rmaker_core.h
+ * @brief Host mock of the RainMaker core: the node, devices and params are 
+ *        kept in memory, the reports are counted, and the cloud writes are 
+ *        injected by the tests with sim_rmaker_write(), they reach the 
+ *        write callbacks from the RainMaker task like on the device.
+ */
+#pragma once
+#include "esp_err.h"
+
+typedef struct esp_rmaker_node esp_rmaker_node_t;
+typedef struct esp_rmaker_device esp_rmaker_device_t;
+typedef struct esp_rmaker_param esp_rmaker_param_t;
+
+typedef enum {
+    RMAKER_VAL_TYPE_INVALID = 0,
+    RMAKER_VAL_TYPE_BOOLEAN,
+    RMAKER_VAL_TYPE_INTEGER,
+    RMAKER_VAL_TYPE_FLOAT,
+    RMAKER_VAL_TYPE_STRING,
+} esp_rmaker_val_type_t;
+
+typedef union {
+    bool b;
+    int i;
+    float f;
+    char* s;
+} esp_rmaker_val_t;
+
+typedef struct {
+    esp_rmaker_val_type_t type;
+    esp_rmaker_val_t val;
+} esp_rmaker_param_val_t;
+
+typedef enum {
+    ESP_RMAKER_REQ_SRC_INIT,
+    ESP_RMAKER_REQ_SRC_CLOUD,
+    ESP_RMAKER_REQ_SRC_SCHEDULE,
+    ESP_RMAKER_REQ_SRC_LOCAL,
+} esp_rmaker_req_src_t;
+
+typedef struct {
+    esp_rmaker_req_src_t src;
+} esp_rmaker_write_ctx_t;
+
+typedef esp_err_t (*esp_rmaker_device_write_cb_t)(const esp_rmaker_device_t* device, 
+                                                  const esp_rmaker_param_t* param, 
+                                                  const esp_rmaker_param_val_t val, 
+                                                  void* priv_data, esp_rmaker_write_ctx_t* ctx);
+
+typedef struct {
+    bool enable_time_sync;
+} esp_rmaker_config_t;
+
+#define PROP_FLAG_WRITE         (1 << 0)
+#define PROP_FLAG_READ          (1 << 1)
+#define PROP_FLAG_TIME_SERIES   (1 << 2)
+#define PROP_FLAG_PERSIST       (1 << 3)
+
+esp_rmaker_param_val_t esp_rmaker_bool(bool val);
+esp_rmaker_param_val_t esp_rmaker_int(int val);
+esp_rmaker_param_val_t esp_rmaker_float(float val);
+esp_rmaker_param_val_t esp_rmaker_str(const char* val);
+
+esp_rmaker_node_t* esp_rmaker_node_init(const esp_rmaker_config_t* config, const char* name, const char* type);
+esp_err_t esp_rmaker_node_add_device(const esp_rmaker_node_t* node, const esp_rmaker_device_t* device);
+esp_err_t esp_rmaker_start(void);
+
+esp_rmaker_device_t* esp_rmaker_device_create(const char* name, const char* type, void* priv_data);
+esp_err_t esp_rmaker_device_add_cb(const esp_rmaker_device_t* device, esp_rmaker_device_write_cb_t write_cb, 
+                                   void* read_cb);
+esp_err_t esp_rmaker_device_add_param(const esp_rmaker_device_t* device, const esp_rmaker_param_t* param);
+esp_err_t esp_rmaker_device_assign_primary_param(const esp_rmaker_device_t* device, const esp_rmaker_param_t* param);
+esp_rmaker_param_t* esp_rmaker_device_get_param_by_type(const esp_rmaker_device_t* device, const char* type);
+esp_rmaker_param_t* esp_rmaker_device_get_param_by_name(const esp_rmaker_device_t* device, const char* name);
+char* esp_rmaker_device_get_name(const esp_rmaker_device_t* device);
+const char* esp_rmaker_device_cb_src_to_str(esp_rmaker_req_src_t src);
+
+esp_rmaker_param_t* esp_rmaker_param_create(const char* name, const char* type, 
+                                            esp_rmaker_param_val_t val, uint8_t properties);
+esp_err_t esp_rmaker_param_add_ui_type(const esp_rmaker_param_t* param, const char* ui_type);
+esp_err_t esp_rmaker_param_add_bounds(const esp_rmaker_param_t* param, esp_rmaker_param_val_t min, 
+                                      esp_rmaker_param_val_t max, esp_rmaker_param_val_t step);
+esp_err_t esp_rmaker_param_update(const esp_rmaker_param_t* param, esp_rmaker_param_val_t val);
+esp_err_t esp_rmaker_param_report(const esp_rmaker_param_t* param);
+esp_err_t esp_rmaker_param_update_and_report(const esp_rmaker_param_t* param, esp_rmaker_param_val_t val);
+esp_rmaker_param_val_t* esp_rmaker_param_get_val(esp_rmaker_param_t* param);
+char* esp_rmaker_param_get_name(const esp_rmaker_param_t* param);
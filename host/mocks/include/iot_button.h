@@ -0,0 +1,46 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file iot_button.h
+ * @brief Host mock of the button component, the presses are injected by 
+ *        the tests with sim_button_tap() and sim_button_hold().
+ */
+#pragma once
+#include "esp_err.h"
+
+typedef struct sim_button* button_handle_t;
+typedef void (*button_cb)(void* arg);
+
+typedef enum {
+    BUTTON_CB_PUSH,
+    BUTTON_CB_RELEASE,
+    BUTTON_CB_TAP,
+    BUTTON_CB_SERIAL,
+} button_cb_type_t;
+
+button_handle_t iot_button_create(int gpio_num, int active_level);
+esp_err_t iot_button_set_evt_cb(button_handle_t btn, button_cb_type_t type, button_cb cb, void* arg);
+esp_err_t iot_button_add_on_press_cb(button_handle_t btn, uint32_t press_sec, button_cb cb, void* arg);
+esp_err_t iot_button_add_on_release_cb(button_handle_t btn, uint32_t press_sec, button_cb cb, void* arg);
@@ -0,0 +1,255 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 Juan Schiavoni
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file sim.h
+ * @brief Control of the host simulation, used by the scenario runner and the
+ *        tests to drive the mocked peripherals and to observe the outputs.
+ *
+ * The time is virtual: a clock of CPU cycles at SIM_CPU_FREQ_HZ that only
+ * moves when the code consumes cycles (context switches, ISR entries, ADC
+ * conversions) or when every task is blocked and it jumps to the next
+ * timeout. The same scenario always produces the same trace.
+ */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+#include "driver/gpio.h"
+#include "esp_adc/adc_oneshot.h"
+#include "esp_rmaker_core.h"
+
+#define SIM_CPU_FREQ_HZ         160000000   /* ESP32-C3 at 160 MHz */
+#define SIM_CYCLES_PER_US       (SIM_CPU_FREQ_HZ / 1000000)
+#define SIM_SWITCH_CYCLES       480         /* Context switch of FreeRTOS, about 3 uS */
+#define SIM_ISR_ENTRY_CYCLES    160         /* Interrupt entry and dispatch, about 1 uS */
+#define SIM_ADC_READ_US         20          /* Blocking oneshot conversion */
+#define SIM_ADC_FULL_SCALE_MV   3300        /* Linear calibration of the mock */
+#define SIM_WIFI_CONNECT_MS     1500        /* Time of app_wifi_start */
+#define SIM_TIMER_PRIORITY      22          /* Priority of the esp_timer task of the IDF */
+#define SIM_RMAKER_PRIORITY     5           /* Priority of the RainMaker work queue task */
+
+/**
+ * @brief Output change of the GPIO model, by gpio_set_level or a register write.
+ */
+typedef struct {
+    int64_t time_us;        ///< Virtual time of the change.
+    uint32_t set;           ///< Bits written to 1.
+    uint32_t clear;         ///< Bits written to 0.
+} sim_gpio_write_t;
+
+/**
+ * @brief Source of the raw codes of an ADC channel.
+ * @param channel ADC channel read.
+ * @param ctx Context given with the source.
+ * @return Raw code, 0 to 4095.
+ */
+typedef int (*sim_adc_source_t)(adc_channel_t channel, void* ctx);
+
+/**
+ * @brief Runs the tasks until sim_stop() is called or every task is blocked
+ *        without a timeout.
+ */
+void sim_run(void);
+
+/**
+ * @brief Ends sim_run() at the next switch, it can be called from a task.
+ */
+void sim_stop(void);
+
+/**
+ * @brief Virtual time.
+ * @return CPU cycles since the reset.
+ */
+uint64_t sim_cycles(void);
+
+/**
+ * @brief Virtual time.
+ * @return Microseconds since the reset.
+ */
+int64_t sim_time_us(void);
+
+/**
+ * @brief Charges the CPU time of the running code to the clock. It's a
+ *        preemption point: a higher priority task that became ready in the
+ *        meantime (a timer) runs before it returns.
+ * @param cycles CPU cycles consumed.
+ */
+void sim_consume(uint64_t cycles);
+
+/**
+ * @brief Blocks the running task with a resolution of one cycle, the ticks
+ *        of vTaskDelay are too coarse to drive the encoder.
+ * @param us Microseconds to sleep.
+ */
+void sim_sleep_us(uint64_t us);
+
+/**
+ * @brief Runs a function in ISR context from the running task, with the
+ *        cost of the interrupt entry. The switch to a task woken by the ISR
+ *        happens when it returns.
+ * @param isr Handler.
+ * @param arg Argument of the handler.
+ */
+void sim_run_isr(void (*isr)(void*), void* arg);
+
+/**
+ * @brief Drives the level of an input, the ISR of the pin runs when the
+ *        edge matches its interrupt type.
+ * @param gpio_num Pin.
+ * @param level New level.
+ */
+void sim_gpio_input(gpio_num_t gpio_num, int level);
+
+/**
+ * @brief Handler installed on a pin, to call it without the cost of the 
+ *        simulated interrupt (with the interrupt of the pin disabled, 
+ *        sim_gpio_input() only changes the level).
+ * @param gpio_num Pin.
+ * @param arg Pointer to store the argument of the handler.
+ * @return The handler, NULL if there is none.
+ */
+gpio_isr_t sim_gpio_isr(gpio_num_t gpio_num, void** arg);
+
+/**
+ * @brief Levels of the outputs.
+ * @return Bit mask of GPIO0 to GPIO31.
+ */
+uint32_t sim_gpio_output(void);
+
+/**
+ * @brief Log of the output changes since the reset or the last clear.
+ * @param count Pointer to store the number of changes.
+ * @return The changes in order.
+ */
+const sim_gpio_write_t* sim_gpio_writes(size_t* count);
+
+/**
+ * @brief Clears the log of the output changes.
+ */
+void sim_gpio_clear_writes(void);
+
+/**
+ * @brief Sets a fixed raw code on an ADC channel.
+ * @param channel ADC channel.
+ * @param raw Raw code, 0 to 4095.
+ */
+void sim_adc_set_raw(adc_channel_t channel, int raw);
+
+/**
+ * @brief Sets a source of raw codes on an ADC channel, called on every
+ *        conversion.
+ * @param channel ADC channel.
+ * @param source Function that returns the codes.
+ * @param ctx Context of the function.
+ */
+void sim_adc_set_source(adc_channel_t channel, sim_adc_source_t source, void* ctx);
+
+/**
+ * @brief Simulates a chip without the calibration in eFuse, the creation
+ *        of the calibration schemes fails.
+ * @param calibrated False for an uncalibrated chip.
+ */
+void sim_adc_set_calibrated(bool calibrated);
+
+/**
+ * @brief Produces a frame of the continuous ADC with the configured
+ *        pattern, and runs the conversion done callback in ISR context.
+ * @param samples Samples of each channel of the pattern.
+ * @return ESP_OK, or ESP_ERR_INVALID_STATE if the driver is not started.
+ */
+esp_err_t sim_adc_continuous_frame(uint32_t samples);
+
+/**
+ * @brief Simulates a tap of the button created with iot_button_create.
+ * @param gpio_num Pin of the button.
+ */
+void sim_button_tap(int gpio_num);
+
+/**
+ * @brief Simulates a press of the button held a number of seconds, the
+ *        press callbacks of that time or less run at the release.
+ * @param gpio_num Pin of the button.
+ * @param seconds Time held.
+ */
+void sim_button_hold(int gpio_num, uint32_t seconds);
+
+/**
+ * @brief Sends a write of the cloud to a param, the write callback of the
+ *        device runs in the RainMaker task.
+ * @param device Name of the device.
+ * @param param Name of the param.
+ * @param val Value written.
+ * @return ESP_OK, ESP_ERR_INVALID_STATE before esp_rmaker_start,
+ *         ESP_ERR_NOT_FOUND for an unknown param.
+ */
+esp_err_t sim_rmaker_write(const char* device, const char* param, esp_rmaker_param_val_t val);
+
+/**
+ * @brief Finds a param of the node.
+ * @param device Name of the device.
+ * @param param Name of the param.
+ * @return The param, NULL if it's not found.
+ */
+esp_rmaker_param_t* sim_rmaker_param(const char* device, const char* param);
+
+/**
+ * @brief Number of successful reports of a param.
+ * @param param Param.
+ * @return Reports since it was created.
+ */
+uint32_t sim_rmaker_reports(const esp_rmaker_param_t* param);
+
+/**
+ * @brief Number of successful reports of the params of a device.
+ * @param device Name of the device.
+ * @return Reports since the params were created.
+ */
+uint32_t sim_rmaker_device_reports(const char* device);
+
+/**
+ * @brief Makes the next reports fail, as with the MQTT link down.
+ * @param err Result of esp_rmaker_param_report, ESP_OK to restore it.
+ */
+void sim_rmaker_set_report_error(esp_err_t err);
+
+/**
+ * @brief Number of blobs written to NVS with a new content.
+ * @return Writes since the reset.
+ */
+uint32_t sim_nvs_writes(void);
+
+/**
+ * @brief Sets the free heap seen by the firmware, the minimum follows it down.
+ * @param bytes Free heap.
+ */
+void sim_heap_set(uint32_t bytes);
+
+/**
+ * @brief Color of the neopixel.
+ * @return RGB as 0x00RRGGBB.
+ */
+uint32_t sim_led_rgb(void);
@@ -0,0 +1,81 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file sim_kernel.h
+ * @brief Primitives of the scheduler used by the mocks to block and wake 
+ *        the tasks, not part of the API of the tests.
+ */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define SIM_FOREVER     UINT64_MAX
+
+/**
+ * @brief Blocks the running task until another one wakes it on the object, 
+ *        or until the deadline.
+ * @param obj Address the task waits on, NULL to only sleep.
+ * @param deadline Cycle of the timeout, SIM_FOREVER for none.
+ * @return True if woken on the object, false on timeout.
+ */
+bool sim_block(const void* obj, uint64_t deadline);
+
+/**
+ * @brief Wakes the highest priority task waiting on an object. When it has 
+ *        more priority than the running task, the running task yields, at 
+ *        once or at the end of the critical section or the ISR.
+ * @param obj Address the task waits on.
+ * @return True if a task of higher priority than the running one was woken.
+ */
+bool sim_wake(const void* obj);
+
+/**
+ * @brief Changes the deadline of a task blocked on an object, used by the 
+ *        timer task to sleep until the next expiry.
+ * @param task Blocked task.
+ * @param obj Address it waits on.
+ * @param deadline New deadline.
+ */
+void sim_set_deadline(TaskHandle_t task, const void* obj, uint64_t deadline);
+
+/**
+ * @brief Deadline of a number of ticks from now.
+ * @param ticks FreeRTOS ticks, portMAX_DELAY for none.
+ * @return Cycle of the timeout.
+ */
+uint64_t sim_deadline(TickType_t ticks);
+
+/**
+ * @brief Creates a task of the simulation itself (timer, RainMaker).
+ */
+TaskHandle_t sim_task_create(TaskFunction_t fn, const char* name, void* arg, UBaseType_t priority);
+
+/**
+ * @brief True while an ISR runs.
+ */
+bool sim_in_isr(void);
@@ -0,0 +1,234 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file nvs.c
+ * @brief Host mock of NVS, the blobs of every namespace are kept in memory. 
+ *        Like the IDF, writing the same content again does not touch the 
+ *        flash, sim_nvs_writes() counts only the real writes.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+
+#define NVS_KEY_LEN         16
+#define NVS_MAX_HANDLES     8
+
+typedef struct nvs_entry {
+    char ns[NVS_KEY_LEN];
+    char key[NVS_KEY_LEN];
+    uint8_t* data;
+    size_t length;
+    struct nvs_entry* next;
+} nvs_entry_t;
+
+typedef struct {
+    bool used;
+    char ns[NVS_KEY_LEN];
+    nvs_open_mode_t mode;
+} nvs_open_t;
+
+static nvs_entry_t* entries;
+static nvs_open_t handles[NVS_MAX_HANDLES];
+static bool initialized;
+static uint32_t writes;
+
+esp_err_t nvs_flash_init(void)
+{
+    initialized = true;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    while (entries) {
+        nvs_entry_t* entry = entries;
+        entries = entry->next;
+        free(entry->data);
+        free(entry);
+    }
+    return ESP_OK;
+}
+
+static nvs_entry_t* nvs_find(const char* ns, const char* key)
+{
+    for (nvs_entry_t* entry = entries; entry; entry = entry->next) {
+        if ((strcmp(entry->ns, ns) == 0) && (strcmp(entry->key, key) == 0)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static bool nvs_ns_exists(const char* ns)
+{
+    for (nvs_entry_t* entry = entries; entry; entry = entry->next) {
+        if (strcmp(entry->ns, ns) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Open namespace of a handle, NULL if it's not valid.
+ */
+static nvs_open_t* nvs_handle(nvs_handle_t handle)
+{
+    if ((handle == 0) || (handle > NVS_MAX_HANDLES) || !handles[handle - 1].used) {
+        return NULL;
+    }
+    return &handles[handle - 1];
+}
+
+esp_err_t nvs_open(const char* name, nvs_open_mode_t mode, nvs_handle_t* handle)
+{
+    if (!initialized) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    if (!name || (strlen(name) >= NVS_KEY_LEN)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // A read-only open does not create the namespace.
+    if ((mode == NVS_READONLY) && !nvs_ns_exists(name)) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    for (int i = 0; i < NVS_MAX_HANDLES; i++) {
+        if (!handles[i].used) {
+            handles[i].used = true;
+            handles[i].mode = mode;
+            strcpy(handles[i].ns, name);
+            *handle = i + 1;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* out_value, size_t* length)
+{
+    nvs_open_t* open = nvs_handle(handle);
+    if (!open) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+
+    nvs_entry_t* entry = nvs_find(open->ns, key);
+    if (!entry) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    if (!out_value) {
+        *length = entry->length;
+        return ESP_OK;
+    }
+    if (*length < entry->length) {
+        *length = entry->length;
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    memcpy(out_value, entry->data, entry->length);
+    *length = entry->length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* value, size_t length)
+{
+    nvs_open_t* open = nvs_handle(handle);
+    if (!open || (open->mode != NVS_READWRITE)) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (!key || (strlen(key) >= NVS_KEY_LEN)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    nvs_entry_t* entry = nvs_find(open->ns, key);
+    if (entry && (entry->length == length) && (memcmp(entry->data, value, length) == 0)) {
+        return ESP_OK;
+    }
+
+    if (!entry) {
+        entry = calloc(1, sizeof(nvs_entry_t));
+        if (!entry) {
+            return ESP_ERR_NO_MEM;
+        }
+        strcpy(entry->ns, open->ns);
+        strcpy(entry->key, key);
+        entry->next = entries;
+        entries = entry;
+    }
+
+    uint8_t* data = malloc(length ? length : 1);
+    if (!data) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(data, value, length);
+    free(entry->data);
+    entry->data = data;
+    entry->length = length;
+    writes++;
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key)
+{
+    nvs_open_t* open = nvs_handle(handle);
+    if (!open || (open->mode != NVS_READWRITE)) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+
+    for (nvs_entry_t** link = &entries; *link; link = &(*link)->next) {
+        nvs_entry_t* entry = *link;
+        if ((strcmp(entry->ns, open->ns) == 0) && (strcmp(entry->key, key) == 0)) {
+            *link = entry->next;
+            free(entry->data);
+            free(entry);
+            writes++;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return nvs_handle(handle) ? ESP_OK : ESP_ERR_NVS_INVALID_HANDLE;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    nvs_open_t* open = nvs_handle(handle);
+    if (open) {
+        open->used = false;
+    }
+}
+
+uint32_t sim_nvs_writes(void)
+{
+    return writes;
+}
@@ -0,0 +1,218 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file platform.c
+ * @brief Host mocks of the small services of the IDF and of the RainMaker 
+ *        examples: log, error names, CPU and heap, CRC32, base64, Wi-Fi, 
+ *        reset buttons and neopixel.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "sim.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_cpu.h"
+#include "esp_system.h"
+#include "esp_rom_crc.h"
+#include "esp_private/esp_clk.h"
+#include "mbedtls/base64.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "app_wifi.h"
+#include "app_reset.h"
+#include "ws2812_led.h"
+
+#define SIM_HEAP_SIZE       (280 * 1024)    /* Free heap of the firmware after the boot */
+#define SIM_HEAP_MIN        (262 * 1024)
+
+static esp_log_level_t log_level = ESP_LOG_INFO;
+static uint32_t led_rgb;
+static uint32_t heap_free = SIM_HEAP_SIZE;
+static uint32_t heap_min = SIM_HEAP_MIN;
+
+void esp_log_level_set(const char* tag, esp_log_level_t level)
+{
+    log_level = level;
+}
+
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...)
+{
+    static const char letters[] = "NEWIDV";
+
+    if (level > log_level) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    printf("%c (%lld) %s: ", letters[level], (long long)(sim_time_us() / 1000), tag);
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+}
+
+const char* esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+    case ESP_OK:                        return "ESP_OK";
+    case ESP_FAIL:                      return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:                return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:           return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:         return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:          return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:             return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:         return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:               return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_NVS_NOT_FOUND:         return "ESP_ERR_NVS_NOT_FOUND";
+    case ESP_ERR_NVS_INVALID_LENGTH:    return "ESP_ERR_NVS_INVALID_LENGTH";
+    default:                            return "UNKNOWN ERROR";
+    }
+}
+
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void)
+{
+    return (esp_cpu_cycle_count_t)sim_cycles();
+}
+
+int esp_cpu_get_core_id(void)
+{
+    return 0;
+}
+
+int esp_clk_cpu_freq(void)
+{
+    return SIM_CPU_FREQ_HZ;
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    return heap_free;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void)
+{
+    return heap_min;
+}
+
+void sim_heap_set(uint32_t bytes)
+{
+    heap_free = bytes;
+    if (bytes < heap_min) {
+        heap_min = bytes;
+    }
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len)
+{
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xEDB88320UL & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+int mbedtls_base64_encode(unsigned char* dst, size_t dlen, size_t* olen, 
+                          const unsigned char* src, size_t slen)
+{
+    static const char alphabet[] = 
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t need = ((slen + 2) / 3) * 4 + 1;
+
+    if (!dst || (dlen < need)) {
+        *olen = need;
+        return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < slen; i += 3) {
+        uint32_t v = (uint32_t)src[i] << 16;
+        if (i + 1 < slen) {
+            v |= (uint32_t)src[i + 1] << 8;
+        }
+        if (i + 2 < slen) {
+            v |= src[i + 2];
+        }
+        dst[n++] = alphabet[(v >> 18) & 0x3f];
+        dst[n++] = alphabet[(v >> 12) & 0x3f];
+        dst[n++] = (i + 1 < slen) ? alphabet[(v >> 6) & 0x3f] : '=';
+        dst[n++] = (i + 2 < slen) ? alphabet[v & 0x3f] : '=';
+    }
+    dst[n] = 0;
+    *olen = n;
+    return 0;
+}
+
+void app_wifi_init(void)
+{
+}
+
+esp_err_t app_wifi_start(app_wifi_pop_type_t pop_type)
+{
+    // The node is provisioned, it only waits for the connection.
+    vTaskDelay(pdMS_TO_TICKS(SIM_WIFI_CONNECT_MS));
+    return ESP_OK;
+}
+
+static void wifi_reset_cb(void* arg)
+{
+    ESP_LOGW("app_reset", "Wi-Fi reset requested");
+}
+
+static void factory_reset_cb(void* arg)
+{
+    ESP_LOGW("app_reset", "factory reset requested");
+}
+
+esp_err_t app_reset_button_register(button_handle_t btn, uint8_t wifi_reset_timeout, 
+                                    uint8_t factory_reset_timeout)
+{
+    esp_err_t err = iot_button_add_on_release_cb(btn, wifi_reset_timeout, wifi_reset_cb, NULL);
+    if (err == ESP_OK) {
+        err = iot_button_add_on_release_cb(btn, factory_reset_timeout, factory_reset_cb, NULL);
+    }
+    return err;
+}
+
+esp_err_t ws2812_led_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t ws2812_led_set_rgb(uint32_t red, uint32_t green, uint32_t blue)
+{
+    led_rgb = ((red & 0xff) << 16) | ((green & 0xff) << 8) | (blue & 0xff);
+    return ESP_OK;
+}
+
+uint32_t sim_led_rgb(void)
+{
+    return led_rgb;
+}
@@ -0,0 +1,138 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file queue.c
+ * @brief Host mock of the FreeRTOS queues, on the primitives of sim.c.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_kernel.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+struct sim_queue {
+    uint8_t* items;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    int receivers;      ///< Address of the wait of the receivers.
+    int senders;        ///< Address of the wait of the senders.
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct sim_queue* queue = calloc(1, sizeof(struct sim_queue));
+    if (!queue) {
+        return NULL;
+    }
+
+    queue->items = calloc(length, item_size);
+    if (!queue->items) {
+        free(queue);
+        return NULL;
+    }
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    free(queue->items);
+    free(queue);
+}
+
+/**
+ * @brief Copies an item to the tail, the queue must have room.
+ */
+static bool queue_put(QueueHandle_t queue, const void* item)
+{
+    UBaseType_t tail = (queue->head + queue->count) % queue->length;
+    memcpy(&queue->items[tail * queue->item_size], item, queue->item_size);
+    queue->count++;
+    return sim_wake(&queue->receivers);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks)
+{
+    uint64_t deadline = sim_deadline(ticks);
+
+    while (queue->count == queue->length) {
+        if ((ticks == 0) || !sim_block(&queue->senders, deadline)) {
+            return errQUEUE_FULL;
+        }
+    }
+
+    queue_put(queue, item);
+    return pdPASS;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* woken)
+{
+    if (queue->count == queue->length) {
+        return errQUEUE_FULL;
+    }
+
+    if (queue_put(queue, item) && woken) {
+        *woken = pdTRUE;
+    }
+    return pdPASS;
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void* item)
+{
+    if (queue->count == queue->length) {
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+    }
+
+    queue_put(queue, item);
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks)
+{
+    uint64_t deadline = sim_deadline(ticks);
+
+    while (queue->count == 0) {
+        if ((ticks == 0) || !sim_block(&queue->receivers, deadline)) {
+            return pdFALSE;
+        }
+    }
+
+    memcpy(item, &queue->items[queue->head * queue->item_size], queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    sim_wake(&queue->senders);
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    return queue->count;
+}
@@ -0,0 +1,478 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file rmaker.c
+ * @brief Host mock of the RainMaker core and standard devices. The params 
+ *        keep their value and count the reports, and the cloud writes of 
+ *        sim_rmaker_write() are queued to a task that calls the write 
+ *        callback of the device, like the work queue of RainMaker.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "sim_kernel.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_rmaker_core.h"
+#include "esp_rmaker_schedule.h"
+#include "esp_rmaker_standard_types.h"
+#include "esp_rmaker_standard_params.h"
+#include "esp_rmaker_standard_devices.h"
+
+#include "esp_log.h"
+static const char* TAG = "esp_rmaker";
+
+#define RMAKER_NAME_LEN         32
+#define RMAKER_WRITE_QUEUE_LEN  8
+
+struct esp_rmaker_param {
+    char name[RMAKER_NAME_LEN];
+    char type[RMAKER_NAME_LEN];
+    uint8_t properties;
+    esp_rmaker_param_val_t val;
+    esp_rmaker_param_val_t min;
+    esp_rmaker_param_val_t max;
+    bool bounds;
+    uint32_t reports;
+    struct esp_rmaker_device* device;
+    struct esp_rmaker_param* next;
+};
+
+struct esp_rmaker_device {
+    char name[RMAKER_NAME_LEN];
+    char type[RMAKER_NAME_LEN];
+    void* priv_data;
+    esp_rmaker_device_write_cb_t write_cb;
+    struct esp_rmaker_param* params;
+    struct esp_rmaker_param* primary;
+    struct esp_rmaker_device* next;
+};
+
+struct esp_rmaker_node {
+    char name[RMAKER_NAME_LEN];
+    struct esp_rmaker_device* devices;
+};
+
+typedef struct {
+    esp_rmaker_device_t* device;
+    esp_rmaker_param_t* param;
+    esp_rmaker_param_val_t val;
+} rmaker_write_t;
+
+static esp_rmaker_node_t* node;
+static QueueHandle_t write_queue;
+static esp_err_t report_error = ESP_OK;
+
+esp_rmaker_param_val_t esp_rmaker_bool(bool val)
+{
+    return (esp_rmaker_param_val_t){ .type = RMAKER_VAL_TYPE_BOOLEAN, .val.b = val };
+}
+
+esp_rmaker_param_val_t esp_rmaker_int(int val)
+{
+    return (esp_rmaker_param_val_t){ .type = RMAKER_VAL_TYPE_INTEGER, .val.i = val };
+}
+
+esp_rmaker_param_val_t esp_rmaker_float(float val)
+{
+    return (esp_rmaker_param_val_t){ .type = RMAKER_VAL_TYPE_FLOAT, .val.f = val };
+}
+
+esp_rmaker_param_val_t esp_rmaker_str(const char* val)
+{
+    return (esp_rmaker_param_val_t){ .type = RMAKER_VAL_TYPE_STRING, .val.s = (char*)val };
+}
+
+/**
+ * @brief Copies a value, the strings are owned by the param.
+ */
+static void param_set_val(esp_rmaker_param_t* param, esp_rmaker_param_val_t val)
+{
+    if (param->val.type == RMAKER_VAL_TYPE_STRING) {
+        free(param->val.val.s);
+    }
+    if ((val.type == RMAKER_VAL_TYPE_STRING) && val.val.s) {
+        val.val.s = strdup(val.val.s);
+    }
+    param->val = val;
+}
+
+esp_rmaker_node_t* esp_rmaker_node_init(const esp_rmaker_config_t* config, const char* name, const char* type)
+{
+    if (node) {
+        return NULL;
+    }
+    node = calloc(1, sizeof(esp_rmaker_node_t));
+    if (node) {
+        strncpy(node->name, name, RMAKER_NAME_LEN - 1);
+    }
+    return node;
+}
+
+esp_err_t esp_rmaker_node_add_device(const esp_rmaker_node_t* n, const esp_rmaker_device_t* device)
+{
+    esp_rmaker_node_t* target = (esp_rmaker_node_t*)n;
+    esp_rmaker_device_t* dev = (esp_rmaker_device_t*)device;
+
+    if (!target || !dev) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_rmaker_device_t** link = &target->devices;
+    while (*link) {
+        if (strcmp((*link)->name, dev->name) == 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        link = &(*link)->next;
+    }
+    *link = dev;
+    return ESP_OK;
+}
+
+/**
+ * @brief RainMaker task, applies the writes of the cloud in order.
+ */
+static void rmaker_task(void* arg)
+{
+    rmaker_write_t write;
+
+    while (true) {
+        if (xQueueReceive(write_queue, &write, portMAX_DELAY) == pdTRUE) {
+            esp_rmaker_write_ctx_t ctx = { .src = ESP_RMAKER_REQ_SRC_CLOUD };
+            if (write.device->write_cb) {
+                write.device->write_cb(write.device, write.param, write.val, 
+                                       write.device->priv_data, &ctx);
+            }
+        }
+    }
+}
+
+esp_err_t esp_rmaker_start(void)
+{
+    if (!node || write_queue) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    write_queue = xQueueCreate(RMAKER_WRITE_QUEUE_LEN, sizeof(rmaker_write_t));
+    if (!write_queue) {
+        return ESP_ERR_NO_MEM;
+    }
+    sim_task_create(rmaker_task, "esp_rmaker", NULL, SIM_RMAKER_PRIORITY);
+    return ESP_OK;
+}
+
+esp_err_t esp_rmaker_schedule_enable(void)
+{
+    return ESP_OK;
+}
+
+esp_rmaker_device_t* esp_rmaker_device_create(const char* name, const char* type, void* priv_data)
+{
+    esp_rmaker_device_t* device = calloc(1, sizeof(esp_rmaker_device_t));
+    if (!device) {
+        return NULL;
+    }
+    strncpy(device->name, name, RMAKER_NAME_LEN - 1);
+    if (type) {
+        strncpy(device->type, type, RMAKER_NAME_LEN - 1);
+    }
+    device->priv_data = priv_data;
+    return device;
+}
+
+esp_err_t esp_rmaker_device_add_cb(const esp_rmaker_device_t* device, esp_rmaker_device_write_cb_t write_cb, 
+                                   void* read_cb)
+{
+    if (!device) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ((esp_rmaker_device_t*)device)->write_cb = write_cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_rmaker_device_add_param(const esp_rmaker_device_t* device, const esp_rmaker_param_t* param)
+{
+    esp_rmaker_device_t* dev = (esp_rmaker_device_t*)device;
+    esp_rmaker_param_t* p = (esp_rmaker_param_t*)param;
+
+    if (!dev || !p || p->device) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_rmaker_param_t** link = &dev->params;
+    while (*link) {
+        if (strcmp((*link)->name, p->name) == 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        link = &(*link)->next;
+    }
+    *link = p;
+    p->device = dev;
+    return ESP_OK;
+}
+
+esp_err_t esp_rmaker_device_assign_primary_param(const esp_rmaker_device_t* device, const esp_rmaker_param_t* param)
+{
+    if (!device || !param) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ((esp_rmaker_device_t*)device)->primary = (esp_rmaker_param_t*)param;
+    return ESP_OK;
+}
+
+esp_rmaker_param_t* esp_rmaker_device_get_param_by_type(const esp_rmaker_device_t* device, const char* type)
+{
+    if (!device || !type) {
+        return NULL;
+    }
+    for (esp_rmaker_param_t* param = device->params; param; param = param->next) {
+        if (strcmp(param->type, type) == 0) {
+            return param;
+        }
+    }
+    return NULL;
+}
+
+esp_rmaker_param_t* esp_rmaker_device_get_param_by_name(const esp_rmaker_device_t* device, const char* name)
+{
+    if (!device || !name) {
+        return NULL;
+    }
+    for (esp_rmaker_param_t* param = device->params; param; param = param->next) {
+        if (strcmp(param->name, name) == 0) {
+            return param;
+        }
+    }
+    return NULL;
+}
+
+char* esp_rmaker_device_get_name(const esp_rmaker_device_t* device)
+{
+    return device ? (char*)device->name : NULL;
+}
+
+const char* esp_rmaker_device_cb_src_to_str(esp_rmaker_req_src_t src)
+{
+    switch (src) {
+    case ESP_RMAKER_REQ_SRC_INIT:
+        return "Init";
+    case ESP_RMAKER_REQ_SRC_CLOUD:
+        return "Cloud";
+    case ESP_RMAKER_REQ_SRC_SCHEDULE:
+        return "Schedule";
+    case ESP_RMAKER_REQ_SRC_LOCAL:
+        return "Local";
+    default:
+        return NULL;
+    }
+}
+
+esp_rmaker_param_t* esp_rmaker_param_create(const char* name, const char* type, 
+                                            esp_rmaker_param_val_t val, uint8_t properties)
+{
+    esp_rmaker_param_t* param = calloc(1, sizeof(esp_rmaker_param_t));
+    if (!param) {
+        return NULL;
+    }
+    strncpy(param->name, name, RMAKER_NAME_LEN - 1);
+    if (type) {
+        strncpy(param->type, type, RMAKER_NAME_LEN - 1);
+    }
+    param->properties = properties;
+    param_set_val(param, val);
+    return param;
+}
+
+esp_err_t esp_rmaker_param_add_ui_type(const esp_rmaker_param_t* param, const char* ui_type)
+{
+    return param ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_rmaker_param_add_bounds(const esp_rmaker_param_t* param, esp_rmaker_param_val_t min, 
+                                      esp_rmaker_param_val_t max, esp_rmaker_param_val_t step)
+{
+    esp_rmaker_param_t* p = (esp_rmaker_param_t*)param;
+    if (!p) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    p->min = min;
+    p->max = max;
+    p->bounds = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_rmaker_param_update(const esp_rmaker_param_t* param, esp_rmaker_param_val_t val)
+{
+    if (!param) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (val.type != param->val.type) {
+        ESP_LOGE(TAG, "%s: type %d does not match %d", param->name, val.type, param->val.type);
+        return ESP_ERR_INVALID_ARG;
+    }
+    param_set_val((esp_rmaker_param_t*)param, val);
+    return ESP_OK;
+}
+
+esp_err_t esp_rmaker_param_report(const esp_rmaker_param_t* param)
+{
+    if (!param) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (report_error != ESP_OK) {
+        return report_error;
+    }
+    ((esp_rmaker_param_t*)param)->reports++;
+    return ESP_OK;
+}
+
+esp_err_t esp_rmaker_param_update_and_report(const esp_rmaker_param_t* param, esp_rmaker_param_val_t val)
+{
+    esp_err_t err = esp_rmaker_param_update(param, val);
+    if (err == ESP_OK) {
+        err = esp_rmaker_param_report(param);
+    }
+    return err;
+}
+
+esp_rmaker_param_val_t* esp_rmaker_param_get_val(esp_rmaker_param_t* param)
+{
+    return param ? &param->val : NULL;
+}
+
+char* esp_rmaker_param_get_name(const esp_rmaker_param_t* param)
+{
+    return param ? (char*)param->name : NULL;
+}
+
+esp_rmaker_param_t* esp_rmaker_name_param_create(const char* param_name, const char* val)
+{
+    return esp_rmaker_param_create(param_name, ESP_RMAKER_PARAM_NAME, esp_rmaker_str(val), 
+                                   PROP_FLAG_READ | PROP_FLAG_WRITE | PROP_FLAG_PERSIST);
+}
+
+esp_rmaker_param_t* esp_rmaker_power_param_create(const char* param_name, bool val)
+{
+    esp_rmaker_param_t* param = esp_rmaker_param_create(param_name, ESP_RMAKER_PARAM_POWER, 
+                                                        esp_rmaker_bool(val), 
+                                                        PROP_FLAG_READ | PROP_FLAG_WRITE);
+    esp_rmaker_param_add_ui_type(param, ESP_RMAKER_UI_TOGGLE);
+    return param;
+}
+
+esp_rmaker_param_t* esp_rmaker_speed_param_create(const char* param_name, int val)
+{
+    esp_rmaker_param_t* param = esp_rmaker_param_create(param_name, ESP_RMAKER_PARAM_SPEED, 
+                                                        esp_rmaker_int(val), 
+                                                        PROP_FLAG_READ | PROP_FLAG_WRITE);
+    esp_rmaker_param_add_ui_type(param, ESP_RMAKER_UI_SLIDER);
+    esp_rmaker_param_add_bounds(param, esp_rmaker_int(0), esp_rmaker_int(5), esp_rmaker_int(1));
+    return param;
+}
+
+esp_rmaker_param_t* esp_rmaker_temperature_param_create(const char* param_name, float val)
+{
+    return esp_rmaker_param_create(param_name, ESP_RMAKER_PARAM_TEMPERATURE, 
+                                   esp_rmaker_float(val), PROP_FLAG_READ);
+}
+
+esp_rmaker_device_t* esp_rmaker_fan_device_create(const char* dev_name, void* priv_data, bool power)
+{
+    esp_rmaker_device_t* device = esp_rmaker_device_create(dev_name, ESP_RMAKER_DEVICE_FAN, priv_data);
+    if (device) {
+        esp_rmaker_device_add_param(device, esp_rmaker_name_param_create(ESP_RMAKER_DEF_NAME_PARAM, dev_name));
+        esp_rmaker_param_t* power_param = esp_rmaker_power_param_create(ESP_RMAKER_DEF_POWER_NAME, power);
+        esp_rmaker_device_add_param(device, power_param);
+        esp_rmaker_device_assign_primary_param(device, power_param);
+    }
+    return device;
+}
+
+esp_rmaker_device_t* esp_rmaker_temp_sensor_device_create(const char* dev_name, void* priv_data, float temperature)
+{
+    esp_rmaker_device_t* device = esp_rmaker_device_create(dev_name, ESP_RMAKER_DEVICE_TEMP_SENSOR, priv_data);
+    if (device) {
+        esp_rmaker_device_add_param(device, esp_rmaker_name_param_create(ESP_RMAKER_DEF_NAME_PARAM, dev_name));
+        esp_rmaker_param_t* temp_param = esp_rmaker_temperature_param_create(ESP_RMAKER_DEF_TEMPERATURE_NAME, 
+                                                                             temperature);
+        esp_rmaker_device_add_param(device, temp_param);
+        esp_rmaker_device_assign_primary_param(device, temp_param);
+    }
+    return device;
+}
+
+esp_rmaker_param_t* sim_rmaker_param(const char* device, const char* param)
+{
+    if (!node) {
+        return NULL;
+    }
+    for (esp_rmaker_device_t* dev = node->devices; dev; dev = dev->next) {
+        if (strcmp(dev->name, device) == 0) {
+            return esp_rmaker_device_get_param_by_name(dev, param);
+        }
+    }
+    return NULL;
+}
+
+esp_err_t sim_rmaker_write(const char* device, const char* param, esp_rmaker_param_val_t val)
+{
+    if (!write_queue) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_rmaker_param_t* p = sim_rmaker_param(device, param);
+    if (!p) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    rmaker_write_t write = { .device = p->device, .param = p, .val = val };
+    return (xQueueSend(write_queue, &write, 0) == pdTRUE) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+uint32_t sim_rmaker_reports(const esp_rmaker_param_t* param)
+{
+    return param ? param->reports : 0;
+}
+
+uint32_t sim_rmaker_device_reports(const char* device)
+{
+    uint32_t reports = 0;
+
+    for (esp_rmaker_device_t* dev = node ? node->devices : NULL; dev; dev = dev->next) {
+        if (strcmp(dev->name, device) == 0) {
+            for (esp_rmaker_param_t* p = dev->params; p; p = p->next) {
+                reports += p->reports;
+            }
+        }
+    }
+    return reports;
+}
+
+void sim_rmaker_set_report_error(esp_err_t err)
+{
+    report_error = err;
+}
@@ -0,0 +1,510 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file sim.c
+ * @brief Deterministic scheduler of the host simulation. The FreeRTOS tasks 
+ *        run as coroutines (ucontext) on a virtual clock of CPU cycles: the 
+ *        highest priority ready task runs until it blocks, and a task that 
+ *        wakes one of higher priority yields to it, so the order of the 
+ *        events is the one of the preemptive kernel. When every task is 
+ *        blocked, the clock jumps to the next timeout.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <ucontext.h>
+
+#include "sim.h"
+#include "sim_kernel.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define SIM_STACK_MIN       (128 * 1024)    /* The host frames are larger than the RISC-V ones */
+#define SIM_STACK_FILL      0xA5            /* Pattern of the high water mark, as FreeRTOS */
+#define SIM_CYCLES_PER_TICK (SIM_CPU_FREQ_HZ / configTICK_RATE_HZ)
+
+typedef enum {
+    SIM_TASK_READY,
+    SIM_TASK_RUNNING,
+    SIM_TASK_BLOCKED,
+    SIM_TASK_DELETED,
+} sim_task_state_t;
+
+struct sim_task {
+    char name[configMAX_TASK_NAME_LEN];
+    UBaseType_t priority;
+    sim_task_state_t state;
+    ucontext_t context;
+    uint8_t* stack;
+    size_t stack_size;
+    TaskFunction_t fn;
+    void* arg;
+    const void* wait_obj;           ///< Object of the wait, NULL for a sleep.
+    uint64_t deadline;              ///< Cycle of the timeout of the wait.
+    bool timed_out;
+    uint32_t notify;                ///< Value of the task notification.
+    uint64_t order;                 ///< FIFO order among the ready tasks of a priority.
+    struct sim_task* next;
+};
+
+static struct sim_task* tasks;
+static struct sim_task* current;
+static struct sim_task* last_run;
+static ucontext_t scheduler_context;
+static uint64_t now;
+static uint64_t order;
+static int isr_nesting;
+static int critical_nesting;
+static bool yield_pending;
+static bool stopped;
+
+uint64_t sim_cycles(void)
+{
+    return now;
+}
+
+int64_t sim_time_us(void)
+{
+    return (int64_t)(now / SIM_CYCLES_PER_US);
+}
+
+bool sim_in_isr(void)
+{
+    return isr_nesting > 0;
+}
+
+uint64_t sim_deadline(TickType_t ticks)
+{
+    if (ticks == portMAX_DELAY) {
+        return SIM_FOREVER;
+    }
+    return now + (uint64_t)ticks * SIM_CYCLES_PER_TICK;
+}
+
+/**
+ * @brief Moves a task to the end of the ready tasks of its priority.
+ */
+static void sim_make_ready(struct sim_task* task)
+{
+    task->state = SIM_TASK_READY;
+    task->wait_obj = NULL;
+    task->order = ++order;
+}
+
+/**
+ * @brief Switches from the running task back to the scheduler.
+ */
+static void sim_switch_out(void)
+{
+    struct sim_task* task = current;
+    swapcontext(&task->context, &scheduler_context);
+}
+
+/**
+ * @brief Yields the CPU, the running task stays ready.
+ */
+static void sim_yield(void)
+{
+    if (!current) {
+        return;
+    }
+    yield_pending = false;
+    sim_make_ready(current);
+    sim_switch_out();
+}
+
+/**
+ * @brief Wakes the tasks whose timeout expired.
+ */
+static void sim_wake_expired(void)
+{
+    for (struct sim_task* task = tasks; task; task = task->next) {
+        if ((task->state == SIM_TASK_BLOCKED) && (task->deadline <= now)) {
+            task->timed_out = true;
+            sim_make_ready(task);
+        }
+    }
+}
+
+/**
+ * @brief Highest priority ready task, the oldest one of the priority.
+ */
+static struct sim_task* sim_pick(void)
+{
+    struct sim_task* best = NULL;
+
+    for (struct sim_task* task = tasks; task; task = task->next) {
+        if (task->state != SIM_TASK_READY) {
+            continue;
+        }
+        if (!best || (task->priority > best->priority) || 
+            ((task->priority == best->priority) && (task->order < best->order))) {
+            best = task;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Earliest timeout of the blocked tasks.
+ */
+static uint64_t sim_next_deadline(void)
+{
+    uint64_t deadline = SIM_FOREVER;
+
+    for (struct sim_task* task = tasks; task; task = task->next) {
+        if ((task->state == SIM_TASK_BLOCKED) && (task->deadline < deadline)) {
+            deadline = task->deadline;
+        }
+    }
+    return deadline;
+}
+
+/**
+ * @brief True if a task of higher priority than the running one is ready.
+ */
+static bool sim_preempted(void)
+{
+    sim_wake_expired();
+    struct sim_task* best = sim_pick();
+    return best && current && (best->priority > current->priority);
+}
+
+/**
+ * @brief Frees the tasks deleted, never the running one.
+ */
+static void sim_reap(void)
+{
+    struct sim_task** link = &tasks;
+
+    while (*link) {
+        struct sim_task* task = *link;
+        if ((task->state == SIM_TASK_DELETED) && (task != current)) {
+            *link = task->next;
+            if (last_run == task) {
+                last_run = NULL;
+            }
+            free(task->stack);
+            free(task);
+        } else {
+            link = &task->next;
+        }
+    }
+}
+
+void sim_run(void)
+{
+    stopped = false;
+
+    while (!stopped) {
+        sim_wake_expired();
+        struct sim_task* task = sim_pick();
+
+        if (!task) {
+            uint64_t deadline = sim_next_deadline();
+            if (deadline == SIM_FOREVER) {
+                break;
+            }
+            now = deadline;
+            continue;
+        }
+
+        if (task != last_run) {
+            now += SIM_SWITCH_CYCLES;
+            last_run = task;
+        }
+        task->state = SIM_TASK_RUNNING;
+        current = task;
+        swapcontext(&scheduler_context, &task->context);
+        current = NULL;
+        sim_reap();
+    }
+}
+
+void sim_stop(void)
+{
+    stopped = true;
+    if (current && !sim_in_isr()) {
+        sim_yield();
+    }
+}
+
+bool sim_block(const void* obj, uint64_t deadline)
+{
+    struct sim_task* task = current;
+
+    assert(task && "blocking outside of a task");
+    assert(!sim_in_isr() && "blocking in an ISR");
+    assert((critical_nesting == 0) && "blocking in a critical section");
+
+    task->state = SIM_TASK_BLOCKED;
+    task->wait_obj = obj;
+    task->deadline = deadline;
+    task->timed_out = false;
+    sim_switch_out();
+
+    return !task->timed_out;
+}
+
+bool sim_wake(const void* obj)
+{
+    struct sim_task* woken = NULL;
+
+    for (struct sim_task* task = tasks; task; task = task->next) {
+        if ((task->state == SIM_TASK_BLOCKED) && obj && (task->wait_obj == obj)) {
+            if (!woken || (task->priority > woken->priority) || 
+                ((task->priority == woken->priority) && (task->order < woken->order))) {
+                woken = task;
+            }
+        }
+    }
+
+    if (!woken) {
+        return false;
+    }
+
+    woken->timed_out = false;
+    sim_make_ready(woken);
+
+    if (!current || (woken->priority <= current->priority)) {
+        return false;
+    }
+
+    if (sim_in_isr() || (critical_nesting > 0)) {
+        yield_pending = true;
+    } else {
+        sim_yield();
+    }
+    return true;
+}
+
+void sim_set_deadline(TaskHandle_t task, const void* obj, uint64_t deadline)
+{
+    if (task && (task->state == SIM_TASK_BLOCKED) && (task->wait_obj == obj)) {
+        task->deadline = deadline;
+    }
+}
+
+void sim_consume(uint64_t cycles)
+{
+    now += cycles;
+    if (current && !sim_in_isr() && (critical_nesting == 0) && sim_preempted()) {
+        sim_yield();
+    }
+}
+
+void sim_sleep_us(uint64_t us)
+{
+    sim_block(NULL, now + us * SIM_CYCLES_PER_US);
+}
+
+void sim_run_isr(void (*isr)(void*), void* arg)
+{
+    now += SIM_ISR_ENTRY_CYCLES;
+    isr_nesting++;
+    isr(arg);
+    isr_nesting--;
+
+    if ((isr_nesting == 0) && (critical_nesting == 0) && yield_pending) {
+        sim_yield();
+    }
+}
+
+/**
+ * @brief First function of every task, a task that returns is deleted.
+ */
+static void sim_task_entry(void)
+{
+    struct sim_task* task = current;
+    task->fn(task->arg);
+    vTaskDelete(NULL);
+}
+
+TaskHandle_t sim_task_create(TaskFunction_t fn, const char* name, void* arg, UBaseType_t priority)
+{
+    TaskHandle_t handle = NULL;
+    xTaskCreate(fn, name, 0, arg, priority, &handle);
+    return handle;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char* name, uint32_t stack_depth, 
+                       void* arg, UBaseType_t priority, TaskHandle_t* handle)
+{
+    struct sim_task* task = calloc(1, sizeof(struct sim_task));
+    if (!task) {
+        return pdFAIL;
+    }
+
+    task->stack_size = (stack_depth > SIM_STACK_MIN) ? stack_depth : SIM_STACK_MIN;
+    task->stack = malloc(task->stack_size);
+    if (!task->stack) {
+        free(task);
+        return pdFAIL;
+    }
+    memset(task->stack, SIM_STACK_FILL, task->stack_size);
+
+    strncpy(task->name, name ? name : "", sizeof(task->name) - 1);
+    task->priority = (priority < configMAX_PRIORITIES) ? priority : configMAX_PRIORITIES - 1;
+    task->fn = fn;
+    task->arg = arg;
+
+    getcontext(&task->context);
+    task->context.uc_stack.ss_sp = task->stack;
+    task->context.uc_stack.ss_size = task->stack_size;
+    task->context.uc_link = NULL;
+    makecontext(&task->context, sim_task_entry, 0);
+
+    // Appended, so the scan order follows the creation order.
+    struct sim_task** link = &tasks;
+    while (*link) {
+        link = &(*link)->next;
+    }
+    *link = task;
+    sim_make_ready(task);
+
+    if (handle) {
+        *handle = task;
+    }
+
+    // A task of higher priority starts at once, as in FreeRTOS.
+    if (current && !sim_in_isr() && (critical_nesting == 0) && 
+        (task->priority > current->priority)) {
+        sim_yield();
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (!task) {
+        task = current;
+    }
+    task->state = SIM_TASK_DELETED;
+
+    if (task == current) {
+        sim_switch_out();
+        abort();    /* Never resumed */
+    }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    if (ticks == 0) {
+        sim_yield();
+        return;
+    }
+    sim_block(NULL, sim_deadline(ticks));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return current;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(now / SIM_CYCLES_PER_TICK);
+}
+
+char* pcTaskGetName(TaskHandle_t task)
+{
+    if (!task) {
+        task = current;
+    }
+    return task ? task->name : "";
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    if (!task) {
+        task = current;
+    }
+    if (!task) {
+        return 0;
+    }
+
+    // The stack grows down, the untouched pattern is at the bottom.
+    size_t free_bytes = 0;
+    while ((free_bytes < task->stack_size) && (task->stack[free_bytes] == SIM_STACK_FILL)) {
+        free_bytes++;
+    }
+    return (UBaseType_t)free_bytes;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    task->notify++;
+    sim_wake(&task->notify);
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* woken)
+{
+    task->notify++;
+    bool higher = sim_wake(&task->notify);
+    if (woken && higher) {
+        *woken = pdTRUE;
+    }
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+    struct sim_task* task = current;
+    uint64_t deadline = sim_deadline(ticks);
+
+    while (task->notify == 0) {
+        if ((ticks == 0) || !sim_block(&task->notify, deadline)) {
+            return 0;
+        }
+    }
+
+    uint32_t value = task->notify;
+    task->notify = clear ? 0 : value - 1;
+    return value;
+}
+
+void vPortEnterCritical(portMUX_TYPE* mux)
+{
+    (void)mux;
+    critical_nesting++;
+}
+
+void vPortExitCritical(portMUX_TYPE* mux)
+{
+    (void)mux;
+    assert(critical_nesting > 0);
+    critical_nesting--;
+
+    if ((critical_nesting == 0) && !sim_in_isr() && yield_pending) {
+        sim_yield();
+    }
+}
+
+BaseType_t xPortInIsrContext(void)
+{
+    return sim_in_isr() ? pdTRUE : pdFALSE;
+}
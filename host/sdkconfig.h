@@ -0,0 +1,222 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file sdkconfig.h
+ * @brief Configuration of the host build: the defaults of Kconfig.projbuild, 
+ *        plus the latency and the trace that are measured by the scenarios. 
+ *        Every option can be overridden with -D to build a variant, the 
+ *        choices are selected by defining the alternative.
+ */
+#pragma once
+
+#define CONFIG_IDF_TARGET_ESP32C3 1
+
+#if !CONFIG_ROT_ENC_BACKEND_TIMER
+#define CONFIG_ROT_ENC_BACKEND_TABLE 1
+#endif
+
+#if !CONFIG_THERMISTOR_ADC_CONTINUOUS
+#define CONFIG_THERMISTOR_ADC_ONESHOT 1
+#endif
+
+#if !CONFIG_ADC_CHANNEL_1 && !CONFIG_ADC_CHANNEL_3 && !CONFIG_ADC_CHANNEL_4
+#define CONFIG_ADC_CHANNEL_2 1
+#endif
+
+#ifndef CONFIG_ROT_ENC_CLK_GPIO
+#define CONFIG_ROT_ENC_CLK_GPIO 0
+#endif
+
+#ifndef CONFIG_ROT_ENC_DTA_GPIO
+#define CONFIG_ROT_ENC_DTA_GPIO 1
+#endif
+
+#ifndef CONFIG_ROT_ENC_DEBOUNCE
+#define CONFIG_ROT_ENC_DEBOUNCE 1000
+#endif
+
+#ifndef CONFIG_ROT_ENC_BUTTON_GPIO
+#define CONFIG_ROT_ENC_BUTTON_GPIO 10
+#endif
+
+#ifndef CONFIG_ROT_ENC_ACCEL_MAX_STEPS
+#define CONFIG_ROT_ENC_ACCEL_MAX_STEPS 4
+#endif
+
+#ifndef CONFIG_ROT_ENC_ACCEL_MIN_RATE
+#define CONFIG_ROT_ENC_ACCEL_MIN_RATE 15
+#endif
+
+#ifndef CONFIG_ROT_ENC_ACCEL_MAX_RATE
+#define CONFIG_ROT_ENC_ACCEL_MAX_RATE 60
+#endif
+
+#ifndef CONFIG_ROT_ENC_EVENT_DEPTH
+#define CONFIG_ROT_ENC_EVENT_DEPTH 16
+#endif
+
+#ifndef CONFIG_THERMISTOR_SERIE_RESISTANCE
+#define CONFIG_THERMISTOR_SERIE_RESISTANCE 164000
+#endif
+
+#ifndef CONFIG_THERMISTOR_NOMINAL_RESISTANCE
+#define CONFIG_THERMISTOR_NOMINAL_RESISTANCE 100000
+#endif
+
+#ifndef CONFIG_THERMISTOR_NOMINAL_TEMPERATURE
+#define CONFIG_THERMISTOR_NOMINAL_TEMPERATURE 25
+#endif
+
+#ifndef CONFIG_THERMISTOR_BETA_VALUE
+#define CONFIG_THERMISTOR_BETA_VALUE 4250
+#endif
+
+#ifndef CONFIG_THERMISTOR_VOLTAGE_SOURCE
+#define CONFIG_THERMISTOR_VOLTAGE_SOURCE 3330
+#endif
+
+#ifndef CONFIG_THERMISTOR_LUT_STEP
+#define CONFIG_THERMISTOR_LUT_STEP 16
+#endif
+
+#ifndef CONFIG_THERMISTOR_DECIMATION_BITS
+#define CONFIG_THERMISTOR_DECIMATION_BITS 2
+#endif
+
+#ifndef CONFIG_THERMISTOR_FILTER
+#define CONFIG_THERMISTOR_FILTER 1
+#endif
+
+#ifndef CONFIG_THERMISTOR_FILTER_SAMPLES
+#define CONFIG_THERMISTOR_FILTER_SAMPLES 16
+#endif
+
+#ifndef CONFIG_THERMISTOR_FILTER_MEDIAN
+#define CONFIG_THERMISTOR_FILTER_MEDIAN 5
+#endif
+
+#ifndef CONFIG_THERMISTOR_FILTER_EMA_SHIFT
+#define CONFIG_THERMISTOR_FILTER_EMA_SHIFT 1
+#endif
+
+#ifndef CONFIG_THERMISTOR_FILTER_OUTLIER
+#define CONFIG_THERMISTOR_FILTER_OUTLIER 40
+#endif
+
+#ifndef CONFIG_THERMISTOR_FILTER_MAX_REJECTS
+#define CONFIG_THERMISTOR_FILTER_MAX_REJECTS 2
+#endif
+
+#ifndef CONFIG_TEMPERATURE_MIN_PERIOD
+#define CONFIG_TEMPERATURE_MIN_PERIOD 5
+#endif
+
+#ifndef CONFIG_TEMPERATURE_MAX_PERIOD
+#define CONFIG_TEMPERATURE_MAX_PERIOD 60
+#endif
+
+#ifndef CONFIG_TEMPERATURE_REPORT_DEADBAND
+#define CONFIG_TEMPERATURE_REPORT_DEADBAND 3
+#endif
+
+#ifndef CONFIG_TEMPERATURE_REPORT_HEARTBEAT
+#define CONFIG_TEMPERATURE_REPORT_HEARTBEAT 900
+#endif
+
+#ifndef CONFIG_REPORT_COALESCE_MS
+#define CONFIG_REPORT_COALESCE_MS 500
+#endif
+
+#ifndef CONFIG_STATE_SAVE_QUIET_PERIOD
+#define CONFIG_STATE_SAVE_QUIET_PERIOD 10
+#endif
+
+#ifndef CONFIG_APP_FAST_BOOT
+#define CONFIG_APP_FAST_BOOT 1
+#endif
+
+#ifndef CONFIG_APP_LATENCY
+#define CONFIG_APP_LATENCY 1
+#endif
+
+#ifndef CONFIG_APP_LATENCY_REPORT_PERIOD
+#define CONFIG_APP_LATENCY_REPORT_PERIOD 30
+#endif
+
+#ifndef CONFIG_APP_WRITE_LOG
+#define CONFIG_APP_WRITE_LOG 1
+#endif
+
+#ifndef CONFIG_APP_METRICS_PERIOD
+#define CONFIG_APP_METRICS_PERIOD 300
+#endif
+
+#ifndef CONFIG_APP_METRICS_DEVICE
+#define CONFIG_APP_METRICS_DEVICE 1
+#endif
+
+#ifndef CONFIG_APP_METRICS_GAUGE_THRESHOLD
+#define CONFIG_APP_METRICS_GAUGE_THRESHOLD 10
+#endif
+
+#ifndef CONFIG_TRACE_ENABLE
+#define CONFIG_TRACE_ENABLE 1
+#endif
+
+#ifndef CONFIG_TRACE_RECORDS
+#define CONFIG_TRACE_RECORDS 512
+#endif
+
+#ifndef CONFIG_RELAY_SPEED_CAP_LOW_GPIO
+#define CONFIG_RELAY_SPEED_CAP_LOW_GPIO 7
+#endif
+
+#ifndef CONFIG_RELAY_SPEED_CAP_HIGH_GPIO
+#define CONFIG_RELAY_SPEED_CAP_HIGH_GPIO 6
+#endif
+
+#ifndef CONFIG_RELAY_SPEED_DIRECT_GPIO
+#define CONFIG_RELAY_SPEED_DIRECT_GPIO 5
+#endif
+
+#ifndef CONFIG_RELAY_LIGHT_GPIO
+#define CONFIG_RELAY_LIGHT_GPIO 4
+#endif
+
+#ifndef CONFIG_RELAY_BREAK_BEFORE_MAKE_MS
+#define CONFIG_RELAY_BREAK_BEFORE_MAKE_MS 50
+#endif
+
+#ifndef CONFIG_RELAY_SETTLE_MS
+#define CONFIG_RELAY_SETTLE_MS 300
+#endif
+
+#ifndef CONFIG_RELAY_ZERO_CROSS_GPIO
+#define CONFIG_RELAY_ZERO_CROSS_GPIO -1
+#endif
+
+#ifndef CONFIG_ESP_MAIN_TASK_STACK_SIZE
+#define CONFIG_ESP_MAIN_TASK_STACK_SIZE 3584
+#endif
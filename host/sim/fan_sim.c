@@ -0,0 +1,578 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file fan_sim.c
+ * @brief Scenario runner of the host simulation: boots the firmware on the 
+ *        mocked IDF and applies a script of inputs and checks, one command 
+ *        per line. The exit status is not zero when a check fails.
+ *
+ * Commands (times in milliseconds, '#' starts a comment):
+ *   log <none|error|warn|info|debug>       level of the firmware logs
+ *   snapshot <power> <speed> <light>       RTC snapshot of a soft reset
+ *   nvs-state <power> <speed> <light>      state saved in NVS before the boot
+ *   temperature <celsius>                  ambient of the thermistor
+ *   adc <channel> <raw>                    raw code of an ADC channel
+ *   uncalibrated                           chip without the ADC calibration
+ *   boot                                   runs app_main in the main task
+ *   wait <ms>                              lets the firmware run
+ *   encoder <cw|ccw> <detents> <period_ms> [bounces]
+ *   button tap | button hold <seconds>
+ *   cloud <device> <param> <value>         write of the cloud
+ *   report-error <on|off>                  makes the reports fail
+ *   work-stall <ms>                        blocks the worker and fills its queue
+ *   heap <bytes>                           free heap of the chip
+ *   expect relays <speed>                  outputs of the speed relays
+ *   expect light <0|1>                     output of the light relay
+ *   expect param <device> <param> <value> [tolerance]
+ *   expect reports <device> <param> [>=|<=]<n>
+ *   expect device-reports <device> [>=|<=]<n>    reports of all its params
+ *   expect nvs-writes [>=|<=]<n>
+ *   expect latency <stage> <count|p50|p99|max> [>=|<=]<n>    times in microseconds
+ *   dump <latency|metrics|trace>
+ *
+ * Stages of the latency: encoder, cloud, enc-isr, enc-task, control, 
+ * relay-settle, relay-switch, report.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <sdkconfig.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+#include <nvs_flash.h>
+
+#include "sim.h"
+#include "sim_kernel.h"
+#include "trace.h"
+#include "app_priv.h"
+
+#define SCENARIO_PRIORITY   24      /* Above every task, it only runs between the waits */
+#define MAX_LINE            256
+#define MAX_ARGS            8
+#define BOUNCE_US           40      /* Period of the contact bounces of the encoder */
+
+#define ENCODER_CLK_GPIO    CONFIG_ROT_ENC_CLK_GPIO
+#define ENCODER_DTA_GPIO    CONFIG_ROT_ENC_DTA_GPIO
+#define BUTTON_GPIO         CONFIG_ROT_ENC_BUTTON_GPIO
+
+#define BIT_CAP_LOW         (1UL << CONFIG_RELAY_SPEED_CAP_LOW_GPIO)
+#define BIT_CAP_HIGH        (1UL << CONFIG_RELAY_SPEED_CAP_HIGH_GPIO)
+#define BIT_DIRECT          (1UL << CONFIG_RELAY_SPEED_DIRECT_GPIO)
+#define BIT_LIGHT           (1UL << CONFIG_RELAY_LIGHT_GPIO)
+
+#if CONFIG_ACTIVATE_RELAY_LOW
+#define RELAY_ACTIVE        0
+#else
+#define RELAY_ACTIVE        1
+#endif
+
+#if CONFIG_ADC_CHANNEL_1
+#define THERMISTOR_CHANNEL  ADC_CHANNEL_1
+#elif CONFIG_ADC_CHANNEL_3
+#define THERMISTOR_CHANNEL  ADC_CHANNEL_3
+#elif CONFIG_ADC_CHANNEL_4
+#define THERMISTOR_CHANNEL  ADC_CHANNEL_4
+#else
+#define THERMISTOR_CHANNEL  ADC_CHANNEL_2
+#endif
+
+void app_main(void);
+
+/**
+ * @brief Relays closed by each speed, written again from the wiring of the
+ *        fan so the check does not share the table of app_relay.c.
+ */
+static const uint32_t speed_outputs[] = {
+    0,
+    BIT_CAP_LOW,
+    BIT_CAP_HIGH,
+    BIT_CAP_LOW | BIT_CAP_HIGH,
+    BIT_DIRECT,
+    BIT_DIRECT,
+};
+
+static const char* const latency_keys[APP_LATENCY_MAX] = {
+    [APP_LATENCY_ENCODER]      = "encoder",
+    [APP_LATENCY_CLOUD]        = "cloud",
+    [APP_LATENCY_ENC_ISR]      = "enc-isr",
+    [APP_LATENCY_ENC_TASK]     = "enc-task",
+    [APP_LATENCY_CONTROL]      = "control",
+    [APP_LATENCY_RELAY_SETTLE] = "relay-settle",
+    [APP_LATENCY_RELAY_SWITCH] = "relay-switch",
+    [APP_LATENCY_REPORT]       = "report",
+};
+
+static FILE* script;
+static const char* script_name;
+static int line_number;
+static int failures;
+
+/**
+ * @brief Reports a failed check or a bad command.
+ */
+static void fail(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+static void fail(const char* fmt, ...)
+{
+    va_list args;
+
+    fprintf(stderr, "%s:%d: ", script_name, line_number);
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+    failures++;
+}
+
+/**
+ * @brief Raw code of the thermistor divider at a temperature, the inverse 
+ *        of the beta model (the thermistor to GND, the serie resistor to 
+ *        the source).
+ */
+static int thermistor_raw(float celsius)
+{
+    const double t0 = CONFIG_THERMISTOR_NOMINAL_TEMPERATURE + 273.15;
+    double rt = CONFIG_THERMISTOR_NOMINAL_RESISTANCE * 
+                exp(CONFIG_THERMISTOR_BETA_VALUE * (1.0 / (celsius + 273.15) - 1.0 / t0));
+    double vout = CONFIG_THERMISTOR_VOLTAGE_SOURCE * rt / (rt + CONFIG_THERMISTOR_SERIE_RESISTANCE);
+    return (int)lround(vout * 4095.0 / SIM_ADC_FULL_SCALE_MV);
+}
+
+/**
+ * @brief Parses "<n>", ">=<n>" or "<=<n>" and compares a value.
+ */
+static bool compare(const char* expr, long value, char* op_out)
+{
+    char op = '=';
+    if (!strncmp(expr, ">=", 2) || !strncmp(expr, "<=", 2)) {
+        op = expr[0];
+        expr += 2;
+    }
+    long expected = strtol(expr, NULL, 0);
+    if (op_out) {
+        *op_out = op;
+    }
+    return (op == '>') ? (value >= expected) : 
+           (op == '<') ? (value <= expected) : (value == expected);
+}
+
+static bool parse_bool(const char* s)
+{
+    return !strcmp(s, "1") || !strcmp(s, "true") || !strcmp(s, "on");
+}
+
+/**
+ * @brief Parses a value with the type of the current value of a param.
+ */
+static esp_rmaker_param_val_t parse_val(esp_rmaker_param_t* param, const char* s)
+{
+    switch (esp_rmaker_param_get_val(param)->type) {
+    case RMAKER_VAL_TYPE_BOOLEAN:
+        return esp_rmaker_bool(parse_bool(s));
+    case RMAKER_VAL_TYPE_INTEGER:
+        return esp_rmaker_int(atoi(s));
+    case RMAKER_VAL_TYPE_FLOAT:
+        return esp_rmaker_float(strtof(s, NULL));
+    default:
+        return esp_rmaker_str(s);
+    }
+}
+
+/**
+ * @brief Moves a pin of the encoder, with the bounces of the contact before
+ *        the stable level.
+ */
+/**
+ * @brief Formats a value of a param.
+ */
+static const char* val_to_str(const esp_rmaker_param_val_t* val, char* text, size_t size)
+{
+    switch (val->type) {
+    case RMAKER_VAL_TYPE_BOOLEAN:
+        return val->val.b ? "true" : "false";
+    case RMAKER_VAL_TYPE_INTEGER:
+        snprintf(text, size, "%d", val->val.i);
+        return text;
+    case RMAKER_VAL_TYPE_FLOAT:
+        snprintf(text, size, "%.2f", val->val.f);
+        return text;
+    default:
+        return "?";
+    }
+}
+
+/**
+ * @brief Main task of the IDF, deleted when app_main returns.
+ */
+static void app_main_task(void* arg)
+{
+    app_main();
+    vTaskDelete(NULL);
+}
+
+static void encoder_edge(gpio_num_t pin, int level, int bounces, uint32_t gap_us)
+{
+    for (int b = 0; b < bounces; b++) {
+        sim_gpio_input(pin, level);
+        sim_sleep_us(BOUNCE_US / 2);
+        sim_gpio_input(pin, !level);
+        sim_sleep_us(BOUNCE_US / 2);
+    }
+    sim_gpio_input(pin, level);
+    sim_sleep_us(gap_us);
+}
+
+/**
+ * @brief Turns the encoder a number of detents, a detent is the full cycle
+ *        of the quadrature: 3 -> 1 -> 0 -> 2 -> 3 clockwise.
+ */
+static void encoder_turn(bool cw, int detents, uint32_t period_ms, int bounces)
+{
+    gpio_num_t first = cw ? ENCODER_CLK_GPIO : ENCODER_DTA_GPIO;
+    gpio_num_t second = cw ? ENCODER_DTA_GPIO : ENCODER_CLK_GPIO;
+    uint32_t gap_us = (period_ms * 1000) / 4;
+
+    for (int d = 0; d < detents; d++) {
+        encoder_edge(first, 0, bounces, gap_us);
+        encoder_edge(second, 0, bounces, gap_us);
+        encoder_edge(first, 1, bounces, gap_us);
+        encoder_edge(second, 1, bounces, gap_us);
+    }
+}
+
+static void cmd_state(bool snapshot, char** argv)
+{
+    app_state_t state;
+    memset(&state, 0, sizeof(state));
+    state.power = parse_bool(argv[1]);
+    state.speed = atoi(argv[2]);
+    state.light = parse_bool(argv[3]);
+    state.temp_enable = DEFAULT_THERMOSTAT_ENABLE;
+    state.temp_level = DEFAULT_THERMOSTAT_TEMPERATURE;
+
+    if (snapshot) {
+        app_boot_snapshot_save(&state);
+        return;
+    }
+
+    nvs_handle_t handle;
+    if ((nvs_flash_init() != ESP_OK) || 
+        (nvs_open("app_state", NVS_READWRITE, &handle) != ESP_OK)) {
+        fail("nvs not available");
+        return;
+    }
+    nvs_set_blob(handle, "fan", &state, sizeof(state));
+    nvs_commit(handle);
+    nvs_close(handle);
+}
+
+/**
+ * @brief Work item that keeps the worker task busy.
+ */
+static void work_stall(void* arg)
+{
+    vTaskDelay(pdMS_TO_TICKS((uintptr_t)arg));
+}
+
+static void work_nothing(void* arg)
+{
+}
+
+/**
+ * @brief Blocks the worker and fills its queue, the posts of the firmware 
+ *        are lost until the worker runs again.
+ */
+static void cmd_work_stall(uint32_t ms)
+{
+    app_work_post(work_stall, (void*)(uintptr_t)ms);
+    sim_sleep_us(1000);
+    while (app_work_post(work_nothing, NULL) == ESP_OK) {
+    }
+}
+
+/**
+ * @brief Prints the histogram of every stage with samples, one line by 
+ *        bucket with the range in microseconds.
+ */
+static void dump_latency(void)
+{
+    static app_latency_hist_t hist;
+
+    for (int path = 0; path < APP_LATENCY_MAX; path++) {
+        if ((app_latency_get(path, &hist) != ESP_OK) || (hist.count == 0)) {
+            continue;
+        }
+        printf("%-12s %-20s n=%u min %.1f med %.1f p99 %.1f max %.1f mean %.1f uS\n", 
+               latency_keys[path], app_latency_name(path), (unsigned)hist.count, 
+               (double)hist.min / SIM_CYCLES_PER_US, 
+               (double)app_latency_percentile(&hist, 500) / SIM_CYCLES_PER_US, 
+               (double)app_latency_percentile(&hist, 990) / SIM_CYCLES_PER_US, 
+               (double)hist.max / SIM_CYCLES_PER_US, 
+               (double)hist.sum / hist.count / SIM_CYCLES_PER_US);
+
+        uint32_t peak = 0;
+        for (int i = 0; i < APP_LATENCY_BUCKETS; i++) {
+            peak = (hist.buckets[i] > peak) ? hist.buckets[i] : peak;
+        }
+        for (int i = 0; i < APP_LATENCY_BUCKETS; i++) {
+            if (hist.buckets[i] == 0) {
+                continue;
+            }
+            uint32_t low = i ? app_latency_bucket_limit(i - 1) + 1 : 0;
+            int bar = (int)((hist.buckets[i] * 40ULL + peak - 1) / peak);
+            printf("    %10.1f - %10.1f %6u %.*s\n", 
+                   (double)low / SIM_CYCLES_PER_US, 
+                   (double)app_latency_bucket_limit(i) / SIM_CYCLES_PER_US, 
+                   (unsigned)hist.buckets[i], bar, 
+                   "########################################");
+        }
+    }
+}
+
+/**
+ * @brief Checks a statistic of the histogram of a stage.
+ */
+static void expect_latency(const char* stage, const char* stat, const char* expr)
+{
+    static app_latency_hist_t hist;
+    int path = 0;
+    char op;
+
+    while ((path < APP_LATENCY_MAX) && strcmp(stage, latency_keys[path])) {
+        path++;
+    }
+    if ((path == APP_LATENCY_MAX) || (app_latency_get(path, &hist) != ESP_OK)) {
+        fail("no latency stage %s", stage);
+        return;
+    }
+
+    long value;
+    if (!strcmp(stat, "count")) {
+        value = hist.count;
+    } else if (!strcmp(stat, "p50") || !strcmp(stat, "p99")) {
+        value = app_latency_percentile(&hist, (stat[1] == '5') ? 500 : 990) / SIM_CYCLES_PER_US;
+    } else if (!strcmp(stat, "max")) {
+        value = hist.max / SIM_CYCLES_PER_US;
+    } else {
+        fail("bad latency statistic %s", stat);
+        return;
+    }
+
+    if (!compare(expr, value, &op)) {
+        fail("latency %s %s is %ld, expected %s", stage, stat, value, expr);
+    }
+}
+
+static void cmd_expect(int argc, char** argv)
+{
+    char op;
+
+    if (!strcmp(argv[1], "relays") && (argc == 3)) {
+        int speed = atoi(argv[2]);
+        if ((speed < 0) || (speed > MAX_CELING_SPEED)) {
+            fail("bad speed %d", speed);
+            return;
+        }
+        uint32_t mask = BIT_CAP_LOW | BIT_CAP_HIGH | BIT_DIRECT;
+        uint32_t expected = RELAY_ACTIVE ? speed_outputs[speed] : (~speed_outputs[speed] & mask);
+        uint32_t output = sim_gpio_output() & mask;
+        if (output != expected) {
+            fail("relays 0x%08x, expected 0x%08x (speed %d)", 
+                 (unsigned)output, (unsigned)expected, speed);
+        }
+    } else if (!strcmp(argv[1], "light") && (argc == 3)) {
+        bool on = ((sim_gpio_output() & BIT_LIGHT) != 0) == RELAY_ACTIVE;
+        if (on != parse_bool(argv[2])) {
+            fail("light %s, expected %s", on ? "on" : "off", argv[2]);
+        }
+    } else if (!strcmp(argv[1], "param") && (argc >= 5)) {
+        esp_rmaker_param_t* param = sim_rmaker_param(argv[2], argv[3]);
+        if (!param) {
+            fail("no param %s.%s", argv[2], argv[3]);
+            return;
+        }
+        esp_rmaker_param_val_t* val = esp_rmaker_param_get_val(param);
+        esp_rmaker_param_val_t expected = parse_val(param, argv[4]);
+        float tolerance = (argc > 5) ? strtof(argv[5], NULL) : 0.01f;
+        bool ok = (val->type == RMAKER_VAL_TYPE_BOOLEAN) ? (val->val.b == expected.val.b) :
+                  (val->type == RMAKER_VAL_TYPE_INTEGER) ? (val->val.i == expected.val.i) :
+                  (val->type == RMAKER_VAL_TYPE_FLOAT) ? (fabsf(val->val.f - expected.val.f) <= tolerance) :
+                  false;
+        if (!ok) {
+            char text[32];
+            fail("param %s.%s is %s, expected %s", argv[2], argv[3], 
+                 val_to_str(val, text, sizeof(text)), argv[4]);
+        }
+    } else if (!strcmp(argv[1], "reports") && (argc == 5)) {
+        esp_rmaker_param_t* param = sim_rmaker_param(argv[2], argv[3]);
+        if (!param) {
+            fail("no param %s.%s", argv[2], argv[3]);
+            return;
+        }
+        uint32_t reports = sim_rmaker_reports(param);
+        if (!compare(argv[4], reports, &op)) {
+            fail("%u reports of %s.%s, expected %s", (unsigned)reports, argv[2], argv[3], argv[4]);
+        }
+    } else if (!strcmp(argv[1], "device-reports") && (argc == 4)) {
+        uint32_t reports = sim_rmaker_device_reports(argv[2]);
+        if (!compare(argv[3], reports, &op)) {
+            fail("%u reports of %s, expected %s", (unsigned)reports, argv[2], argv[3]);
+        }
+    } else if (!strcmp(argv[1], "latency") && (argc == 5)) {
+        expect_latency(argv[2], argv[3], argv[4]);
+    } else if (!strcmp(argv[1], "nvs-writes") && (argc == 3)) {
+        uint32_t writes = sim_nvs_writes();
+        if (!compare(argv[2], writes, &op)) {
+            fail("%u nvs writes, expected %s", (unsigned)writes, argv[2]);
+        }
+    } else {
+        fail("bad expect");
+    }
+}
+
+/**
+ * @brief Runs a command of the script.
+ */
+static void run_command(int argc, char** argv)
+{
+    const char* cmd = argv[0];
+
+    if (!strcmp(cmd, "log") && (argc == 2)) {
+        static const char* levels[] = { "none", "error", "warn", "info", "debug" };
+        for (int l = 0; l < 5; l++) {
+            if (!strcmp(argv[1], levels[l])) {
+                esp_log_level_set("*", (esp_log_level_t)l);
+                return;
+            }
+        }
+        fail("bad level %s", argv[1]);
+    } else if ((!strcmp(cmd, "snapshot") || !strcmp(cmd, "nvs-state")) && (argc == 4)) {
+        cmd_state(cmd[0] == 's', argv);
+    } else if (!strcmp(cmd, "temperature") && (argc == 2)) {
+        sim_adc_set_raw(THERMISTOR_CHANNEL, thermistor_raw(strtof(argv[1], NULL)));
+    } else if (!strcmp(cmd, "adc") && (argc == 3)) {
+        sim_adc_set_raw(atoi(argv[1]), atoi(argv[2]));
+    } else if (!strcmp(cmd, "uncalibrated") && (argc == 1)) {
+        sim_adc_set_calibrated(false);
+    } else if (!strcmp(cmd, "boot") && (argc == 1)) {
+        sim_task_create(app_main_task, "main", NULL, 1);
+    } else if (!strcmp(cmd, "wait") && (argc == 2)) {
+        sim_sleep_us(strtoull(argv[1], NULL, 0) * 1000);
+    } else if (!strcmp(cmd, "encoder") && ((argc == 4) || (argc == 5))) {
+        encoder_turn(!strcmp(argv[1], "cw"), atoi(argv[2]), atoi(argv[3]), 
+                     (argc == 5) ? atoi(argv[4]) : 0);
+    } else if (!strcmp(cmd, "button") && (argc >= 2)) {
+        if (!strcmp(argv[1], "tap")) {
+            sim_button_tap(BUTTON_GPIO);
+        } else if (!strcmp(argv[1], "hold") && (argc == 3)) {
+            sim_button_hold(BUTTON_GPIO, atoi(argv[2]));
+        } else {
+            fail("bad button");
+        }
+    } else if (!strcmp(cmd, "cloud") && (argc == 4)) {
+        esp_rmaker_param_t* param = sim_rmaker_param(argv[1], argv[2]);
+        if (!param || (sim_rmaker_write(argv[1], argv[2], parse_val(param, argv[3])) != ESP_OK)) {
+            fail("write of %s.%s not accepted", argv[1], argv[2]);
+        }
+    } else if (!strcmp(cmd, "heap") && (argc == 2)) {
+        sim_heap_set(strtoul(argv[1], NULL, 0));
+    } else if (!strcmp(cmd, "report-error") && (argc == 2)) {
+        sim_rmaker_set_report_error(parse_bool(argv[1]) ? ESP_FAIL : ESP_OK);
+    } else if (!strcmp(cmd, "work-stall") && (argc == 2)) {
+        cmd_work_stall(strtoul(argv[1], NULL, 0));
+    } else if (!strcmp(cmd, "expect") && (argc >= 3)) {
+        cmd_expect(argc, argv);
+    } else if (!strcmp(cmd, "dump") && (argc == 2)) {
+        if (!strcmp(argv[1], "latency")) {
+            dump_latency();
+        } else if (!strcmp(argv[1], "metrics")) {
+            app_metrics_report();
+        } else if (!strcmp(argv[1], "trace")) {
+            trace_dump();
+        } else {
+            fail("bad dump");
+        }
+    } else {
+        fail("unknown command %s", cmd);
+    }
+}
+
+/**
+ * @brief Task of the script, it runs above the firmware so the inputs are 
+ *        applied at the exact time, and the firmware only runs in the waits.
+ */
+static void scenario_task(void* arg)
+{
+    char line[MAX_LINE];
+
+    while (fgets(line, sizeof(line), script)) {
+        line_number++;
+
+        char* comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+
+        char* argv[MAX_ARGS];
+        int argc = 0;
+        for (char* tok = strtok(line, " \t\r\n"); tok && (argc < MAX_ARGS); tok = strtok(NULL, " \t\r\n")) {
+            argv[argc++] = tok;
+        }
+        if (argc) {
+            run_command(argc, argv);
+        }
+    }
+
+    sim_stop();
+    vTaskDelete(NULL);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <scenario>\n", argv[0]);
+        return 2;
+    }
+
+    script_name = argv[1];
+    script = fopen(script_name, "r");
+    if (!script) {
+        perror(script_name);
+        return 2;
+    }
+
+    // The thermistor reads the nominal temperature until the script sets it.
+    sim_adc_set_raw(THERMISTOR_CHANNEL, thermistor_raw(CONFIG_THERMISTOR_NOMINAL_TEMPERATURE));
+    sim_task_create(scenario_task, "scenario", NULL, SCENARIO_PRIORITY);
+    sim_run();
+    fclose(script);
+
+    printf("%s: %d failure(s) at %lld ms\n", script_name, failures, (long long)(sim_time_us() / 1000));
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,91 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file test.c
+ * @brief Support of the host tests.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+
+#include "sim.h"
+#include "sim_kernel.h"
+#include "test.h"
+
+#define TEST_TASK_PRIORITY  1   /* As the main task of the IDF */
+
+static int failures;
+static void (*test_body)(void);
+
+bool test_check(bool ok, const char* file, int line, const char* fmt, ...)
+{
+    if (!ok) {
+        va_list args;
+
+        fprintf(stderr, "%s:%d: ", file, line);
+        va_start(args, fmt);
+        vfprintf(stderr, fmt, args);
+        va_end(args);
+        fputc('\n', stderr);
+        failures++;
+    }
+    return ok;
+}
+
+/**
+ * @brief Task of the test.
+ */
+static void test_task(void* arg)
+{
+    test_body();
+    sim_stop();
+    vTaskDelete(NULL);
+}
+
+int test_run(const char* name, void (*body)(void))
+{
+    // The firmware logs only the problems, the tests print the results.
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    test_body = body;
+    sim_task_create(test_task, name, NULL, TEST_TASK_PRIORITY);
+    sim_run();
+
+    printf("%s: %d failure(s)\n", name, failures);
+    return failures ? 1 : 0;
+}
+
+uint64_t test_host_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
@@ -0,0 +1,64 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file test.h
+ * @brief Support of the host tests: checks that count the failures, and 
+ *        a runner that executes the body of a test in a task of the 
+ *        simulation, so the code under test can use timers and queues.
+ */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Checks a condition, prints the message when it fails.
+ */
+#define TEST_CHECK(cond, ...)   test_check((cond), __FILE__, __LINE__, __VA_ARGS__)
+
+/**
+ * @brief Records the result of a check.
+ * @param ok Result of the check.
+ * @param file Source of the check.
+ * @param line Line of the check.
+ * @param fmt Message printed when it fails.
+ * @return The result.
+ */
+bool test_check(bool ok, const char* file, int line, const char* fmt, ...) 
+    __attribute__((format(printf, 4, 5)));
+
+/**
+ * @brief Runs the body of a test in a task of priority 1, until it returns.
+ * @param name Name of the test, printed with the result.
+ * @param body Body of the test.
+ * @return Exit status of the test program, 0 when every check passed.
+ */
+int test_run(const char* name, void (*body)(void));
+
+/**
+ * @brief Time of the host, to measure the cost of the code under test.
+ * @return Nanoseconds of a monotonic clock.
+ */
+uint64_t test_host_ns(void);
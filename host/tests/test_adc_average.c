@@ -0,0 +1,188 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file test_adc_average.c
+ * @brief Compares the integer average of the thermistor driver with the 
+ *        Kahan sum in double it replaced, on the same bursts of 64 samples: 
+ *        the error of the integer average must never be larger, and the 
+ *        host time of both loops is printed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <sdkconfig.h>
+
+#include "sim.h"
+#include "test.h"
+#include "thermistor.h"
+
+#define SAMPLES             64      /* Burst of a reading without the filter */
+#define BURSTS              2000
+#define NOISE_CODES         24      /* Peak to peak noise of the ADC */
+#define CHANNEL             ADC_CHANNEL_2
+
+static uint16_t burst[SAMPLES];
+static uint32_t burst_idx;
+static uint32_t lcg = 12345;
+
+static uint32_t rand_next(void)
+{
+    lcg = lcg * 1664525u + 1013904223u;
+    return lcg >> 8;
+}
+
+/**
+ * @brief Source of the ADC mock, replays the burst.
+ */
+static int burst_source(adc_channel_t channel, void* ctx)
+{
+    return burst[burst_idx++ % SAMPLES];
+}
+
+/**
+ * @brief The reading before the change: Kahan sum in double and a 
+ *        truncating average.
+ */
+static uint32_t kahan_read_vout(thermistor_handle_t* th)
+{
+    double sum = 0, c = 0, y, t;
+    int adc_raw;
+    int voltage = 0;
+    int i;
+
+    for (i = 0; i < SAMPLES; i++) {
+        adc_oneshot_read(th->bus->adc_h, th->channel, &adc_raw);
+        y = adc_raw - c;
+        t = sum + y;
+        c = (t - sum) - y;
+        sum = t;
+    }
+    adc_raw = (int)(sum / i);
+    adc_cali_raw_to_voltage(th->bus->adc_cali_h, adc_raw, &voltage);
+    return voltage;
+}
+
+/**
+ * @brief Only the reads of a burst, the cost of the ADC mock.
+ */
+static void read_burst(thermistor_handle_t* th)
+{
+    int adc_raw;
+
+    for (int i = 0; i < SAMPLES; i++) {
+        adc_oneshot_read(th->bus->adc_h, th->channel, &adc_raw);
+    }
+}
+
+/**
+ * @brief mV of the exact mean of the burst, with the linear calibration of 
+ *        the mock without rounding.
+ */
+static double exact_mv(void)
+{
+    uint32_t sum = 0;
+    for (int i = 0; i < SAMPLES; i++) {
+        sum += burst[i];
+    }
+    return (sum / (double)SAMPLES) * SIM_ADC_FULL_SCALE_MV / 4095.0;
+}
+
+static void test_adc_average(void)
+{
+    thermistor_bus_t bus;
+    thermistor_handle_t th;
+
+    TEST_CHECK(thermistor_bus_init(&bus, ADC_UNIT_1, THERMISTOR_MODE_ONESHOT) == ESP_OK, "bus");
+    TEST_CHECK(thermistor_bus_add(&bus, &th, CHANNEL, CONFIG_THERMISTOR_SERIE_RESISTANCE, 
+                                  CONFIG_THERMISTOR_NOMINAL_RESISTANCE, 
+                                  CONFIG_THERMISTOR_NOMINAL_TEMPERATURE, 
+                                  CONFIG_THERMISTOR_BETA_VALUE, 
+                                  CONFIG_THERMISTOR_VOLTAGE_SOURCE, 0) == ESP_OK, "add");
+    sim_adc_set_source(CHANNEL, burst_source, NULL);
+
+    double error_kahan = 0;
+    double error_int = 0;
+    double error_dec = 0;
+    uint32_t identical = 0;
+    uint64_t ns_kahan = 0;
+    uint64_t ns_int = 0;
+    uint64_t ns_reads = 0;
+
+    for (int b = 0; b < BURSTS; b++) {
+        uint32_t center = NOISE_CODES + (rand_next() % (4095 - 2 * NOISE_CODES));
+        for (int i = 0; i < SAMPLES; i++) {
+            burst[i] = center - (NOISE_CODES / 2) + (rand_next() % NOISE_CODES);
+        }
+        double exact = exact_mv();
+
+        burst_idx = 0;
+        uint64_t start = test_host_ns();
+        uint32_t kahan = kahan_read_vout(&th);
+        ns_kahan += test_host_ns() - start;
+
+        thermistor_set_decimation(&th, 0);
+        burst_idx = 0;
+        start = test_host_ns();
+        uint32_t integer = thermistor_read_vout(&th);
+        ns_int += test_host_ns() - start;
+
+        burst_idx = 0;
+        start = test_host_ns();
+        read_burst(&th);
+        ns_reads += test_host_ns() - start;
+
+        thermistor_set_decimation(&th, CONFIG_THERMISTOR_DECIMATION_BITS);
+        burst_idx = 0;
+        uint32_t decimated = thermistor_read_vout(&th);
+
+        // Rounding instead of truncating moves the average at most one code.
+        TEST_CHECK(abs((int)integer - (int)kahan) <= 1,
+                   "burst %d: integer %u mV, kahan %u mV", b, (unsigned)integer, (unsigned)kahan);
+        identical += (integer == kahan);
+        error_kahan += fabs(kahan - exact);
+        error_int += fabs(integer - exact);
+        error_dec += fabs(decimated - exact);
+    }
+
+    printf("mean error: kahan %.3f mV, integer %.3f mV, integer with %d bits %.3f mV\n", 
+           error_kahan / BURSTS, error_int / BURSTS, CONFIG_THERMISTOR_DECIMATION_BITS, 
+           error_dec / BURSTS);
+    printf("identical results %u of %u, the others are rounded instead of truncated\n", 
+           (unsigned)identical, BURSTS);
+    TEST_CHECK(error_int <= error_kahan, "the integer average is less accurate");
+
+    // The host has a FPU, on the C3 each double add is a soft-float call.
+    double reads = (double)ns_reads / BURSTS;
+    printf("host time of a reading less the ADC mock: kahan %.0f ns, integer %.0f ns\n", 
+           (double)ns_kahan / BURSTS - reads, (double)ns_int / BURSTS - reads);
+}
+
+int main(void)
+{
+    return test_run("adc_average", test_adc_average);
+}
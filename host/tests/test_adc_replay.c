@@ -0,0 +1,215 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file test_adc_replay.c
+ * @brief Replays a raw ADC trace of the thermistor through the reading of the
+ *        driver, with the filter of menuconfig and without it (the plain 
+ *        average of 64 samples), and prints the noise of the temperatures 
+ *        and the cost of a reading. The trace is one raw code per line, 
+ *        generated by tools/adc_trace_gen.py or captured on the board.
+ *
+ *   test_adc_replay host/data/adc_wifi_bursts.csv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <sdkconfig.h>
+
+#include "sim.h"
+#include "test.h"
+#include "thermistor.h"
+
+#define WINDOW              64      /* Samples of the trace for each reading */
+#define MAX_TRACE           (WINDOW * 1024)
+#define PLAIN_CHANNEL       ADC_CHANNEL_2
+#define FILTER_CHANNEL      ADC_CHANNEL_3
+
+/**
+ * @brief Result of the readings of a configuration.
+ */
+typedef struct {
+    const char* name;
+    thermistor_handle_t th;
+    uint32_t pos;           ///< Next sample of the trace.
+    double sum;
+    double sum_sq;
+    double max_error;
+    int64_t adc_us;         ///< Virtual time of the ADC.
+    uint64_t host_ns;       ///< Host time of the readings.
+} replay_t;
+
+static const char* trace_path;
+static uint16_t trace[MAX_TRACE];
+static uint32_t trace_len;
+static float trace_celsius = NAN;
+static replay_t plain = { .name = "64-sample mean" };
+static replay_t filtered = { .name = "filter" };
+
+/**
+ * @brief Loads the trace, the lines with '#' are comments.
+ */
+static bool trace_load(const char* path)
+{
+    char line[128];
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), f) && (trace_len < MAX_TRACE)) {
+        float celsius;
+        if (line[0] == '#') {
+            if (sscanf(line, "# celsius %f", &celsius) == 1) {
+                trace_celsius = celsius;
+            }
+        } else if (line[0] != '\n') {
+            trace[trace_len++] = atoi(line);
+        }
+    }
+    fclose(f);
+    return trace_len >= WINDOW;
+}
+
+/**
+ * @brief Source of the ADC mock, each channel reads the trace from its 
+ *        position.
+ */
+static int trace_source(adc_channel_t channel, void* ctx)
+{
+    replay_t* replay = ctx;
+    return trace[replay->pos++ % trace_len];
+}
+
+static esp_err_t replay_add(thermistor_bus_t* bus, replay_t* replay, adc_channel_t channel)
+{
+    sim_adc_set_source(channel, trace_source, replay);
+    return thermistor_bus_add(bus, &replay->th, channel, CONFIG_THERMISTOR_SERIE_RESISTANCE, 
+                              CONFIG_THERMISTOR_NOMINAL_RESISTANCE, 
+                              CONFIG_THERMISTOR_NOMINAL_TEMPERATURE, 
+                              CONFIG_THERMISTOR_BETA_VALUE, 
+                              CONFIG_THERMISTOR_VOLTAGE_SOURCE, 
+                              CONFIG_THERMISTOR_LUT_STEP);
+}
+
+/**
+ * @brief Reads the window of the trace that starts at a sample.
+ */
+static void replay_read(replay_t* replay, uint32_t start)
+{
+    replay->pos = start;
+
+    int64_t us = sim_time_us();
+    uint64_t ns = test_host_ns();
+    float celsius = thermistor_get_celsius(&replay->th);
+    replay->host_ns += test_host_ns() - ns;
+    replay->adc_us += sim_time_us() - us;
+
+    double error = celsius - trace_celsius;
+    replay->sum += celsius;
+    replay->sum_sq += celsius * celsius;
+    if (fabs(error) > replay->max_error) {
+        replay->max_error = fabs(error);
+    }
+}
+
+static double replay_sd(const replay_t* replay, uint32_t readings)
+{
+    double mean = replay->sum / readings;
+    return sqrt(fmax(0, replay->sum_sq / readings - mean * mean));
+}
+
+static void replay_print(const replay_t* replay, uint32_t readings)
+{
+    double mean = replay->sum / readings;
+    double sd = replay_sd(replay, readings);
+
+    printf("%-15s mean %.3f C, sd %.4f C, max error %.3f C, ADC %lld us, host %.0f ns per reading\n", 
+           replay->name, mean, sd, replay->max_error, 
+           (long long)(replay->adc_us / readings), (double)replay->host_ns / readings);
+}
+
+static void test_adc_replay(void)
+{
+    thermistor_bus_t bus;
+
+    if (!TEST_CHECK(trace_load(trace_path), "could not load %s", trace_path)) {
+        return;
+    }
+
+    TEST_CHECK(thermistor_bus_init(&bus, ADC_UNIT_1, THERMISTOR_MODE_ONESHOT) == ESP_OK, "bus");
+    TEST_CHECK(replay_add(&bus, &plain, PLAIN_CHANNEL) == ESP_OK, "plain");
+    TEST_CHECK(replay_add(&bus, &filtered, FILTER_CHANNEL) == ESP_OK, "filtered");
+    thermistor_set_decimation(&plain.th, CONFIG_THERMISTOR_DECIMATION_BITS);
+    thermistor_set_decimation(&filtered.th, CONFIG_THERMISTOR_DECIMATION_BITS);
+
+    thermistor_filter_config_t filter_conf = {
+        .samples = CONFIG_THERMISTOR_FILTER_SAMPLES,
+        .median_len = CONFIG_THERMISTOR_FILTER_MEDIAN,
+        .ema_shift = CONFIG_THERMISTOR_FILTER_EMA_SHIFT,
+        .max_rejects = CONFIG_THERMISTOR_FILTER_MAX_REJECTS,
+        .outlier_gate = CONFIG_THERMISTOR_FILTER_OUTLIER,
+    };
+    TEST_CHECK(thermistor_set_filter(&filtered.th, &filter_conf) == ESP_OK, "filter");
+
+    // Without the real temperature, the plain mean of the trace is the reference.
+    if (isnan(trace_celsius)) {
+        uint64_t sum = 0;
+        for (uint32_t i = 0; i < trace_len; i++) {
+            sum += trace[i];
+        }
+        uint32_t mv = (uint32_t)((sum * SIM_ADC_FULL_SCALE_MV) / (trace_len * 4095ULL));
+        trace_celsius = thermistor_vout_to_celsius(&plain.th, mv);
+    }
+
+    uint32_t readings = trace_len / WINDOW;
+    for (uint32_t r = 0; r < readings; r++) {
+        replay_read(&plain, r * WINDOW);
+        replay_read(&filtered, r * WINDOW);
+    }
+
+    printf("%s: %u samples, %u readings, %.2f C\n", 
+           trace_path, (unsigned)trace_len, (unsigned)readings, trace_celsius);
+    replay_print(&plain, readings);
+    replay_print(&filtered, readings);
+
+    TEST_CHECK(replay_sd(&filtered, readings) <= replay_sd(&plain, readings), 
+               "the filter is noisier than the plain mean");
+    TEST_CHECK(filtered.max_error <= plain.max_error, 
+               "the filter lets through a larger error than the plain mean");
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <trace.csv>\n", argv[0]);
+        return 2;
+    }
+    trace_path = argv[1];
+    return test_run("adc_replay", test_adc_replay);
+}
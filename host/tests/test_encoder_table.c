@@ -0,0 +1,224 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file test_encoder_table.c
+ * @brief Replays clean and bouncy quadrature sequences through the table 
+ *        decoder in the GPIO ISR: the final position must be exact at every
+ *        resolution, and a clean sequence must give one event per step. It 
+ *        also prints the host cost of the handler per edge, and checks that
+ *        the steps of the events dropped by a full ring reach the consumer.
+ */
+
+#include <stdio.h>
+
+#include <sdkconfig.h>
+#include <driver/gpio.h>
+
+#include "sim.h"
+#include "test.h"
+#include "rotary_encoder.h"
+
+#define CLK_GPIO            CONFIG_ROT_ENC_CLK_GPIO
+#define DTA_GPIO            CONFIG_ROT_ENC_DTA_GPIO
+
+#define DETENTS             50
+#define EDGE_GAP_US         2000    /* 8 ms per detent, slower than the acceleration */
+#define BOUNCE_US           40
+#define MAX_BOUNCES         3
+#define COST_EDGES          (1 << 20)
+#define RING_DEPTH          4
+
+static rotenc_handle_t encoder;
+static uint32_t events;
+static int32_t position;
+
+static void on_event(rotenc_event_t event)
+{
+    events++;
+    position = event.position;
+}
+
+static void IRAM_ATTR empty_isr(void* arg)
+{
+}
+
+/**
+ * @brief Moves a pin to a level, after chattering between both levels.
+ * @return Edges driven.
+ */
+static uint32_t edge(gpio_num_t pin, int level, int bounces)
+{
+    for (int b = 0; b < bounces; b++) {
+        sim_gpio_input(pin, level);
+        sim_sleep_us(BOUNCE_US / 2);
+        sim_gpio_input(pin, !level);
+        sim_sleep_us(BOUNCE_US / 2);
+    }
+    sim_gpio_input(pin, level);
+    sim_sleep_us(EDGE_GAP_US);
+    return 1 + 2 * bounces;
+}
+
+/**
+ * @brief Turns a number of detents: 3 -> 1 -> 0 -> 2 -> 3 clockwise.
+ * @return Edges driven.
+ */
+static uint32_t turn(gpio_num_t clk, gpio_num_t dta, bool cw, int detents, int bounces)
+{
+    gpio_num_t first = cw ? clk : dta;
+    gpio_num_t second = cw ? dta : clk;
+    uint32_t edges = 0;
+
+    for (int d = 0; d < detents; d++) {
+        edges += edge(first, 0, bounces);
+        edges += edge(second, 0, bounces);
+        edges += edge(first, 1, bounces);
+        edges += edge(second, 1, bounces);
+    }
+    return edges;
+}
+
+/**
+ * @brief Host time of an edge through the handler of the pins, called 
+ *        directly in a loop with the simulated interrupt disabled, and 
+ *        less the time of the same loop with an empty handler.
+ */
+static double edge_ns(gpio_num_t clk, gpio_num_t dta)
+{
+    // Clockwise edges: the pin that changes and its new level.
+    static const struct { bool clk; int level; } cycle[4] = {
+        { true, 0 }, { false, 0 }, { true, 1 }, { false, 1 },
+    };
+    void* arg;
+    gpio_isr_t isr = sim_gpio_isr(clk, &arg);
+    double ns[2];
+
+    gpio_intr_disable(clk);
+    gpio_intr_disable(dta);
+    for (int pass = 0; pass < 2; pass++) {
+        gpio_isr_t handler = pass ? isr : empty_isr;
+        uint64_t start = test_host_ns();
+        for (uint32_t i = 0; i < COST_EDGES; i++) {
+            sim_gpio_input(cycle[i & 3].clk ? clk : dta, cycle[i & 3].level);
+            handler(arg);
+        }
+        ns[pass] = (double)(test_host_ns() - start) / COST_EDGES;
+    }
+    gpio_intr_enable(clk);
+    gpio_intr_enable(dta);
+    return ns[1] - ns[0];
+}
+
+static void check_resolution(rotenc_resolution_t resolution, const char* name)
+{
+    rotenc_set_resolution(&encoder, resolution);
+
+    for (int bounces = 0; bounces <= MAX_BOUNCES; bounces++) {
+        int32_t steps = DETENTS * (ROTENC_RES_FULL / resolution);
+
+        rotenc_reset(&encoder);
+        events = 0;
+        position = 0;
+        turn(CLK_GPIO, DTA_GPIO, true, DETENTS, bounces);
+        TEST_CHECK(position == steps, "%s, %d bounces: cw position %d, expected %d", 
+                   name, bounces, (int)position, (int)steps);
+        if (bounces == 0) {
+            TEST_CHECK(events == (uint32_t)steps, "%s: %u cw events, expected %d", 
+                       name, (unsigned)events, (int)steps);
+        }
+        uint32_t cw_events = events;
+
+        turn(CLK_GPIO, DTA_GPIO, false, DETENTS, bounces);
+        TEST_CHECK(position == 0, "%s, %d bounces: ccw position %d, expected 0", 
+                   name, bounces, (int)position);
+
+        printf("%-8s bounces %d: %4u events for %3d steps\n", 
+               name, bounces, (unsigned)cw_events, (int)steps);
+    }
+
+    rotenc_reset(&encoder);
+    printf("%-8s %.1f ns per edge on the host\n", name, edge_ns(CLK_GPIO, DTA_GPIO));
+}
+
+/**
+ * @brief Sums the steps of the events pending in the ring.
+ */
+static int32_t ring_steps(void)
+{
+    rotenc_event_t pending[RING_DEPTH];
+    uint32_t count = 0;
+    int32_t steps = 0;
+
+    if (rotenc_wait_events(&encoder, pending, RING_DEPTH, &count) == ESP_OK) {
+        for (uint32_t i = 0; i < count; i++) {
+            steps += pending[i].steps;
+        }
+    }
+    return steps;
+}
+
+static void check_ring_overflow(void)
+{
+    TEST_CHECK(rotenc_init(&encoder, CLK_GPIO, DTA_GPIO, CONFIG_ROT_ENC_DEBOUNCE) == ESP_OK, "ring init");
+    TEST_CHECK(rotenc_set_event_ring(&encoder, RING_DEPTH, 0) == ESP_OK, "ring");
+
+    // Nobody consumes while it turns, the ring fills and the rest is dropped.
+    turn(CLK_GPIO, DTA_GPIO, true, DETENTS, 0);
+    int32_t steps = ring_steps();
+    TEST_CHECK(steps == RING_DEPTH, "ring: %d steps before the overflow, expected %d", 
+               (int)steps, RING_DEPTH);
+    TEST_CHECK(rotenc_get_overflows(&encoder) == DETENTS - RING_DEPTH, "ring: %u overflows, expected %d",
+               (unsigned)rotenc_get_overflows(&encoder), DETENTS - RING_DEPTH);
+
+    // The next event carries the dropped steps.
+    turn(CLK_GPIO, DTA_GPIO, true, 1, 0);
+    steps += ring_steps();
+    TEST_CHECK(steps == DETENTS + 1, "ring: %d steps in total, expected %d", 
+               (int)steps, DETENTS + 1);
+
+    printf("ring     %u overflows, %d steps delivered\n", 
+           (unsigned)rotenc_get_overflows(&encoder), (int)steps);
+    rotenc_uninit(&encoder);
+}
+
+static void test_encoder_table(void)
+{
+    TEST_CHECK(rotenc_init(&encoder, CLK_GPIO, DTA_GPIO, CONFIG_ROT_ENC_DEBOUNCE) == ESP_OK, "init");
+    TEST_CHECK(rotenc_set_event_callback(&encoder, on_event) == ESP_OK, "callback");
+
+    check_resolution(ROTENC_RES_FULL, "full");
+    check_resolution(ROTENC_RES_HALF, "half");
+    check_resolution(ROTENC_RES_QUARTER, "quarter");
+
+    rotenc_uninit(&encoder);
+
+    check_ring_overflow();
+}
+
+int main(void)
+{
+    return test_run("encoder_table", test_encoder_table);
+}
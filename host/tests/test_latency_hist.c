@@ -0,0 +1,125 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file test_latency_hist.c
+ * @brief Checks the histograms of the latency: every value falls in the 
+ *        bucket that its limits describe, and the p99 of a distribution 
+ *        with a few outliers is close to the real one instead of the max.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sdkconfig.h>
+#include <esp_err.h>
+#include <esp_rmaker_core.h>
+
+#include "test.h"
+#include "app_priv.h"
+
+#define SAMPLES         10000
+#define OUTLIERS        50          /* Half of the 1 % above the p99 */
+#define OUTLIER_CYCLES  48000000    /* 300 mS at 160 MHz, the settle window */
+
+static int cmp_u32(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Records single values and checks the bucket that got each one.
+ */
+static void check_buckets(void)
+{
+    static app_latency_hist_t before, after;
+    uint32_t values[] = { 0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 100, 1000, 65535, 65536, 
+                          1000000, 0x7fffffff, 0x80000000, 0xffffffff };
+
+    TEST_CHECK(app_latency_bucket_limit(APP_LATENCY_BUCKETS - 1) == 0xffffffff, "last limit");
+    for (uint32_t i = 1; i < APP_LATENCY_BUCKETS; i++) {
+        TEST_CHECK(app_latency_bucket_limit(i) > app_latency_bucket_limit(i - 1), 
+                   "limit %u not increasing", (unsigned)i);
+    }
+
+    for (size_t v = 0; v < sizeof(values) / sizeof(values[0]); v++) {
+        app_latency_get(APP_LATENCY_ENC_ISR, &before);
+        app_latency_record_span(APP_LATENCY_ENC_ISR, 1, 1 + values[v]);
+        app_latency_get(APP_LATENCY_ENC_ISR, &after);
+
+        uint32_t i = 0;
+        while ((i < APP_LATENCY_BUCKETS) && (after.buckets[i] == before.buckets[i])) {
+            i++;
+        }
+        uint32_t low = i ? app_latency_bucket_limit(i - 1) + 1 : 0;
+        TEST_CHECK((i < APP_LATENCY_BUCKETS) && (values[v] >= low) && 
+                   (values[v] <= app_latency_bucket_limit(i)), 
+                   "%u in bucket %u", (unsigned)values[v], (unsigned)i);
+    }
+}
+
+/**
+ * @brief Normal samples of 2 to 4 mS with a few at the settle window.
+ */
+static void check_p99(void)
+{
+    static uint32_t samples[SAMPLES];
+    static app_latency_hist_t hist;
+
+    srand(1);
+    for (int i = 0; i < SAMPLES; i++) {
+        samples[i] = (i < OUTLIERS) ? OUTLIER_CYCLES + i : 320000 + (rand() % 320000);
+        app_latency_record_span(APP_LATENCY_CONTROL, 1, 1 + samples[i]);
+    }
+    qsort(samples, SAMPLES, sizeof(samples[0]), cmp_u32);
+    TEST_CHECK(app_latency_get(APP_LATENCY_CONTROL, &hist) == ESP_OK, "get");
+
+    uint32_t exact = samples[(SAMPLES * 99 + 99) / 100 - 1];
+    uint32_t p99 = app_latency_percentile(&hist, 990);
+    uint32_t p50 = app_latency_percentile(&hist, 500);
+    printf("p50 %u (exact %u), p99 %u (exact %u), max %u cycles\n", (unsigned)p50, 
+           (unsigned)samples[SAMPLES / 2 - 1], (unsigned)p99, (unsigned)exact, (unsigned)hist.max);
+
+    TEST_CHECK(hist.count == SAMPLES, "count %u", (unsigned)hist.count);
+    TEST_CHECK((hist.min == samples[0]) && (hist.max == samples[SAMPLES - 1]), 
+               "min %u max %u", (unsigned)hist.min, (unsigned)hist.max);
+    TEST_CHECK((p99 >= exact) && (p99 <= exact + exact / 4), "p99 %u, exact %u", 
+               (unsigned)p99, (unsigned)exact);
+    TEST_CHECK(p99 < hist.max, "p99 is the max");
+    TEST_CHECK(app_latency_percentile(&hist, 1000) == hist.max, "p100 is not the max");
+}
+
+static void test_latency_hist(void)
+{
+    check_buckets();
+    check_p99();
+}
+
+int main(void)
+{
+    return test_run("latency_hist", test_latency_hist);
+}
@@ -0,0 +1,157 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file test_relay_masks.c
+ * @brief Checks the exact sequence of GPIO writes of the relay sequencer for
+ *        every pair of speeds: one write that breaks the relays to release, 
+ *        the break before make gap, and one write that makes the relays to 
+ *        close, with the polarity of CONFIG_ACTIVATE_RELAY_LOW.
+ */
+
+#include <stdio.h>
+
+#include <sdkconfig.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "sim.h"
+#include "test.h"
+#include "app_priv.h"
+
+#define BIT_CAP_LOW         (1UL << CONFIG_RELAY_SPEED_CAP_LOW_GPIO)
+#define BIT_CAP_HIGH        (1UL << CONFIG_RELAY_SPEED_CAP_HIGH_GPIO)
+#define BIT_DIRECT          (1UL << CONFIG_RELAY_SPEED_DIRECT_GPIO)
+#define RELAY_BITS          (BIT_CAP_LOW | BIT_CAP_HIGH | BIT_DIRECT)
+
+#define SETTLE_US           (CONFIG_RELAY_SETTLE_MS * 1000)
+#define GAP_US              (CONFIG_RELAY_BREAK_BEFORE_MAKE_MS * 1000)
+#define SLACK_US            100     /* Timer task and context switches */
+#define IDLE_US             1000000 /* Longer than any transition */
+
+/**
+ * @brief Relays closed by each speed, from the wiring of the fan.
+ */
+static const uint32_t speed_bits[MAX_CELING_SPEED + 1] = {
+    0,
+    BIT_CAP_LOW,
+    BIT_CAP_HIGH,
+    BIT_CAP_LOW | BIT_CAP_HIGH,
+    BIT_DIRECT,
+    BIT_DIRECT,
+};
+
+/**
+ * @brief Levels of the outputs with the relays of a speed closed.
+ */
+static uint32_t speed_levels(uint8_t speed)
+{
+#if CONFIG_ACTIVATE_RELAY_LOW
+    return ~speed_bits[speed] & RELAY_BITS;
+#else
+    return speed_bits[speed];
+#endif
+}
+
+/**
+ * @brief Checks one write of the log: the bits driven to the active level 
+ *        (make) or to the idle level (break), at the expected time.
+ */
+static void check_write(const sim_gpio_write_t* write, uint32_t bits, bool make, 
+                        int64_t at_us, uint8_t from, uint8_t to)
+{
+#if CONFIG_ACTIVATE_RELAY_LOW
+    make = !make;
+#endif
+    uint32_t set = make ? bits : 0;
+    uint32_t clear = make ? 0 : bits;
+
+    TEST_CHECK((write->set == set) && (write->clear == clear),
+               "%u -> %u: wrote set 0x%02x clear 0x%02x, expected set 0x%02x clear 0x%02x", 
+               from, to, (unsigned)write->set, (unsigned)write->clear, 
+               (unsigned)set, (unsigned)clear);
+    TEST_CHECK((write->time_us >= at_us) && (write->time_us < at_us + SLACK_US),
+               "%u -> %u: write at %lld us, expected %lld us", 
+               from, to, (long long)write->time_us, (long long)at_us);
+}
+
+/**
+ * @brief Changes the speed and checks the writes of the transition.
+ */
+static void check_transition(uint8_t from, uint8_t to)
+{
+    app_relay_restore(from);
+    sim_sleep_us(IDLE_US);
+    TEST_CHECK((sim_gpio_output() & RELAY_BITS) == speed_levels(from), 
+               "%u: outputs 0x%02x before the change", from, (unsigned)sim_gpio_output());
+
+    sim_gpio_clear_writes();
+    int64_t start = sim_time_us();
+    app_relay_set_speed(to);
+    sim_sleep_us(IDLE_US);
+
+    uint32_t brk = speed_bits[from] & ~speed_bits[to];
+    uint32_t make = speed_bits[to] & ~speed_bits[from];
+    int64_t at = start + ((to == 0) ? 0 : SETTLE_US);
+
+    size_t count;
+    const sim_gpio_write_t* writes = sim_gpio_writes(&count);
+    size_t expected = (brk ? 1 : 0) + (make ? 1 : 0);
+    if (!TEST_CHECK(count == expected, "%u -> %u: %zu writes, expected %zu", 
+                    from, to, count, expected)) {
+        return;
+    }
+
+    if (brk) {
+        check_write(writes++, brk, false, at, from, to);
+        at += GAP_US;
+    }
+    if (make) {
+        check_write(writes, make, true, at, from, to);
+    }
+    TEST_CHECK((sim_gpio_output() & RELAY_BITS) == speed_levels(to), 
+               "%u -> %u: outputs 0x%02x", from, to, (unsigned)sim_gpio_output());
+}
+
+static void test_relay_masks(void)
+{
+    TEST_CHECK(app_relay_init() == ESP_OK, "init");
+    TEST_CHECK(app_relay_set_speed(MAX_CELING_SPEED + 1) == ESP_ERR_INVALID_ARG, "range");
+
+    for (uint8_t from = 0; from <= MAX_CELING_SPEED; from++) {
+        for (uint8_t to = 0; to <= MAX_CELING_SPEED; to++) {
+            check_transition(from, to);
+        }
+    }
+}
+
+int main(void)
+{
+#if CONFIG_ACTIVATE_RELAY_LOW
+    return test_run("relay_masks_low", test_relay_masks);
+#else
+    return test_run("relay_masks", test_relay_masks);
+#endif
+}
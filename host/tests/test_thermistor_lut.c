@@ -0,0 +1,155 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file test_thermistor_lut.c
+ * @brief Compares the table of the thermistor with the Steinhart equation it
+ *        is built from, over every mV of the divider, and measures the host
+ *        time of both conversions. Also checks that the ends of the divider 
+ *        and a scan without calibration or without frames are rejected.
+ */
+
+#include <stdio.h>
+#include <math.h>
+
+#include <sdkconfig.h>
+
+#include "sim.h"
+#include "test.h"
+#include "thermistor.h"
+
+#define VSOURCE             CONFIG_THERMISTOR_VOLTAGE_SOURCE
+#define LUT_STEP_MV         CONFIG_THERMISTOR_LUT_STEP
+#define BAND_MIN            -20.0f  /* Range where the fan is used */
+#define BAND_MAX            80.0f
+#define BAND_MAX_ERROR      0.05f   /* Celsius, error allowed to the table in the band */
+#define SPEED_PASSES        200
+
+/**
+ * @brief Adds a thermistor with the Kconfig values to a bus.
+ */
+static esp_err_t add(thermistor_bus_t* bus, thermistor_handle_t* th, 
+                     adc_channel_t channel, uint16_t lut_step_mv)
+{
+    return thermistor_bus_add(bus, th, channel, CONFIG_THERMISTOR_SERIE_RESISTANCE, 
+                              CONFIG_THERMISTOR_NOMINAL_RESISTANCE, 
+                              CONFIG_THERMISTOR_NOMINAL_TEMPERATURE, 
+                              CONFIG_THERMISTOR_BETA_VALUE, VSOURCE, lut_step_mv);
+}
+
+/**
+ * @brief Host time of a conversion, over the whole range of the divider.
+ */
+static double conversion_ns(thermistor_handle_t* th)
+{
+    volatile float sink = 0;
+    uint64_t start = test_host_ns();
+
+    for (int pass = 0; pass < SPEED_PASSES; pass++) {
+        for (uint32_t vout = 1; vout < VSOURCE; vout++) {
+            sink += thermistor_vout_to_celsius(th, vout);
+        }
+    }
+    (void)sink;
+    return (double)(test_host_ns() - start) / (SPEED_PASSES * (VSOURCE - 1));
+}
+
+static void test_accuracy(void)
+{
+    thermistor_bus_t bus;
+    thermistor_handle_t lut;
+    thermistor_handle_t ref;
+
+    TEST_CHECK(thermistor_bus_init(&bus, ADC_UNIT_1, THERMISTOR_MODE_ONESHOT) == ESP_OK, "bus");
+    TEST_CHECK(add(&bus, &lut, ADC_CHANNEL_2, LUT_STEP_MV) == ESP_OK, "lut");
+    TEST_CHECK(add(&bus, &ref, ADC_CHANNEL_3, 0) == ESP_OK, "steinhart");
+
+    float band_error = 0;
+    float max_error = 0;
+    uint32_t max_error_mv = 0;
+    for (uint32_t vout = 1; vout < VSOURCE; vout++) {
+        float expected = thermistor_vout_to_celsius(&ref, vout);
+        float error = fabsf(thermistor_vout_to_celsius(&lut, vout) - expected);
+
+        // The table saturates at +-327.67 C, out of any real reading.
+        if (fabsf(expected) < 300.0f && error > max_error) {
+            max_error = error;
+            max_error_mv = vout;
+        }
+        if ((expected >= BAND_MIN) && (expected <= BAND_MAX) && (error > band_error)) {
+            band_error = error;
+        }
+    }
+
+    printf("lut step %d mV: max error %.3f C in %.0f..%.0f C, %.3f C at %u mV\n", 
+           LUT_STEP_MV, band_error, BAND_MIN, BAND_MAX, max_error, (unsigned)max_error_mv);
+    TEST_CHECK(band_error <= BAND_MAX_ERROR, "error %.3f C in the band", band_error);
+
+    thermistor_handle_t* models[] = { &lut, &ref };
+    for (int m = 0; m < 2; m++) {
+        TEST_CHECK(isnan(thermistor_vout_to_celsius(models[m], 0)), "0 mV is not NAN");
+        TEST_CHECK(isnan(thermistor_vout_to_celsius(models[m], VSOURCE)), "vsource is not NAN");
+        TEST_CHECK(isnan(thermistor_vout_to_celsius(models[m], VSOURCE + 100)), "above vsource is not NAN");
+        TEST_CHECK(!isnan(thermistor_vout_to_celsius(models[m], 1)), "1 mV is NAN");
+        TEST_CHECK(!isnan(thermistor_vout_to_celsius(models[m], VSOURCE - 1)), "vsource - 1 is NAN");
+    }
+
+    double lut_ns = conversion_ns(&lut);
+    double ref_ns = conversion_ns(&ref);
+    printf("lut %.1f ns, steinhart %.1f ns per conversion on the host (x%.1f)\n", 
+           lut_ns, ref_ns, ref_ns / lut_ns);
+}
+
+static void test_scan_errors(void)
+{
+    thermistor_bus_t bus;
+    thermistor_handle_t th;
+
+    sim_adc_set_calibrated(false);
+    TEST_CHECK(thermistor_bus_init(&bus, ADC_UNIT_1, THERMISTOR_MODE_ONESHOT) == ESP_OK, "bus");
+    TEST_CHECK(add(&bus, &th, ADC_CHANNEL_2, LUT_STEP_MV) == ESP_OK, "add");
+    TEST_CHECK(thermistor_bus_scan(&bus) == ESP_ERR_INVALID_STATE, "scan without calibration");
+    TEST_CHECK(isnan(thermistor_get_celsius(&th)), "reading without calibration");
+    sim_adc_set_calibrated(true);
+
+    sim_adc_set_raw(ADC_CHANNEL_2, 2000);
+    TEST_CHECK(thermistor_bus_init(&bus, ADC_UNIT_1, THERMISTOR_MODE_CONTINUOUS) == ESP_OK, "bus");
+    TEST_CHECK(add(&bus, &th, ADC_CHANNEL_2, LUT_STEP_MV) == ESP_OK, "add");
+    TEST_CHECK(thermistor_bus_scan(&bus) == ESP_ERR_INVALID_STATE, "scan before the first frame");
+    TEST_CHECK(sim_adc_continuous_frame(16) == ESP_OK, "frame");
+    TEST_CHECK(thermistor_bus_scan(&bus) == ESP_OK, "scan after a frame");
+    TEST_CHECK(!isnan(thermistor_vout_to_celsius(&th, th.vout)), "reading after a frame");
+}
+
+static void test_thermistor_lut(void)
+{
+    test_accuracy();
+    test_scan_errors();
+}
+
+int main(void)
+{
+    return test_run("thermistor_lut", test_thermistor_lut);
+}
@@ -0,0 +1,125 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file app_boot.c
+ * @brief Boot profile and fast boot. Each boot stage is time stamped and 
+ *        the table is printed on the console. The fan state is also kept in 
+ *        RTC memory, which survives the soft resets (panic, watchdog, OTA), 
+ *        so the outputs are restored in the first milliseconds, before NVS 
+ *        and the radio stack are initialized.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <sdkconfig.h>
+
+#include <esp_attr.h>
+#include <esp_timer.h>
+#include <esp_rom_crc.h>
+#include <esp_rmaker_core.h>
+
+#include "app_priv.h"
+
+#include "esp_log.h"
+static const char* TAG = "app_boot";
+
+#define MAX_BOOT_MARKS          12
+#define BOOT_SNAPSHOT_MAGIC     0x46414E53  /* "FANS" */
+
+/**
+ * @brief Time stamp of a boot stage.
+ */
+typedef struct {
+    const char* stage;      ///< Name of the stage, a literal.
+    int64_t time_us;        ///< Time since the boot, from esp_timer_get_time.
+} boot_mark_t;
+
+/**
+ * @brief Fan state retained in RTC memory.
+ */
+typedef struct {
+    uint32_t magic;         ///< BOOT_SNAPSHOT_MAGIC when it was written.
+    app_state_t state;      ///< Last fan state.
+    uint32_t crc;           ///< CRC32 of magic and state.
+} boot_snapshot_t;
+
+static boot_mark_t boot_marks[MAX_BOOT_MARKS];
+static uint8_t boot_mark_count = 0;
+
+#if CONFIG_APP_FAST_BOOT
+static RTC_NOINIT_ATTR boot_snapshot_t boot_snapshot;
+
+/**
+ * @brief Calculates the CRC of the snapshot, without the crc field.
+ */
+static uint32_t boot_snapshot_crc(const boot_snapshot_t* snapshot)
+{
+    return esp_rom_crc32_le(0, (const uint8_t*)snapshot, offsetof(boot_snapshot_t, crc));
+}
+#endif
+
+void app_boot_mark(const char* stage)
+{
+    if (boot_mark_count < MAX_BOOT_MARKS) {
+        boot_marks[boot_mark_count].stage = stage;
+        boot_marks[boot_mark_count].time_us = esp_timer_get_time();
+        boot_mark_count++;
+    }
+}
+
+void app_boot_report(void)
+{
+    int64_t last = 0;
+
+    ESP_LOGI(TAG, "%-20s %10s %10s", "stage", "at (mS)", "took (mS)");
+    for (uint8_t i = 0; i < boot_mark_count; i++) {
+        ESP_LOGI(TAG, "%-20s %10.1f %10.1f", boot_marks[i].stage, 
+                 boot_marks[i].time_us / 1000.0, (boot_marks[i].time_us - last) / 1000.0);
+        last = boot_marks[i].time_us;
+    }
+}
+
+bool app_boot_snapshot_load(app_state_t* state)
+{
+#if CONFIG_APP_FAST_BOOT
+    // After a power-on the RTC memory has random content, the CRC rejects it.
+    if ((boot_snapshot.magic == BOOT_SNAPSHOT_MAGIC) && 
+        (boot_snapshot.crc == boot_snapshot_crc(&boot_snapshot)) &&
+        (boot_snapshot.state.speed <= MAX_CELING_SPEED)) {
+        *state = boot_snapshot.state;
+        return true;
+    }
+#endif
+    return false;
+}
+
+void app_boot_snapshot_save(const app_state_t* state)
+{
+#if CONFIG_APP_FAST_BOOT
+    boot_snapshot.magic = BOOT_SNAPSHOT_MAGIC;
+    boot_snapshot.state = *state;
+    boot_snapshot.crc = boot_snapshot_crc(&boot_snapshot);
+#endif
+}
@@ -30,6 +30,10 @@
 
 #include <sdkconfig.h>
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+
 #include <iot_button.h>
 #include <esp_rmaker_core.h>
 #include <esp_rmaker_standard_types.h> 
@@ -37,10 +41,12 @@
 
 #include <app_reset.h>
 #include "app_priv.h"
+#include "trace.h"
 
 #include "rotary_encoder.h"
 #include "thermistor.h"
 #include "math.h"
+#include <string.h>
 
 #include "esp_log.h"
 static const char* TAG = "app_drv";
@@ -53,22 +59,98 @@ static const char* TAG = "app_drv";
 #define BUTTON_GPIO          CONFIG_ROT_ENC_BUTTON_GPIO
 #define BUTTON_ACTIVE_LEVEL  0
 
+#define ENCODER_TASK_STACK      3072
+#define ENCODER_TASK_PRIORITY   5
+#define ENCODER_BATCH_EVENTS    8
+#define ENCODER_WAIT_MS         1000
+#define ENCODER_STEPS_PER_LEVEL 3
+
+#define CONTROL_TASK_STACK      4096
+#define CONTROL_TASK_PRIORITY   6
+#define CONTROL_QUEUE_LEN       16
+#define CONTROL_POST_WAIT_MS    100
+
 #define WIFI_RESET_BUTTON_TIMEOUT       30
 #define FACTORY_RESET_BUTTON_TIMEOUT    60
+#define TRACE_DUMP_BUTTON_TIMEOUT       5
+
+/**
+ * @brief Commands to the controller task, the only writer of the fan state.
+ */
+typedef enum {
+    CONTROL_POWER,          ///< Turn the fan on/off, val.b.
+    CONTROL_SPEED,          ///< Set the speed, val.i.
+    CONTROL_SPEED_STEP,     ///< Add speed levels moved by the encoder, val.i.
+    CONTROL_LIGHT,          ///< Turn the light on/off, val.b.
+    CONTROL_LIGHT_TOGGLE,   ///< Toggle the light from the push button.
+    CONTROL_TEMP_ENABLE,    ///< Enable the thermostat, val.b.
+    CONTROL_TEMP_LEVEL,     ///< Set the thermostat temperature, val.i.
+    CONTROL_TEMPERATURE,    ///< New temperature reading for the thermostat, val.f.
+} control_cmd_type_t;
+
+typedef struct {
+    control_cmd_type_t type;
+    union {
+        bool b;
+        int i;
+        float f;
+    } val;
+    uint32_t stamp;             ///< Latency stamp of the source, 0 if not measured.
+    uint32_t posted;            ///< Latency stamp of the post to the queue.
+    app_latency_path_t path;    ///< Path measured by the stamp.
+} control_cmd_t;
+
+#define CONTROL_CHANGE_SPEED    (1 << 0)    /* The relays and the led must be updated */
+#define CONTROL_CHANGE_LED      (1 << 1)    /* Only the led must be updated */
 
+static QueueHandle_t control_queue;
+
+// Fan and thermostat state, written only by the controller task.
 static uint8_t g_speed = DEFAULT_SPEED;
 static bool g_power = DEFAULT_POWER;
 static bool g_light = DEFAULT_LIGHT;
-static float g_temperature = 0;
 static bool g_temp_enable = DEFAULT_THERMOSTAT_ENABLE;
 static int g_temp_level = DEFAULT_THERMOSTAT_TEMPERATURE;
 
+// Readings and adaptive period, written by the worker task (and by 
+// app_temperature_init before the timer starts), the others read the cache.
+static float g_temperature = 0;
+static uint32_t g_temp_period = CONFIG_TEMPERATURE_MIN_PERIOD;
+static int64_t g_temp_sample_time = 0;
+static float g_temp_sample_value = 0;
+
+// Set by the controller to request a reading, cleared by the worker.
+static volatile bool g_temp_restart_pending = false;
+
 // Create rotary encoder instance, and timer
 static esp_timer_handle_t temperature_timer;
 static rotenc_handle_t h_encoder = { 0 };
 
+static thermistor_bus_t th_bus;
 static thermistor_handle_t th;
-static int32_t last_encoder_position = 0; 
+#if CONFIG_MOTOR_THERMISTOR
+static thermistor_handle_t th_motor;
+static float g_motor_temperature = 0;  /* Written by the worker task, like g_temperature */
+#endif
+static int32_t encoder_steps = 0; 
+
+/**
+ * @brief Last value reported of a temperature param.
+ */
+typedef struct {
+    esp_rmaker_param_t* param;  ///< Param of the temperature.
+    float value;                ///< Last reported value.
+    int64_t time;               ///< Time in uS of the last report.
+    bool valid;                 ///< It has been reported at least once.
+} deadband_report_t;
+
+static deadband_report_t temp_report = { 0 };
+#if CONFIG_MOTOR_THERMISTOR
+static deadband_report_t motor_report = { 0 };
+#endif
+
+static thermistor_cal_point_t cal_points[MAX_CALIBRATION_POINTS];
+static uint8_t cal_count = 0;
 
 // Converts the choice of menuconfig into the enums of the ADC channels.
 #if CONFIG_ADC_CHANNEL_1
@@ -93,33 +175,11 @@ static int32_t last_encoder_position = 0;
     #error "Configure the ADC channel where the thermistor is connected"
 #endif
 
-/**
- * @brief Activates the corresponding relay and applies the configured logic.
- */
-static void relay_on(gpio_num_t gpio_num)
-{
-bool level = true;  
-
-#if CONFIG_ACTIVATE_RELAY_LOW
-    level = false;
-#endif
-   
-   gpio_set_level(gpio_num, level);
-}
-
-/**
- * @brief Turn off the corresponding relay and apply the configured logic.
- */
-static void relay_off(gpio_num_t gpio_num)
-{
-bool level = false;  
-
-#if CONFIG_ACTIVATE_RELAY_LOW
-    level = true;
+#if CONFIG_THERMISTOR_ADC_CONTINUOUS
+	#define THERMISTOR_ADC_MODE THERMISTOR_MODE_CONTINUOUS
+#else
+	#define THERMISTOR_ADC_MODE THERMISTOR_MODE_ONESHOT
 #endif
-   
-   gpio_set_level(gpio_num, level);
-}
 
 static void set_idle_color(void)
 {
@@ -198,72 +258,326 @@ static void show_status(uint8_t speed, bool light)
  */
 static void set_speed(uint8_t val)
 {
-    // First turn off the relay.
-    if (val == 0) {
-        relay_off(CONFIG_RELAY_SPEED_CAP_LOW_GPIO);
-        relay_off(CONFIG_RELAY_SPEED_CAP_HIGH_GPIO);
-        relay_off(CONFIG_RELAY_SPEED_DIRECT_GPIO);
-    } else if (val == 1) {
-        relay_off(CONFIG_RELAY_SPEED_CAP_HIGH_GPIO);
-        relay_off(CONFIG_RELAY_SPEED_DIRECT_GPIO);
-        relay_on(CONFIG_RELAY_SPEED_CAP_LOW_GPIO);
-    } else if (val == 2) {
-        relay_off(CONFIG_RELAY_SPEED_CAP_LOW_GPIO);
-        relay_off(CONFIG_RELAY_SPEED_DIRECT_GPIO);
-        relay_on(CONFIG_RELAY_SPEED_CAP_HIGH_GPIO);
-    } else if (val == 3) {
-        relay_off(CONFIG_RELAY_SPEED_DIRECT_GPIO);
-        relay_on(CONFIG_RELAY_SPEED_CAP_LOW_GPIO);
-        relay_on(CONFIG_RELAY_SPEED_CAP_HIGH_GPIO);
-    } else if ((val == 4) || (val == 5)) {
-        relay_off(CONFIG_RELAY_SPEED_CAP_LOW_GPIO);
-        relay_off(CONFIG_RELAY_SPEED_CAP_HIGH_GPIO);
-        relay_on(CONFIG_RELAY_SPEED_DIRECT_GPIO);
-    }
+    // The sequencer switches the relays in background.
+    app_relay_set_speed(val);
 
     show_status(val, g_light);
 }
 
 /**
- * @brief Function called by the encoder component when the user moves the shaft.
- * @param event Contains the position and direction of the encoder.
+ * @brief Accumulates the accelerated steps of an encoder event, and returns 
+ *        the speed levels moved. A reversal restarts the accumulation.
+ * @param event Contains the position, direction and steps of the encoder.
+ * @return Speed levels to add (negative to subtract).
+ */
+static int encoder_levels(rotenc_event_t event)
+{
+    if ((encoder_steps > 0 && event.steps < 0) || (encoder_steps < 0 && event.steps > 0)) {
+        encoder_steps = 0;
+    }
+    encoder_steps += event.steps;
+
+    int levels = encoder_steps / ENCODER_STEPS_PER_LEVEL;
+    encoder_steps -= levels * ENCODER_STEPS_PER_LEVEL;
+    return levels;
+}
+
+/**
+ * @brief Restarts the temperature timer to read in the minimum period. It 
+ *        runs in the worker task, like the reading that updates the period.
+ * @param priv
+ */
+static void temperature_restart(void *priv)
+{
+    g_temp_restart_pending = false;
+    if (temperature_timer) {
+        g_temp_period = CONFIG_TEMPERATURE_MIN_PERIOD;
+        esp_timer_stop(temperature_timer);
+        esp_timer_start_once(temperature_timer, g_temp_period * 1000000ULL);
+    }
+}
+
+/**
+ * @brief Requests a reading in the minimum period, when the thermostat 
+ *        settings change. The requests of a slider drag are merged into 
+ *        the one already queued.
+ */
+static void temperature_sample_soon(void)
+{
+    if (!g_temp_restart_pending) {
+        g_temp_restart_pending = true;
+        if (app_work_post(temperature_restart, NULL) != ESP_OK) {
+            g_temp_restart_pending = false;
+        }
+    }
+}
+
+/**
+ * @brief Get a param of the fan device.
+ * @param type Type of the param.
+ * @return The param, or NULL while the network task did not create the device.
+ */
+static esp_rmaker_param_t* fan_param(const char* type)
+{
+    return fan_device ? esp_rmaker_device_get_param_by_type(fan_device, type) : NULL;
+}
+
+/**
+ * @brief Posts a command to the controller task.
+ * @param cmd Command to apply.
+ * @return ESP_OK if successful, ESP_ERR_TIMEOUT if the queue is full.
+ */
+static esp_err_t control_post(const control_cmd_t* cmd)
+{
+    control_cmd_t queued = *cmd;
+    if (queued.stamp) {
+        queued.posted = app_latency_stamp();
+    }
+
+    if (!control_queue || 
+        (xQueueSend(control_queue, &queued, pdMS_TO_TICKS(CONTROL_POST_WAIT_MS)) != pdTRUE)) {
+        ESP_LOGW(TAG, "control command %d lost", cmd->type);
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Turns the power on when the speed is set, and off at speed 0, 
+ *        reporting the change.
+ */
+static void control_power_follow_speed(void)
+{
+    if ((g_speed > 0) && !g_power) {
+        g_power = true;
+        app_report_param(
+                fan_param(ESP_RMAKER_PARAM_POWER),
+                esp_rmaker_bool(g_power));
+    } else if ((g_speed == 0) && g_power) {
+        g_power = false;
+        app_report_param(
+                fan_param(ESP_RMAKER_PARAM_POWER),
+                esp_rmaker_bool(g_power));
+    }
+}
+
+/**
+ * @brief Applies the speed levels moved by the user with the shaft.
+ * @param levels Speed levels to add (negative to subtract).
+ * @return Changes to apply by the controller.
  */
-static void encoder_update(rotenc_event_t event)
+static uint8_t control_speed_step(int levels)
 {
     uint8_t old_speed = g_speed;
+    int speed = g_speed + levels;
+
+    if (speed > MAX_CELING_SPEED) {
+        speed = MAX_CELING_SPEED;
+    } else if (speed < 0) {
+        speed = 0;
+    }
+    g_speed = speed;
+
+    if (old_speed == g_speed) {
+        return 0;
+    }
+
+    app_report_param(
+            fan_param(ESP_RMAKER_PARAM_SPEED),
+            esp_rmaker_int(g_speed));
+    control_power_follow_speed();
+    return CONTROL_CHANGE_SPEED;
+}
+
+/**
+ * @brief Turns the fan on above the thermostat temperature, and off 
+ *        when it falls near the setpoint.
+ * @param temperature Last reading in Celsius.
+ * @return Changes to apply by the controller.
+ */
+static uint8_t control_thermostat(float temperature)
+{
+    if (!g_temp_enable) {
+        return 0;
+    }
+
+    if (!g_power && (temperature > g_temp_level)) {
+        g_power = true;
+    } else if (g_power && (temperature < (g_temp_level + 1))) {
+        g_power = false;
+    } else {
+        return 0;
+    }
+
+    app_report_param(
+        fan_param(ESP_RMAKER_PARAM_POWER),
+        esp_rmaker_bool(g_power));
+    return CONTROL_CHANGE_SPEED;
+}
+
+/**
+ * @brief Applies a command to the fan state.
+ * @param cmd Command to apply.
+ * @return Changes to apply by the controller.
+ */
+static uint8_t control_apply(const control_cmd_t* cmd)
+{
+    uint8_t changes = 0;
+
+    switch (cmd->type) {
+    case CONTROL_POWER:
+        g_power = cmd->val.b;
+        changes = CONTROL_CHANGE_SPEED;
+        break;
+    case CONTROL_SPEED:
+        g_speed = cmd->val.i;
+        control_power_follow_speed();
+        changes = CONTROL_CHANGE_SPEED;
+        break;
+    case CONTROL_SPEED_STEP:
+        changes = control_speed_step(cmd->val.i);
+        break;
+    case CONTROL_LIGHT:
+        g_light = cmd->val.b;
+        app_relay_set_light(g_light);
+        changes = CONTROL_CHANGE_LED;
+        break;
+    case CONTROL_LIGHT_TOGGLE:
+        g_light = !g_light;
+        app_relay_set_light(g_light);
+        app_report_param(light_param, esp_rmaker_bool(g_light));
+        changes = CONTROL_CHANGE_LED;
+        break;
+    case CONTROL_TEMP_ENABLE:
+        g_temp_enable = cmd->val.b;
+        temperature_sample_soon();
+        break;
+    case CONTROL_TEMP_LEVEL:
+        g_temp_level = cmd->val.i;
+        temperature_sample_soon();
+        break;
+    case CONTROL_TEMPERATURE:
+        changes = control_thermostat(cmd->val.f);
+        break;
+    }
+
+    return changes;
+}
+
+/**
+ * @brief Controller task, it owns the fan state and applies the commands 
+ *        in order. The commands queued together are applied as a batch, 
+ *        and the relays and the led are updated once at the end.
+ * @param arg
+ */
+static void control_task(void *arg)
+{
+    control_cmd_t cmd;
+
+    app_metrics_watch_task();
 
-    if (abs(last_encoder_position - event.position) >= 3) {
-        if ((event.direction == ROTENC_CW) && (g_speed < MAX_CELING_SPEED)) {
-            g_speed++;
-        } else if ((event.direction == ROTENC_CCW) && (g_speed > 0)) {
-            g_speed--;
-        } 
-
-        if (old_speed != g_speed) {
-            esp_rmaker_param_update_and_report(
-                    esp_rmaker_device_get_param_by_type(fan_device, ESP_RMAKER_PARAM_SPEED),
-                    esp_rmaker_int(g_speed));
-
-            if ((old_speed == 0) || ((g_power == false) && (g_speed > 0))) {
-                g_power = true;
-                esp_rmaker_param_update_and_report(
-                        esp_rmaker_device_get_param_by_type(fan_device, ESP_RMAKER_PARAM_POWER),
-                        esp_rmaker_bool(g_power));
-            } else if (g_speed == 0) {
-                g_power = false;
-                esp_rmaker_param_update_and_report(
-                        esp_rmaker_device_get_param_by_type(fan_device, ESP_RMAKER_PARAM_POWER),
-                        esp_rmaker_bool(g_power));
-                
+    while (true) {
+        if (xQueueReceive(control_queue, &cmd, portMAX_DELAY) == pdTRUE) {
+            uint8_t changes = 0;
+            control_cmd_t first = { .stamp = 0 };
+            do {
+                uint8_t change = control_apply(&cmd);
+                if ((change & CONTROL_CHANGE_SPEED) && cmd.stamp && !first.stamp) {
+                    first = cmd;
+                }
+                changes |= change;
+            } while (xQueueReceive(control_queue, &cmd, 0) == pdTRUE);
+            TRACE(APP_TRACE_CONTROL_BATCH, changes);
+
+            if (changes & CONTROL_CHANGE_SPEED) {
+                set_speed(g_power ? g_speed : 0);
+                app_latency_record(first.path, first.stamp);
+                app_latency_record(APP_LATENCY_CONTROL, first.posted);
+            } else if (changes & CONTROL_CHANGE_LED) {
+                show_status(g_speed, g_light);
+            }
+
+            app_state_t state;
+            app_fan_get_state(&state);
+            app_state_save(&state);
+        }
+    }
+}
+
+/**
+ * @brief Creates the command queue and the controller task.
+ * @return ESP_OK if successful
+ */
+static esp_err_t control_init(void)
+{
+    control_queue = xQueueCreate(CONTROL_QUEUE_LEN, sizeof(control_cmd_t));
+    if (!control_queue) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (xTaskCreate(control_task, "control", CONTROL_TASK_STACK, NULL, 
+                    CONTROL_TASK_PRIORITY, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Task that drains the encoder ring, all the steps buffered since the 
+ *        last wakeup are added up and applied once, so a fast spin moves 
+ *        several levels with a single relay transition.
+ * @param arg
+ */
+static void encoder_task(void *arg)
+{
+    rotenc_event_t events[ENCODER_BATCH_EVENTS];
+    uint32_t count = 0;
+    uint32_t overflows = 0;
+
+    app_metrics_watch_task();
+
+    while (true) {
+        if (rotenc_wait_events(&h_encoder, events, ENCODER_BATCH_EVENTS, &count) == ESP_OK) {
+            uint32_t woken = app_latency_stamp();
+            app_metrics_add(APP_METRIC_ENCODER_EVENTS, count);
+            int levels = 0;
+            for (uint32_t i = 0; i < count; i++) {
+                levels += encoder_levels(events[i]);
+                app_latency_record_span(APP_LATENCY_ENC_ISR, events[i].isr_cycles, events[i].cycles);
+            }
+            if (count) {
+                app_latency_record_span(APP_LATENCY_ENC_TASK, events[0].cycles, woken);
             }
 
-            set_speed(g_speed);
+            // The oldest edge of the batch is the start of the latency.
+            if (levels) {
+                control_post(&(control_cmd_t){ .type = CONTROL_SPEED_STEP, .val.i = levels, 
+                                                .stamp = events[0].isr_cycles, 
+                                                .path = APP_LATENCY_ENCODER });
+            }
+        }
+
+        if (rotenc_get_overflows(&h_encoder) != overflows) {
+            uint32_t last = overflows;
+            overflows = rotenc_get_overflows(&h_encoder);
+            app_metrics_add(APP_METRIC_ENCODER_DROPPED, overflows - last);
+            ESP_LOGW(TAG, "encoder ring overflows: %u", (unsigned)overflows);
         }
-     
-        last_encoder_position = event.position;
     }
 }
 
+#if CONFIG_TRACE_ENABLE
+/**
+ * @brief Trace hook of the encoder driver, it runs in the ISRs.
+ * @param event Event of the driver.
+ * @param arg Argument of the event.
+ */
+static void IRAM_ATTR encoder_trace(rotenc_trace_event_t event, uint32_t arg)
+{
+    trace_record((event == ROTENC_TRACE_STEP) ? APP_TRACE_ENC_STEP : APP_TRACE_ENC_OVERFLOW, arg);
+}
+#endif
+
 /**
  * @brief Initialize the rotary encoder to control speed and light.
  * @param void
@@ -280,7 +594,26 @@ static esp_err_t encoder_init(void)
                                 CONFIG_ROT_ENC_DEBOUNCE);
 
     if (err == ESP_OK) {
-        err = rotenc_set_event_callback(&h_encoder, encoder_update);
+        err = rotenc_set_event_ring(&h_encoder, CONFIG_ROT_ENC_EVENT_DEPTH, ENCODER_WAIT_MS);
+    }
+
+#if CONFIG_TRACE_ENABLE
+    rotenc_set_trace_callback(encoder_trace);
+#endif
+
+#if CONFIG_ROT_ENC_ACCEL_MAX_STEPS > 1
+    if (err == ESP_OK) {
+        err = rotenc_set_acceleration(&h_encoder, CONFIG_ROT_ENC_ACCEL_MIN_RATE, 
+                                      CONFIG_ROT_ENC_ACCEL_MAX_RATE, 
+                                      CONFIG_ROT_ENC_ACCEL_MAX_STEPS);
+    }
+#endif
+
+    if (err == ESP_OK) {
+        if (xTaskCreate(encoder_task, "encoder", ENCODER_TASK_STACK, NULL, 
+                        ENCODER_TASK_PRIORITY, NULL) != pdPASS) {
+            err = ESP_ERR_NO_MEM;
+        }
     }
 
     return err;
@@ -292,42 +625,183 @@ static esp_err_t encoder_init(void)
  */
 static void push_btn_cb(void *arg)
 {
-    app_fan_set_ligth(!g_light);
-    
-    esp_rmaker_param_update_and_report(light_param, esp_rmaker_bool(g_light));
+    control_post(&(control_cmd_t){ .type = CONTROL_LIGHT_TOGGLE });
+}
+
+#if CONFIG_TRACE_ENABLE
+/**
+ * @brief Prints the trace on the console, it runs in the worker task.
+ * @param arg
+ */
+static void trace_dump_work(void *arg)
+{
+    trace_dump();
+}
+
+/**
+ * @brief Function invoked when the button is held TRACE_DUMP_BUTTON_TIMEOUT 
+ *        seconds, defers the dump of the trace.
+ * @param arg
+ */
+static void trace_dump_btn_cb(void *arg)
+{
+    app_work_post(trace_dump_work, NULL);
+}
+#endif
+
+/**
+ * @brief Reports a temperature to the cloud only when it moved more than the 
+ *        deadband from the last reported value, or when the heartbeat 
+ *        interval elapsed without reports.
+ * @param report Reporting state of the param.
+ * @param value Temperature in Celsius.
+ */
+static void report_with_deadband(deadband_report_t* report, float value)
+{
+    int64_t now = esp_timer_get_time();
+
+    if (report->valid && 
+        (fabsf(value - report->value) < (CONFIG_TEMPERATURE_REPORT_DEADBAND / 10.0f)) &&
+        ((now - report->time) < (CONFIG_TEMPERATURE_REPORT_HEARTBEAT * 1000000LL))) {
+        app_metrics_add(APP_METRIC_REPORTS_SUPPRESSED, 1);
+        return;
+    }
+
+    if (esp_rmaker_param_update_and_report(report->param, esp_rmaker_float(value)) == ESP_OK) {
+        report->value = value;
+        report->time = now;
+        report->valid = true;
+        app_metrics_add(APP_METRIC_REPORTS_SENT, 1);
+    }
+}
+
+/**
+ * @brief Reads the thermistors and updates the cached temperatures. Only the 
+ *        init and the worker task scan, the other tasks read the cache.
+ */
+static void temperature_scan(void)
+{
+    // A single pass reads the ambient and the motor thermistors.
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = thermistor_bus_scan(&th_bus);
+    app_metrics_set(APP_METRIC_ADC_READ_US, (uint32_t)(esp_timer_get_time() - start));
+
+    // A failed scan or a broken divider keeps the last good reading.
+    if (err == ESP_OK) {
+        float celsius = thermistor_vout_to_celsius(&th, th.vout);
+        if (!isnan(celsius)) {
+            g_temperature = celsius;
+        }
+#if CONFIG_MOTOR_THERMISTOR
+        celsius = thermistor_vout_to_celsius(&th_motor, th_motor.vout);
+        if (!isnan(celsius)) {
+            g_motor_temperature = celsius;
+        }
+#endif
+    }
 }
 
 /**
- * @brief Function invoked when the timer expires to read the temperature.
+ * @brief Calculates the period until the next reading: the minimum when the 
+ *        temperature moves fast or is near the thermostat setpoint, else 
+ *        doubles the last one up to the maximum.
+ * @return Period in seconds.
+ */
+static uint32_t temperature_next_period(void)
+{
+    int64_t now = esp_timer_get_time();
+    float minutes = (now - g_temp_sample_time) / 60000000.0f;
+    float rate = (minutes > 0) ? fabsf(g_temperature - g_temp_sample_value) / minutes : 0;
+    bool near_setpoint = g_temp_enable && 
+                         (fabsf(g_temperature - g_temp_level) < TEMPERATURE_SETPOINT_BAND);
+
+    g_temp_sample_time = now;
+    g_temp_sample_value = g_temperature;
+
+    if (near_setpoint || (rate > TEMPERATURE_FAST_RATE)) {
+        g_temp_period = CONFIG_TEMPERATURE_MIN_PERIOD;
+    } else if (g_temp_period < CONFIG_TEMPERATURE_MAX_PERIOD) {
+        g_temp_period *= 2;
+        if (g_temp_period > CONFIG_TEMPERATURE_MAX_PERIOD) {
+            g_temp_period = CONFIG_TEMPERATURE_MAX_PERIOD;
+        }
+    }
+
+    return g_temp_period;
+}
+
+/**
+ * @brief Reads the temperature, reports it and feeds the thermostat. It runs 
+ *        in the worker task, the ADC read and the report are slow.
+ *        The timer is re-armed with the new period when it changes.
  * @param priv
  */
 static void app_temperatura_update(void *priv)
 {
-    app_get_current_temperature();
-
-    esp_rmaker_param_update_and_report(
-            esp_rmaker_device_get_param_by_type(thermostat_device, ESP_RMAKER_PARAM_TEMPERATURE),
-            esp_rmaker_float(g_temperature));
-
-    if (g_temp_enable) {
-        if (!g_power) {
-            if (g_temperature > g_temp_level) {
-                g_power = true;
-                esp_rmaker_param_update_and_report(
-                    esp_rmaker_device_get_param_by_type(fan_device, ESP_RMAKER_PARAM_POWER),
-                    esp_rmaker_bool(g_power));
-                set_speed(g_speed);
-            }        
-        } else {
-            if (g_temperature < (g_temp_level + 1)) {
-                g_power = false;
-                esp_rmaker_param_update_and_report(
-                    esp_rmaker_device_get_param_by_type(fan_device, ESP_RMAKER_PARAM_POWER),
-                    esp_rmaker_bool(g_power));
-                set_speed(0);
-            }  
-        }
+    uint32_t period = g_temp_period;
+
+    temperature_scan();
+
+    if (temperature_next_period() != period) {
+        esp_timer_stop(temperature_timer);
+        esp_timer_start_once(temperature_timer, g_temp_period * 1000000ULL);
+    }
+
+    // The devices are created by the network task, after the first reading.
+    if (!temp_report.param && thermostat_device) {
+        temp_report.param = esp_rmaker_device_get_param_by_type(thermostat_device, 
+                                                                ESP_RMAKER_PARAM_TEMPERATURE);
+    }
+    if (temp_report.param) {
+        report_with_deadband(&temp_report, g_temperature);
+    }
+
+#if CONFIG_MOTOR_THERMISTOR
+    motor_report.param = motor_temp_param;
+    if (motor_report.param) {
+        report_with_deadband(&motor_report, g_motor_temperature);
     }
+#endif
+
+    control_post(&(control_cmd_t){ .type = CONTROL_TEMPERATURE, .val.f = g_temperature });
+}
+
+/**
+ * @brief Function invoked when the timer expires to read the temperature. 
+ *        It re-arms itself with the current period, so a reading lost in 
+ *        the full work queue only skips one sample.
+ * @param priv
+ */
+static void app_temperature_timer_cb(void *priv)
+{
+    TRACE(APP_TRACE_TEMP_TIMER, 0);
+    esp_timer_start_once(temperature_timer, g_temp_period * 1000000ULL);
+    app_work_post(app_temperatura_update, NULL);
+}
+
+/**
+ * @brief Applies the oversampling and filter options of menuconfig to a thermistor.
+ * @param thermistor Thermistor already added to the bus.
+ * @return ESP_OK if successful
+ */
+static esp_err_t thermistor_setup(thermistor_handle_t* thermistor)
+{
+    esp_err_t err = thermistor_set_decimation(thermistor, CONFIG_THERMISTOR_DECIMATION_BITS);
+
+#if CONFIG_THERMISTOR_FILTER
+    if (err == ESP_OK) {
+        thermistor_filter_config_t filter_conf = {
+            .samples = CONFIG_THERMISTOR_FILTER_SAMPLES,
+            .median_len = CONFIG_THERMISTOR_FILTER_MEDIAN,
+            .ema_shift = CONFIG_THERMISTOR_FILTER_EMA_SHIFT,
+            .max_rejects = CONFIG_THERMISTOR_FILTER_MAX_REJECTS,
+            .outlier_gate = CONFIG_THERMISTOR_FILTER_OUTLIER,
+        };
+        err = thermistor_set_filter(thermistor, &filter_conf);
+    }
+#endif
+
+    return err;
 }
 
 /**
@@ -340,22 +814,60 @@ static esp_err_t app_temperature_init(void)
 {
     g_temperature = DEFAULT_TEMPERATURE;
     esp_timer_create_args_t temperature_timer_conf = {
-        .callback = app_temperatura_update,
+        .callback = app_temperature_timer_cb,
         .dispatch_method = ESP_TIMER_TASK,
         .name = "app_temperatura_update"
     };
 
-    esp_err_t err = thermistor_init(&th, THERMISTOR_ADC_CHANNEL, 
-                                    CONFIG_THERMISTOR_SERIE_RESISTANCE, 
-                                    CONFIG_THERMISTOR_NOMINAL_RESISTANCE, 
-                                    CONFIG_THERMISTOR_NOMINAL_TEMPERATURE,
-                                    CONFIG_THERMISTOR_BETA_VALUE, 
-                                    CONFIG_THERMISTOR_VOLTAGE_SOURCE);
+    esp_err_t err = thermistor_bus_init(&th_bus, ADC_UNIT_1, THERMISTOR_ADC_MODE);
+
+    if (err == ESP_OK) {
+        err = thermistor_bus_add(&th_bus, &th, THERMISTOR_ADC_CHANNEL, 
+                                 CONFIG_THERMISTOR_SERIE_RESISTANCE, 
+                                 CONFIG_THERMISTOR_NOMINAL_RESISTANCE, 
+                                 CONFIG_THERMISTOR_NOMINAL_TEMPERATURE,
+                                 CONFIG_THERMISTOR_BETA_VALUE, 
+                                 CONFIG_THERMISTOR_VOLTAGE_SOURCE,
+                                 CONFIG_THERMISTOR_LUT_STEP);
+    }
+
+    if (err == ESP_OK) {
+        err = thermistor_setup(&th);
+    }
+
+    if (err == ESP_OK) {
+        esp_err_t cal_err = thermistor_load_calibration(&th, THERMISTOR_CALIBRATION_KEY);
+        if (cal_err == ESP_OK) {
+            ESP_LOGI(TAG, "thermistor calibration loaded");
+        } else if (cal_err != ESP_ERR_NVS_NOT_FOUND) {
+            ESP_LOGW(TAG, "thermistor calibration not loaded: %d", cal_err);
+        }
+    }
+
+#if CONFIG_MOTOR_THERMISTOR
+    if (err == ESP_OK) {
+        err = thermistor_bus_add(&th_bus, &th_motor, CONFIG_MOTOR_THERMISTOR_ADC_CHANNEL, 
+                                 CONFIG_MOTOR_THERMISTOR_SERIE_RESISTANCE, 
+                                 CONFIG_MOTOR_THERMISTOR_NOMINAL_RESISTANCE, 
+                                 CONFIG_THERMISTOR_NOMINAL_TEMPERATURE,
+                                 CONFIG_MOTOR_THERMISTOR_BETA_VALUE, 
+                                 CONFIG_THERMISTOR_VOLTAGE_SOURCE,
+                                 CONFIG_THERMISTOR_LUT_STEP);
+    }
+
+    if (err == ESP_OK) {
+        err = thermistor_setup(&th_motor);
+    }
+#endif
 
     if (err == ESP_OK) {
         err = esp_timer_create(&temperature_timer_conf, &temperature_timer);
         if (err == ESP_OK) {
-            esp_timer_start_periodic(temperature_timer, TEMPERATURE_REPORTING_PERIOD * 1000000U);
+            // The first reading is taken before the network task creates the params.
+            temperature_scan();
+            g_temp_sample_time = esp_timer_get_time();
+            g_temp_sample_value = g_temperature;
+            esp_timer_start_once(temperature_timer, g_temp_period * 1000000ULL);
         }
     }
 
@@ -364,59 +876,60 @@ static esp_err_t app_temperature_init(void)
 
 esp_err_t app_fan_set_power(bool power)
 {
-    g_power = power;
-    if (power) {
-        set_speed(g_speed);
-    } else {
-        set_speed(0);
-    }
-    return ESP_OK;
+    return control_post(&(control_cmd_t){ .type = CONTROL_POWER, .val.b = power, 
+                                           .stamp = app_latency_stamp(), 
+                                           .path = APP_LATENCY_CLOUD });
 }
 
 esp_err_t app_fan_set_speed(uint8_t speed)
 {
-    g_speed = speed;
-
-    if ((g_speed > 0) && !g_power) {
-        g_power = true;
-        esp_rmaker_param_update_and_report(
-                esp_rmaker_device_get_param_by_type(fan_device, ESP_RMAKER_PARAM_POWER),
-                esp_rmaker_bool(g_power));
-    } else if ((g_speed == 0) && g_power) {
-        g_power = false;
-        esp_rmaker_param_update_and_report(
-                esp_rmaker_device_get_param_by_type(fan_device, ESP_RMAKER_PARAM_POWER),
-                esp_rmaker_bool(g_power));
-        
-    }
-
-    set_speed(speed);
-
-    return ESP_OK; 
+    return control_post(&(control_cmd_t){ .type = CONTROL_SPEED, .val.i = speed, 
+                                           .stamp = app_latency_stamp(), 
+                                           .path = APP_LATENCY_CLOUD });
 }
 
 esp_err_t app_fan_set_ligth(bool state)
 {
-    g_light = state;
-
-    if (state) {
-        relay_on(CONFIG_RELAY_LIGHT_GPIO);
-    } else {
-        relay_off(CONFIG_RELAY_LIGHT_GPIO);
-    }
+    return control_post(&(control_cmd_t){ .type = CONTROL_LIGHT, .val.b = state });
+}
 
-    show_status(g_speed, g_light);
-    return ESP_OK;  
+void app_fan_get_state(app_state_t* state)
+{
+    state->speed = g_speed;
+    state->power = g_power;
+    state->light = g_light;
+    state->temp_enable = g_temp_enable;
+    state->temp_level = g_temp_level;
 }
 
 esp_err_t app_fan_init(void)
 {
-    app_fan_set_power(g_power);
-    return ESP_OK;
+    // Restores the state before the controller starts to own it.
+    app_state_t state;
+    app_state_load(&state);
+    g_speed = state.speed;
+    g_power = state.power;
+    g_light = state.light;
+    g_temp_enable = state.temp_enable;
+    g_temp_level = state.temp_level;
+
+    // The outputs are applied at once, like the RTC snapshot of the fast 
+    // boot: no settle window and no command stamped as a cloud write.
+    app_relay_restore(g_power ? g_speed : 0);
+    app_relay_set_light(g_light);
+    show_status(g_speed, g_light);
+
+    return control_init();
 }
 
 void app_driver_init()
 {
+    app_work_init();
+    app_report_init();
+    app_latency_init();
+    app_metrics_init();
+    app_relay_init();
+    init_led();
     app_fan_init();
     
     button_handle_t btn_handle = iot_button_create(BUTTON_GPIO, BUTTON_ACTIVE_LEVEL);
@@ -425,42 +938,87 @@ void app_driver_init()
         iot_button_set_evt_cb(btn_handle, BUTTON_CB_TAP, push_btn_cb, NULL);
         /* Register Wi-Fi reset and factory reset functionality on same button */
         app_reset_button_register(btn_handle, WIFI_RESET_BUTTON_TIMEOUT, FACTORY_RESET_BUTTON_TIMEOUT);
+#if CONFIG_TRACE_ENABLE
+        /* The trace is dumped well before the Wi-Fi reset */
+        iot_button_add_on_press_cb(btn_handle, TRACE_DUMP_BUTTON_TIMEOUT, trace_dump_btn_cb, NULL);
+#endif
     }
 
-    /* Configure power */
-    gpio_config_t io_conf = {
-        .mode = GPIO_MODE_OUTPUT,
-        .pull_up_en = 1,
-    };
-    uint64_t pin_mask = (((uint64_t)1 << CONFIG_RELAY_SPEED_CAP_LOW_GPIO) | 
-                         ((uint64_t)1 << CONFIG_RELAY_SPEED_CAP_HIGH_GPIO) | 
-                         ((uint64_t)1 << CONFIG_RELAY_SPEED_DIRECT_GPIO) | 
-                         ((uint64_t)1 << CONFIG_RELAY_LIGHT_GPIO) );
-    io_conf.pin_bit_mask = pin_mask;
-    /* Configure the GPIO */
-    gpio_config(&io_conf);
-
-    app_fan_set_ligth(false);
-    set_speed(0); 
-
     encoder_init(); 
     app_temperature_init(); 
-    init_led();
 }
 
 float app_get_current_temperature(void)
 {
-    g_temperature = thermistor_get_celsius(&th);
-
     return g_temperature;
 }
 
+#if CONFIG_MOTOR_THERMISTOR
+float app_get_motor_temperature(void)
+{
+    return g_motor_temperature;
+}
+#endif
+
 void app_temp_set_enable(bool enable)
 {
-    g_temp_enable = enable;
+    control_post(&(control_cmd_t){ .type = CONTROL_TEMP_ENABLE, .val.b = enable });
 }
 
 void app_temp_set_level(int level)
 {
-    g_temp_level = level;
+    control_post(&(control_cmd_t){ .type = CONTROL_TEMP_LEVEL, .val.i = level });
+}
+
+/**
+ * @brief Captures a calibration point and fits the coefficients. It runs in 
+ *        the worker task, like the scans, so the ADC is never read by two 
+ *        tasks at the same time.
+ * @param arg Temperature of the reference thermometer, packed by 
+ *        app_temp_calibrate().
+ */
+static void temperature_calibrate(void *arg)
+{
+    thermistor_cal_point_t point;
+    uintptr_t packed = (uintptr_t)arg;
+    float celsius;
+
+    memcpy(&celsius, &packed, sizeof(celsius));
+
+    esp_err_t err = thermistor_capture_point(&th, celsius, &point);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "calibration point not captured: %d", err);
+        return;
+    }
+
+    // Keep the last points, the oldest one is replaced.
+    if (cal_count == MAX_CALIBRATION_POINTS) {
+        memmove(&cal_points[0], &cal_points[1], sizeof(cal_points[0]) * (MAX_CALIBRATION_POINTS - 1));
+        cal_count--;
+    }
+    cal_points[cal_count++] = point;
+
+    if (cal_count < 2) {
+        ESP_LOGI(TAG, "calibration point captured, one more is needed");
+        return;
+    }
+
+    err = thermistor_calibrate(&th, cal_points, cal_count);
+    if (err == ESP_OK) {
+        err = thermistor_save_calibration(&th, THERMISTOR_CALIBRATION_KEY);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "calibration not stored: %d", err);
+        }
+    } else {
+        ESP_LOGW(TAG, "calibration fit failed, capture points at different temperatures");
+    }
+}
+
+esp_err_t app_temp_calibrate(float celsius)
+{
+    _Static_assert(sizeof(float) <= sizeof(uintptr_t), "the temperature is packed in the argument");
+    uintptr_t packed = 0;
+
+    memcpy(&packed, &celsius, sizeof(celsius));
+    return app_work_post(temperature_calibrate, (void*)packed);
 }
@@ -0,0 +1,256 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file app_latency.c
+ * @brief Control latency instrumentation: the paths are stamped with the CPU 
+ *        cycle counter at the source (encoder edge, cloud write, relay 
+ *        request) and at each stage on the way to the relays, and every 
+ *        sample is added to a logarithmic histogram of its stage. The 
+ *        histograms keep the exact min and max, and the percentiles are 
+ *        read from the buckets, so the p99 stays meaningful after millions 
+ *        of samples in a fixed amount of memory.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sdkconfig.h>
+
+#include <freertos/FreeRTOS.h>
+#include <esp_cpu.h>
+#include <esp_timer.h>
+#include <esp_private/esp_clk.h>
+#include <esp_rmaker_core.h>
+
+#include "app_priv.h"
+
+#include "esp_log.h"
+static const char* TAG = "app_latency";
+
+static const char* const path_names[APP_LATENCY_MAX] = {
+    [APP_LATENCY_ENCODER]      = "encoder->relay req",
+    [APP_LATENCY_CLOUD]        = "cloud->relay req",
+    [APP_LATENCY_ENC_ISR]      = "enc isr->step",
+    [APP_LATENCY_ENC_TASK]     = "enc step->task",
+    [APP_LATENCY_CONTROL]      = "control->relay req",
+    [APP_LATENCY_RELAY_SETTLE] = "relay req->start",
+    [APP_LATENCY_RELAY_SWITCH] = "relay start->write",
+    [APP_LATENCY_REPORT]       = "report change->sent",
+};
+
+const char* app_latency_name(app_latency_path_t path)
+{
+    return (path < APP_LATENCY_MAX) ? path_names[path] : "?";
+}
+
+uint32_t app_latency_bucket_limit(uint32_t index)
+{
+    if (index < 4) {
+        return index;
+    }
+
+    // Four buckets by octave: the two bits below the most significant one.
+    uint32_t shift = (index / 4) - 1;
+    uint32_t lower = (4 + (index % 4)) << shift;
+    return lower + ((1UL << shift) - 1);
+}
+
+uint32_t app_latency_percentile(const app_latency_hist_t* hist, uint32_t per_mille)
+{
+    if (!hist || (hist->count == 0)) {
+        return 0;
+    }
+
+    uint64_t rank = ((uint64_t)hist->count * per_mille + 999) / 1000;
+    uint64_t seen = 0;
+    rank = (rank == 0) ? 1 : rank;
+    for (uint32_t i = 0; i < APP_LATENCY_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            uint32_t limit = app_latency_bucket_limit(i);
+            return (limit < hist->max) ? limit : hist->max;
+        }
+    }
+    return hist->max;
+}
+
+#if CONFIG_APP_LATENCY
+
+static app_latency_hist_t latency_hists[APP_LATENCY_MAX];
+static portMUX_TYPE latency_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t latency_timer;
+
+/**
+ * @brief Bucket of a sample. The C3 has no count leading zeros instruction, 
+ *        and __builtin_clz would call libgcc from the ISRs.
+ * @param cycles Sample.
+ * @return Index of the bucket.
+ */
+static uint32_t IRAM_ATTR latency_bucket(uint32_t cycles)
+{
+    if (cycles < 4) {
+        return cycles;
+    }
+
+    uint32_t msb = 0;
+    uint32_t v = cycles;
+    if (v >= (1UL << 16)) { v >>= 16; msb += 16; }
+    if (v >= (1UL << 8))  { v >>= 8;  msb += 8; }
+    if (v >= (1UL << 4))  { v >>= 4;  msb += 4; }
+    if (v >= (1UL << 2))  { v >>= 2;  msb += 2; }
+    if (v >= (1UL << 1))  { msb += 1; }
+
+    return (msb - 1) * 4 + ((cycles >> (msb - 2)) & 3);
+}
+
+/**
+ * @brief Prints a value in CPU cycles as microseconds with one decimal.
+ */
+static const char* latency_us(uint32_t cycles, uint32_t mhz, char* text, size_t size)
+{
+    uint64_t tenths = ((uint64_t)cycles * 10) / mhz;
+    snprintf(text, size, "%llu.%u", (unsigned long long)(tenths / 10), (unsigned)(tenths % 10));
+    return text;
+}
+
+/**
+ * @brief Prints the statistics of every path. It runs in the worker task.
+ * @param priv
+ */
+static void app_latency_print(void *priv)
+{
+    static app_latency_hist_t hist;
+    uint32_t mhz = esp_clk_cpu_freq() / 1000000;
+    char min[16], med[16], p99[16], max[16];
+
+    for (int path = 0; path < APP_LATENCY_MAX; path++) {
+        if ((app_latency_get(path, &hist) != ESP_OK) || (hist.count == 0)) {
+            continue;
+        }
+
+        ESP_LOGI(TAG, "%-20s n=%-6u min %8s med %8s p99 %8s max %8s uS", path_names[path], 
+                 (unsigned)hist.count, latency_us(hist.min, mhz, min, sizeof(min)), 
+                 latency_us(app_latency_percentile(&hist, 500), mhz, med, sizeof(med)), 
+                 latency_us(app_latency_percentile(&hist, 990), mhz, p99, sizeof(p99)), 
+                 latency_us(hist.max, mhz, max, sizeof(max)));
+    }
+}
+
+/**
+ * @brief Function invoked periodically to report the latencies.
+ * @param priv
+ */
+static void app_latency_timer_cb(void *priv)
+{
+    app_work_post(app_latency_print, NULL);
+}
+
+esp_err_t app_latency_init(void)
+{
+    esp_timer_create_args_t latency_timer_conf = {
+        .callback = app_latency_timer_cb,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "app_latency"
+    };
+
+    esp_err_t err = esp_timer_create(&latency_timer_conf, &latency_timer);
+    if (err == ESP_OK) {
+        err = esp_timer_start_periodic(latency_timer, CONFIG_APP_LATENCY_REPORT_PERIOD * 1000000ULL);
+    }
+    return err;
+}
+
+uint32_t IRAM_ATTR app_latency_stamp(void)
+{
+    // Zero means not stamped, a real zero count only loses one sample.
+    return esp_cpu_get_cycle_count();
+}
+
+void IRAM_ATTR app_latency_record_span(app_latency_path_t path, uint32_t start, uint32_t end)
+{
+    if ((path >= APP_LATENCY_MAX) || (start == 0)) {
+        return;
+    }
+
+    uint32_t elapsed = end - start;
+    uint32_t bucket = latency_bucket(elapsed);
+
+    portENTER_CRITICAL_SAFE(&latency_lock);
+    app_latency_hist_t* h = &latency_hists[path];
+    if ((h->count == 0) || (elapsed < h->min)) {
+        h->min = elapsed;
+    }
+    if (elapsed > h->max) {
+        h->max = elapsed;
+    }
+    h->sum += elapsed;
+    h->buckets[bucket]++;
+    h->count++;
+    portEXIT_CRITICAL_SAFE(&latency_lock);
+}
+
+void IRAM_ATTR app_latency_record(app_latency_path_t path, uint32_t stamp)
+{
+    app_latency_record_span(path, stamp, esp_cpu_get_cycle_count());
+}
+
+esp_err_t app_latency_get(app_latency_path_t path, app_latency_hist_t* hist)
+{
+    if ((path >= APP_LATENCY_MAX) || !hist) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&latency_lock);
+    memcpy(hist, &latency_hists[path], sizeof(*hist));
+    portEXIT_CRITICAL(&latency_lock);
+    return ESP_OK;
+}
+
+#else
+
+esp_err_t app_latency_init(void)
+{
+    return ESP_OK;
+}
+
+uint32_t app_latency_stamp(void)
+{
+    return 0;
+}
+
+void app_latency_record(app_latency_path_t path, uint32_t stamp)
+{
+}
+
+void app_latency_record_span(app_latency_path_t path, uint32_t start, uint32_t end)
+{
+}
+
+esp_err_t app_latency_get(app_latency_path_t path, app_latency_hist_t* hist)
+{
+    ESP_LOGD(TAG, "latency instrumentation disabled");
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif
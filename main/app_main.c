@@ -28,7 +28,7 @@
  *        without humming.
  */
 
-#include <string.h>
+#include <sdkconfig.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <esp_log.h>
@@ -46,65 +46,220 @@
 
 static const char *TAG = "app_main";
 
+#define APP_NETWORK_TASK_STACK      CONFIG_ESP_MAIN_TASK_STACK_SIZE
+#define APP_NETWORK_TASK_PRIORITY   5
+
 esp_rmaker_device_t *fan_device;
 esp_rmaker_param_t *light_param;
 
 esp_rmaker_device_t *thermostat_device;
 esp_rmaker_param_t *thermostat_enable_param;
 esp_rmaker_param_t *thermostat_slider_param;
+esp_rmaker_param_t *motor_temp_param;
+esp_rmaker_param_t *thermostat_calibrate_param;
+
+#define PARAM_BINDINGS      16      /* Slots of the dispatch table, power of two */
+
+/**
+ * @brief Applies a validated value of a param.
+ */
+typedef esp_err_t (*param_handler_t)(esp_rmaker_param_val_t val);
+
+/**
+ * @brief Binding of a param to its handler, with the type and the range 
+ *        (int and float) of the values accepted.
+ */
+typedef struct {
+    const esp_rmaker_param_t* param;
+    esp_rmaker_val_type_t type;
+    float min;
+    float max;
+    param_handler_t handler;
+} param_binding_t;
+
+static param_binding_t param_bindings[PARAM_BINDINGS];
+
+/**
+ * @brief Slot of a param in the dispatch table, the pointers are aligned 
+ *        so the low bits are dropped.
+ */
+static uint32_t param_hash(const esp_rmaker_param_t* param)
+{
+    uintptr_t key = (uintptr_t)param;
+    return (uint32_t)((key >> 3) ^ (key >> 9)) & (PARAM_BINDINGS - 1);
+}
+
+/**
+ * @brief Binds a param to its handler and validator, it's called when the 
+ *        param is created.
+ * @param param RainMaker param.
+ * @param type Type of the values accepted.
+ * @param min Minimum value, ignored for bool.
+ * @param max Maximum value, ignored for bool.
+ * @param handler Function that applies the value.
+ * @return ESP_OK if successful
+ */
+static esp_err_t param_bind(const esp_rmaker_param_t* param, esp_rmaker_val_type_t type, 
+                            float min, float max, param_handler_t handler)
+{
+    if (!param) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t slot = param_hash(param);
+    for (uint32_t i = 0; i < PARAM_BINDINGS; i++) {
+        param_binding_t* binding = &param_bindings[(slot + i) & (PARAM_BINDINGS - 1)];
+        if (!binding->param || (binding->param == param)) {
+            *binding = (param_binding_t){ .param = param, .type = type, 
+                                          .min = min, .max = max, .handler = handler };
+            return ESP_OK;
+        }
+    }
+
+    ESP_LOGE(TAG, "dispatch table full");
+    return ESP_ERR_NO_MEM;
+}
+
+/**
+ * @brief Finds the binding of a param.
+ * @param param RainMaker param.
+ * @return The binding, NULL if the param is not bound.
+ */
+static const param_binding_t* param_lookup(const esp_rmaker_param_t* param)
+{
+    uint32_t slot = param_hash(param);
+    for (uint32_t i = 0; i < PARAM_BINDINGS; i++) {
+        const param_binding_t* binding = &param_bindings[(slot + i) & (PARAM_BINDINGS - 1)];
+        if (binding->param == param) {
+            return binding;
+        }
+        if (!binding->param) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Checks the type and the range of a value.
+ * @param binding Binding of the param.
+ * @param val Value received.
+ * @return True if the value is valid.
+ */
+static bool param_validate(const param_binding_t* binding, const esp_rmaker_param_val_t* val)
+{
+    if (val->type != binding->type) {
+        return false;
+    }
+
+    switch (val->type) {
+    case RMAKER_VAL_TYPE_BOOLEAN:
+        return true;
+    case RMAKER_VAL_TYPE_INTEGER:
+        return (val->val.i >= binding->min) && (val->val.i <= binding->max);
+    case RMAKER_VAL_TYPE_FLOAT:
+        return (val->val.f >= binding->min) && (val->val.f <= binding->max);
+    default:
+        return false;
+    }
+}
+
+#if CONFIG_APP_WRITE_LOG
+/**
+ * @brief Logs a write request.
+ */
+static void param_log(const esp_rmaker_device_t *device, const esp_rmaker_param_t *param,
+                      const esp_rmaker_param_val_t* val, esp_rmaker_write_ctx_t *ctx)
+{
+    const char* src = ctx ? esp_rmaker_device_cb_src_to_str(ctx->src) : "-";
+    const char* device_name = esp_rmaker_device_get_name(device);
+    const char* param_name = esp_rmaker_param_get_name(param);
+
+    switch (val->type) {
+    case RMAKER_VAL_TYPE_BOOLEAN:
+        ESP_LOGI(TAG, "Received value = %s for %s - %s via %s", 
+                 val->val.b ? "true" : "false", device_name, param_name, src);
+        break;
+    case RMAKER_VAL_TYPE_INTEGER:
+        ESP_LOGI(TAG, "Received value = %d for %s - %s via %s", 
+                 val->val.i, device_name, param_name, src);
+        break;
+    case RMAKER_VAL_TYPE_FLOAT:
+        ESP_LOGI(TAG, "Received value = %.2f for %s - %s via %s", 
+                 val->val.f, device_name, param_name, src);
+        break;
+    default:
+        break;
+    }
+}
+#endif
+
+static esp_err_t on_power(esp_rmaker_param_val_t val)
+{
+    return app_fan_set_power(val.val.b);
+}
+
+static esp_err_t on_speed(esp_rmaker_param_val_t val)
+{
+    return app_fan_set_speed(val.val.i);
+}
+
+static esp_err_t on_light(esp_rmaker_param_val_t val)
+{
+    return app_fan_set_ligth(val.val.b);
+}
+
+static esp_err_t on_thermostat_enable(esp_rmaker_param_val_t val)
+{
+    app_temp_set_enable(val.val.b);
+    return ESP_OK;
+}
+
+static esp_err_t on_thermostat_level(esp_rmaker_param_val_t val)
+{
+    app_temp_set_level(val.val.i);
+    return ESP_OK;
+}
+
+static esp_err_t on_calibrate(esp_rmaker_param_val_t val)
+{
+    return app_temp_calibrate(val.val.f);
+}
 
 /* Callback to handle commands received from the RainMaker cloud */
 static esp_err_t write_cb(const esp_rmaker_device_t *device, const esp_rmaker_param_t *param,
             const esp_rmaker_param_val_t val, void *priv_data, esp_rmaker_write_ctx_t *ctx)
 {
-    if (ctx) {
-        ESP_LOGI(TAG, "Received write request via : %s", esp_rmaker_device_cb_src_to_str(ctx->src));
-    }
-    char *device_name = esp_rmaker_device_get_name(device);
-    char *param_name = esp_rmaker_param_get_name(param);
-    if (strcmp(param_name, ESP_RMAKER_DEF_POWER_NAME) == 0) {
-        ESP_LOGI(TAG, "Received value = %s for %s - %s",
-                val.val.b? "true" : "false", device_name, param_name);
-        app_fan_set_power(val.val.b);
-    } else if (strcmp(param_name, ESP_RMAKER_DEF_SPEED_NAME) == 0) {
-        ESP_LOGI(TAG, "Received value = %d for %s - %s",
-                val.val.i, device_name, param_name);
-        app_fan_set_speed(val.val.i);
-    } else if (strcmp(param_name, LIGHT_SWITCH_NAME) == 0) {
-        ESP_LOGI(TAG, "Received value = %s for %s - %s",
-                val.val.b? "true" : "false", device_name, param_name);
-        app_fan_set_ligth(val.val.b);
-    } else if (strcmp(param_name, THERMOSTAT_SWITCH_NAME) == 0) {
-        ESP_LOGI(TAG, "Received value = %s for %s - %s",
-                val.val.b? "true" : "false", device_name, param_name);
-        app_temp_set_enable(val.val.b);
-    } else if (strcmp(param_name, THERMOSTAT_SLIDER_NAME) == 0) {
-        ESP_LOGI(TAG, "Received value = %d for %s - %s",
-                val.val.i, device_name, param_name);
-        app_temp_set_level(val.val.i);
-    } else {
+    const param_binding_t* binding = param_lookup(param);
+    if (!binding) {
         /* Silently ignoring invalid params */
         return ESP_OK;
     }
-    esp_rmaker_param_update_and_report(param, val);
-    return ESP_OK;
-}
 
-void app_main()
-{
-    /* Initialize Application specific hardware drivers and
-     * set initial state.
-     */
-    app_driver_init();
+#if CONFIG_APP_WRITE_LOG
+    param_log(device, param, &val, ctx);
+#endif
 
-    /* Initialize NVS. */
-    esp_err_t err = nvs_flash_init();
-    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-        ESP_ERROR_CHECK(nvs_flash_erase());
-        err = nvs_flash_init();
+    // Nothing reaches the relays or the thermostat out of range.
+    if (!param_validate(binding, &val)) {
+        ESP_LOGW(TAG, "Rejected value for %s", esp_rmaker_param_get_name(param));
+        return ESP_ERR_INVALID_ARG;
     }
-    ESP_ERROR_CHECK( err );
 
+    esp_err_t err = binding->handler(val);
+    if (err == ESP_OK) {
+        app_report_param(param, val);
+    }
+    return err;
+}
+
+/**
+ * @brief Creates the RainMaker node and devices and starts the Wi-Fi, in 
+ *        background so the local control does not wait for the radio.
+ * @param arg
+ */
+static void app_network_task(void *arg)
+{
     /* Initialize Wi-Fi. Note that, this should be called before esp_rmaker_init()
      */
     app_wifi_init();
@@ -122,37 +277,77 @@ void app_main()
         abort();
     }
 
+    /* The params start with the state restored by the driver */
+    app_state_t state;
+    app_fan_get_state(&state);
+
     /* Create a device and add the relevant parameters to it */
-    fan_device = esp_rmaker_fan_device_create("Fan", NULL, DEFAULT_POWER);
-    esp_rmaker_device_add_cb(fan_device, write_cb, NULL);
-    esp_rmaker_device_add_param(fan_device, esp_rmaker_speed_param_create(ESP_RMAKER_DEF_SPEED_NAME, DEFAULT_SPEED));
+    esp_rmaker_device_t *fan = esp_rmaker_fan_device_create("Fan", NULL, state.power);
+    esp_rmaker_device_add_cb(fan, write_cb, NULL);
+    esp_rmaker_param_t *speed_param = esp_rmaker_speed_param_create(ESP_RMAKER_DEF_SPEED_NAME, state.speed);
+    esp_rmaker_device_add_param(fan, speed_param);
+    param_bind(esp_rmaker_device_get_param_by_type(fan, ESP_RMAKER_PARAM_POWER), 
+               RMAKER_VAL_TYPE_BOOLEAN, 0, 0, on_power);
+    param_bind(speed_param, RMAKER_VAL_TYPE_INTEGER, 0, MAX_CELING_SPEED, on_speed);
     
-    light_param = esp_rmaker_param_create(LIGHT_SWITCH_NAME, NULL, 
-                                          esp_rmaker_bool(DEFAULT_LIGHT), 
-                                          PROP_FLAG_READ | PROP_FLAG_WRITE);
-    esp_rmaker_param_add_ui_type(light_param, ESP_RMAKER_UI_TOGGLE);
-    esp_rmaker_device_add_param(fan_device, light_param);
+    esp_rmaker_param_t *light = esp_rmaker_param_create(LIGHT_SWITCH_NAME, NULL, 
+                                                        esp_rmaker_bool(state.light), 
+                                                        PROP_FLAG_READ | PROP_FLAG_WRITE);
+    esp_rmaker_param_add_ui_type(light, ESP_RMAKER_UI_TOGGLE);
+    esp_rmaker_device_add_param(fan, light);
+    param_bind(light, RMAKER_VAL_TYPE_BOOLEAN, 0, 0, on_light);
 
-    esp_rmaker_node_add_device(node, fan_device);
+    esp_rmaker_node_add_device(node, fan);
 
     /* Create the temperature device and add the relevant parameters to it */
-    thermostat_device = esp_rmaker_temp_sensor_device_create(THERMOSTAT_DEVICE_NAME, NULL, app_get_current_temperature());
-    esp_rmaker_device_add_cb(thermostat_device, write_cb, NULL);
+    esp_rmaker_device_t *thermostat = esp_rmaker_temp_sensor_device_create(THERMOSTAT_DEVICE_NAME, NULL, app_get_current_temperature());
+    esp_rmaker_device_add_cb(thermostat, write_cb, NULL);
 
     thermostat_enable_param = esp_rmaker_param_create(THERMOSTAT_SWITCH_NAME, NULL, 
-                                                      esp_rmaker_bool(DEFAULT_THERMOSTAT_ENABLE), 
+                                                      esp_rmaker_bool(state.temp_enable), 
                                                       PROP_FLAG_READ | PROP_FLAG_WRITE);
     esp_rmaker_param_add_ui_type(thermostat_enable_param, ESP_RMAKER_UI_TOGGLE);
-    esp_rmaker_device_add_param(thermostat_device, thermostat_enable_param);
+    esp_rmaker_device_add_param(thermostat, thermostat_enable_param);
+    param_bind(thermostat_enable_param, RMAKER_VAL_TYPE_BOOLEAN, 0, 0, on_thermostat_enable);
     
     thermostat_slider_param = esp_rmaker_param_create(THERMOSTAT_SLIDER_NAME, NULL, 
-                                                      esp_rmaker_int(DEFAULT_THERMOSTAT_TEMPERATURE), 
+                                                      esp_rmaker_int(state.temp_level), 
                                                       PROP_FLAG_READ | PROP_FLAG_WRITE);
     esp_rmaker_param_add_ui_type(thermostat_slider_param, ESP_RMAKER_UI_SLIDER);
-    esp_rmaker_param_add_bounds(thermostat_slider_param, esp_rmaker_int(10), esp_rmaker_int(40), esp_rmaker_int(1));
-    esp_rmaker_device_add_param(thermostat_device, thermostat_slider_param);
+    esp_rmaker_param_add_bounds(thermostat_slider_param, esp_rmaker_int(THERMOSTAT_MIN_TEMPERATURE), 
+                                esp_rmaker_int(THERMOSTAT_MAX_TEMPERATURE), esp_rmaker_int(1));
+    esp_rmaker_device_add_param(thermostat, thermostat_slider_param);
+    param_bind(thermostat_slider_param, RMAKER_VAL_TYPE_INTEGER, 
+               THERMOSTAT_MIN_TEMPERATURE, THERMOSTAT_MAX_TEMPERATURE, on_thermostat_level);
+
+    thermostat_calibrate_param = esp_rmaker_param_create(THERMOSTAT_CALIBRATE_NAME, NULL, 
+                                                         esp_rmaker_float(DEFAULT_TEMPERATURE), 
+                                                         PROP_FLAG_READ | PROP_FLAG_WRITE);
+    esp_rmaker_param_add_ui_type(thermostat_calibrate_param, ESP_RMAKER_UI_TEXT);
+    esp_rmaker_device_add_param(thermostat, thermostat_calibrate_param);
+    param_bind(thermostat_calibrate_param, RMAKER_VAL_TYPE_FLOAT, 
+               CALIBRATE_MIN_TEMPERATURE, CALIBRATE_MAX_TEMPERATURE, on_calibrate);
 
-    esp_rmaker_node_add_device(node, thermostat_device);
+    esp_rmaker_param_t *motor_temp = NULL;
+#if CONFIG_MOTOR_THERMISTOR
+    motor_temp = esp_rmaker_param_create(MOTOR_TEMPERATURE_NAME, ESP_RMAKER_PARAM_TEMPERATURE, 
+                                         esp_rmaker_float(app_get_motor_temperature()), 
+                                         PROP_FLAG_READ);
+    esp_rmaker_device_add_param(thermostat, motor_temp);
+#endif
+
+    esp_rmaker_node_add_device(node, thermostat);
+
+    /* Published only when complete, the controller and the worker use them
+     * as soon as they are not NULL.
+     */
+    light_param = light;
+    motor_temp_param = motor_temp;
+    fan_device = fan;
+    thermostat_device = thermostat;
+
+    /* Read-only diagnostics, updated by the metrics summary */
+    app_metrics_create_device(node);
 
     /* Enable scheduling.
      * Please note that you also need to set the timezone for schedules to work correctly.
@@ -165,16 +360,66 @@ void app_main()
 
     /* Start the ESP RainMaker Agent */
     esp_rmaker_start();
+    app_boot_mark("rainmaker");
 
     /* Start the Wi-Fi.
      * If the node is provisioned, it will start connection attempts,
      * else, it will start Wi-Fi provisioning. The function will return
      * after a connection has been successfully established
      */
-    err = app_wifi_start(POP_TYPE_RANDOM);
+    esp_err_t err = app_wifi_start(POP_TYPE_RANDOM);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Could not start Wifi. Aborting!!!");
         vTaskDelay(5000/portTICK_PERIOD_MS);
         abort();
     }
+
+    app_boot_mark("wifi connected");
+    app_boot_report();
+
+    /* The network task is the deepest stack at boot, sampled before it ends */
+    app_metrics_report();
+    vTaskDelete(NULL);
+}
+
+void app_main()
+{
+    app_boot_mark("app_main");
+
+#if CONFIG_APP_FAST_BOOT
+    /* After a soft reset the outputs are restored from RTC memory at once,
+     * and the driver starts from the same snapshot without reading NVS.
+     */
+    app_state_t snapshot;
+    if (app_boot_snapshot_load(&snapshot)) {
+        app_relay_init();
+        app_relay_restore(snapshot.power ? snapshot.speed : 0);
+        app_relay_set_light(snapshot.light);
+        app_boot_mark("outputs restored");
+    }
+#endif
+
+    /* Initialize NVS, before the drivers because they load the
+     * thermistor calibration from it.
+     */
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        err = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK( err );
+    app_boot_mark("nvs");
+
+    /* Initialize Application specific hardware drivers and
+     * restore the state stored in NVS, before the Wi-Fi starts.
+     */
+    app_driver_init();
+    app_boot_mark("driver");
+    app_boot_report();
+
+    if (xTaskCreate(app_network_task, "app_network", APP_NETWORK_TASK_STACK, NULL, 
+                    APP_NETWORK_TASK_PRIORITY, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Could not create the network task. Aborting!!!");
+        abort();
+    }
 }
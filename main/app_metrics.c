@@ -0,0 +1,286 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file app_metrics.c
+ * @brief Registry of runtime metrics: the subsystems update counters and 
+ *        gauges without locks or allocations. A periodic summary samples the 
+ *        heap and the stacks, prints them on the console and updates the 
+ *        read-only params of the diagnostics device.
+ *
+ * An idle device must not publish: the reports of the diagnostics are not 
+ * counted as sent, the gauges are only reported when they move more than 
+ * APP_METRICS_GAUGE_THRESHOLD percent, and the reports suppressed by the 
+ * deadband, that grow with every idle reading, stay on the console.
+ *
+ * The C3 (rv32imc) has no atomic extension: a relaxed store is a plain 
+ * store, but __atomic_fetch_add is a call to the atomic helpers of the IDF, 
+ * that mask the interrupts around the read-modify-write. It's a short 
+ * critical section, still safe from the ISRs, not a single instruction.
+ */
+
+#include <sdkconfig.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <esp_rmaker_core.h>
+#include <esp_rmaker_standard_types.h>
+
+#include "app_priv.h"
+
+#include "esp_log.h"
+static const char* TAG = "app_metrics";
+
+#define METRICS_MAX_TASKS   6       /* Tasks watched for the stack watermark */
+
+/**
+ * @brief Kind of metric, it defines how the summary shows it.
+ */
+typedef enum {
+    METRIC_COUNTER,                 ///< Total since the boot.
+    METRIC_RATE,                    ///< Counter shown as increments by second.
+    METRIC_GAUGE,                   ///< Last value set.
+} metric_kind_t;
+
+typedef struct {
+    const char* name;
+    metric_kind_t kind;
+    bool local;                     ///< Only on the console, it grows on an idle device.
+} metric_desc_t;
+
+static const metric_desc_t metric_desc[APP_METRIC_MAX] = {
+    [APP_METRIC_ENCODER_EVENTS]     = { "Encoder Rate",         METRIC_RATE,    false },
+    [APP_METRIC_ENCODER_DROPPED]    = { "Encoder Dropped",      METRIC_COUNTER, false },
+    [APP_METRIC_ADC_READ_US]        = { "ADC Read us",          METRIC_GAUGE,   false },
+    [APP_METRIC_RELAY_REQUESTS]     = { "Relay Requests",       METRIC_COUNTER, false },
+    [APP_METRIC_RELAY_TRANSITIONS]  = { "Relay Transitions",    METRIC_COUNTER, false },
+    [APP_METRIC_REPORTS_SENT]       = { "Reports Sent",         METRIC_COUNTER, false },
+    [APP_METRIC_REPORTS_SUPPRESSED] = { "Reports Suppressed",   METRIC_COUNTER, true },
+    [APP_METRIC_WORK_LOST]          = { "Work Lost",            METRIC_COUNTER, false },
+    [APP_METRIC_HEAP_FREE]          = { "Heap Free",            METRIC_GAUGE,   false },
+    [APP_METRIC_HEAP_MIN]           = { "Heap Min",             METRIC_GAUGE,   false },
+    [APP_METRIC_STACK_MIN]          = { "Stack Min",            METRIC_GAUGE,   false },
+};
+
+static uint32_t metric_values[APP_METRIC_MAX];
+static uint32_t metric_last[APP_METRIC_MAX];        /* Values of the last summary */
+static TaskHandle_t watched_tasks[METRICS_MAX_TASKS];
+static uint32_t watched_count = 0;
+static esp_timer_handle_t metrics_timer;
+
+#if CONFIG_APP_METRICS_DEVICE
+static esp_rmaker_param_t* metric_params[APP_METRIC_MAX];
+static uint32_t published[APP_METRIC_MAX];
+#endif
+
+void IRAM_ATTR app_metrics_add(app_metric_t metric, uint32_t n)
+{
+    if (metric < APP_METRIC_MAX) {
+        __atomic_fetch_add(&metric_values[metric], n, __ATOMIC_RELAXED);
+    }
+}
+
+void IRAM_ATTR app_metrics_set(app_metric_t metric, uint32_t value)
+{
+    if (metric < APP_METRIC_MAX) {
+        __atomic_store_n(&metric_values[metric], value, __ATOMIC_RELAXED);
+    }
+}
+
+void app_metrics_watch_task(void)
+{
+    uint32_t slot = __atomic_fetch_add(&watched_count, 1, __ATOMIC_RELAXED);
+    if (slot < METRICS_MAX_TASKS) {
+        watched_tasks[slot] = xTaskGetCurrentTaskHandle();
+    } else {
+        ESP_LOGW(TAG, "too many watched tasks");
+    }
+}
+
+/**
+ * @brief Samples the gauges that are read rather than pushed.
+ */
+static void app_metrics_sample(void)
+{
+    uint32_t stack_min = UINT32_MAX;
+    uint32_t count = (watched_count < METRICS_MAX_TASKS) ? watched_count : METRICS_MAX_TASKS;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (watched_tasks[i]) {
+            uint32_t free = uxTaskGetStackHighWaterMark(watched_tasks[i]);
+            if (free < stack_min) {
+                stack_min = free;
+            }
+        }
+    }
+
+    app_metrics_set(APP_METRIC_HEAP_FREE, esp_get_free_heap_size());
+    app_metrics_set(APP_METRIC_HEAP_MIN, esp_get_minimum_free_heap_size());
+    if (stack_min != UINT32_MAX) {
+        app_metrics_set(APP_METRIC_STACK_MIN, stack_min);
+    }
+}
+
+/**
+ * @brief Value of a metric as shown by the summary.
+ * @param metric Metric.
+ * @param value Current value.
+ */
+static uint32_t app_metrics_value(app_metric_t metric, uint32_t value)
+{
+    if (metric_desc[metric].kind == METRIC_RATE) {
+        return (value - metric_last[metric]) / CONFIG_APP_METRICS_PERIOD;
+    }
+    return value;
+}
+
+#if CONFIG_APP_METRICS_DEVICE
+/**
+ * @brief Tells if the value of a metric moved enough from the published one.
+ * @param metric Metric.
+ * @param shown Value as shown by the summary.
+ */
+static bool app_metrics_changed(app_metric_t metric, uint32_t shown)
+{
+    uint32_t last = published[metric];
+
+    if (metric_desc[metric].kind != METRIC_GAUGE) {
+        return shown != last;
+    }
+    // The gauges jitter on every sample, only a trend is worth a message.
+    uint32_t delta = (shown > last) ? (shown - last) : (last - shown);
+    return delta && (((uint64_t)delta * 100) >= ((uint64_t)last * CONFIG_APP_METRICS_GAUGE_THRESHOLD));
+}
+#endif
+
+/**
+ * @brief Periodic summary, it runs in the worker task because the reports 
+ *        to the cloud can block.
+ * @param priv
+ */
+static void app_metrics_publish(void *priv)
+{
+    app_metrics_sample();
+
+    for (int metric = 0; metric < APP_METRIC_MAX; metric++) {
+        uint32_t value = __atomic_load_n(&metric_values[metric], __ATOMIC_RELAXED);
+        uint32_t shown = app_metrics_value(metric, value);
+
+        ESP_LOGI(TAG, "%-20s %u", metric_desc[metric].name, (unsigned)shown);
+#if CONFIG_APP_METRICS_DEVICE
+        // Only the changes are reported, in the coalescing window of the 
+        // other params, to save cloud messages.
+        if (metric_params[metric] && app_metrics_changed(metric, shown)) {
+            if (app_report_param(metric_params[metric], esp_rmaker_int(shown)) == ESP_OK) {
+                published[metric] = shown;
+            }
+        }
+#endif
+        metric_last[metric] = value;
+    }
+}
+
+/**
+ * @brief Function invoked periodically to summarize the metrics.
+ * @param priv
+ */
+static void app_metrics_timer_cb(void *priv)
+{
+    app_work_post(app_metrics_publish, NULL);
+}
+
+esp_err_t app_metrics_init(void)
+{
+    esp_timer_create_args_t metrics_timer_conf = {
+        .callback = app_metrics_timer_cb,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "app_metrics"
+    };
+
+    esp_err_t err = esp_timer_create(&metrics_timer_conf, &metrics_timer);
+    if (err == ESP_OK) {
+        err = esp_timer_start_periodic(metrics_timer, CONFIG_APP_METRICS_PERIOD * 1000000ULL);
+    }
+    return err;
+}
+
+esp_err_t app_metrics_create_device(const esp_rmaker_node_t* node)
+{
+#if CONFIG_APP_METRICS_DEVICE
+    esp_rmaker_device_t* device = esp_rmaker_device_create(METRICS_DEVICE_NAME, NULL, NULL);
+    if (!device) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (int metric = 0; metric < APP_METRIC_MAX; metric++) {
+        if (metric_desc[metric].local) {
+            continue;
+        }
+        esp_rmaker_param_t* param = esp_rmaker_param_create(metric_desc[metric].name, NULL, 
+                                                            esp_rmaker_int(0), PROP_FLAG_READ);
+        if (param) {
+            esp_rmaker_param_add_ui_type(param, ESP_RMAKER_UI_TEXT);
+            esp_rmaker_device_add_param(device, param);
+            published[metric] = 0;
+            metric_params[metric] = param;
+        }
+    }
+
+    return esp_rmaker_node_add_device(node, device);
+#else
+    return ESP_OK;
+#endif
+}
+
+bool app_metrics_is_param(const esp_rmaker_param_t* param)
+{
+#if CONFIG_APP_METRICS_DEVICE
+    for (int metric = 0; metric < APP_METRIC_MAX; metric++) {
+        if (param && (metric_params[metric] == param)) {
+            return true;
+        }
+    }
+#endif
+    return false;
+}
+
+void app_metrics_report(void)
+{
+    uint32_t count = (watched_count < METRICS_MAX_TASKS) ? watched_count : METRICS_MAX_TASKS;
+
+    app_metrics_sample();
+    for (int metric = 0; metric < APP_METRIC_MAX; metric++) {
+        ESP_LOGI(TAG, "%-20s %u", metric_desc[metric].name, 
+                 (unsigned)__atomic_load_n(&metric_values[metric], __ATOMIC_RELAXED));
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (watched_tasks[i]) {
+            ESP_LOGI(TAG, "stack %-14s %u", pcTaskGetName(watched_tasks[i]), 
+                     (unsigned)uxTaskGetStackHighWaterMark(watched_tasks[i]));
+        }
+    }
+}
@@ -31,13 +31,107 @@
 #define DEFAULT_TEMPERATURE                 25.0
 #define DEFAULT_THERMOSTAT_TEMPERATURE      30
 #define DEFAULT_THERMOSTAT_ENABLE           false
-#define TEMPERATURE_REPORTING_PERIOD        60 /* Seconds */
+#define TEMPERATURE_SETPOINT_BAND           2.0 /* Celsius, samples fast inside it */
+#define TEMPERATURE_FAST_RATE               0.5 /* Celsius per minute, samples fast above it */
 #define MAX_CELING_SPEED                    5
+#define THERMOSTAT_MIN_TEMPERATURE          10  /* Celsius, range of the thermostat slider */
+#define THERMOSTAT_MAX_TEMPERATURE          40
+#define CALIBRATE_MIN_TEMPERATURE           -10 /* Celsius, range of the calibration points */
+#define CALIBRATE_MAX_TEMPERATURE           60
 
 #define LIGHT_SWITCH_NAME                   "Ligth"
 #define THERMOSTAT_DEVICE_NAME              "Thermostat"
 #define THERMOSTAT_SWITCH_NAME              "Enable"
 #define THERMOSTAT_SLIDER_NAME              "Temp"
+#define MOTOR_TEMPERATURE_NAME              "Motor"
+#define THERMOSTAT_CALIBRATE_NAME           "Calibrate"
+#define METRICS_DEVICE_NAME                 "Diagnostics"
+#define THERMISTOR_CALIBRATION_KEY          "ambient"
+#define MAX_CALIBRATION_POINTS              3
+
+/**
+ * @brief Fan state stored in NVS, restored at boot.
+ */
+typedef struct {
+    uint8_t speed;                  ///< Ceiling speed, 0 to MAX_CELING_SPEED.
+    bool power;                     ///< Fan on.
+    bool light;                     ///< Light on.
+    bool temp_enable;               ///< Thermostat enabled.
+    int32_t temp_level;             ///< Thermostat temperature in Celsius.
+} app_state_t;
+
+/**
+ * @brief Function deferred to the worker task.
+ * @param arg Argument given when it was posted.
+ */
+typedef void (*app_work_fn_t)(void *arg);
+
+/**
+ * @brief Control paths and stages measured by the latency instrumentation.
+ */
+typedef enum {
+    APP_LATENCY_ENCODER = 0,        ///< Encoder edge interrupt to relay request, end to end.
+    APP_LATENCY_CLOUD,              ///< Cloud write to relay request, end to end.
+    APP_LATENCY_ENC_ISR,            ///< Edge interrupt to step (the debounce callback on the timer backend).
+    APP_LATENCY_ENC_TASK,           ///< Step to the wakeup of the encoder task.
+    APP_LATENCY_CONTROL,            ///< Command posted to relay request by the controller task.
+    APP_LATENCY_RELAY_SETTLE,       ///< Relay request to the start of the transition (settle window).
+    APP_LATENCY_RELAY_SWITCH,       ///< Start of the transition to the last relay write.
+    APP_LATENCY_REPORT,             ///< First change of the coalescing window to the report sent.
+    APP_LATENCY_MAX,
+} app_latency_path_t;
+
+#define APP_LATENCY_BUCKETS     124     /* Logarithmic buckets, 4 by octave of CPU cycles */
+
+/**
+ * @brief Histogram of a path, in CPU cycles.
+ */
+typedef struct {
+    uint32_t count;                             ///< Samples recorded since the boot.
+    uint32_t min;                               ///< Exact minimum.
+    uint32_t max;                               ///< Exact maximum.
+    uint64_t sum;                               ///< Sum of the samples, for the mean.
+    uint32_t buckets[APP_LATENCY_BUCKETS];      ///< Samples by bucket, see app_latency_bucket_limit().
+} app_latency_hist_t;
+
+/**
+ * @brief Ids of the events of the hot path trace (esp32-trace), the meaning 
+ *        of the argument is noted. Keep in sync with tools/trace_decode.py.
+ */
+typedef enum {
+    APP_TRACE_NONE = 0,
+    APP_TRACE_ENC_STEP,             ///< Encoder step, position.
+    APP_TRACE_ENC_OVERFLOW,         ///< Encoder ring full, overflows.
+    APP_TRACE_RELAY_REQUEST,        ///< Relay speed requested, speed.
+    APP_TRACE_RELAY_BREAK,          ///< Relays released, mask.
+    APP_TRACE_RELAY_MAKE,           ///< Relays closed, mask.
+    APP_TRACE_RELAY_ZERO_CROSS,     ///< Zero-cross of the mains, 1 if a step was waiting.
+    APP_TRACE_CONTROL_BATCH,        ///< Controller batch applied, change flags.
+    APP_TRACE_WORK_BEGIN,           ///< Deferred work starts, function address.
+    APP_TRACE_WORK_END,             ///< Deferred work ends, function address.
+    APP_TRACE_REPORT_TIMER,         ///< Report window expired.
+    APP_TRACE_REPORT_FLUSH,         ///< Params reported to the cloud, count.
+    APP_TRACE_TEMP_TIMER,           ///< Temperature sample timer expired.
+    APP_TRACE_MAX,
+} app_trace_id_t;
+
+/**
+ * @brief Metrics of the registry, the subsystems update them in the hot paths.
+ */
+typedef enum {
+    APP_METRIC_ENCODER_EVENTS = 0,  ///< Counter, reported by second.
+    APP_METRIC_ENCODER_DROPPED,     ///< Counter, events lost by the encoder ring.
+    APP_METRIC_ADC_READ_US,         ///< Gauge, time of the last thermistor read.
+    APP_METRIC_RELAY_REQUESTS,      ///< Counter, speed changes requested to the relays.
+    APP_METRIC_RELAY_TRANSITIONS,   ///< Counter, speed transitions switched.
+    APP_METRIC_REPORTS_SENT,        ///< Counter, params reported to the cloud, without the diagnostics.
+    APP_METRIC_REPORTS_SUPPRESSED,  ///< Counter, reports skipped by the deadband.
+    APP_METRIC_WORK_LOST,           ///< Counter, deferred work lost by a full queue.
+    APP_METRIC_HEAP_FREE,           ///< Gauge, free heap in bytes.
+    APP_METRIC_HEAP_MIN,            ///< Gauge, minimum free heap since the boot.
+    APP_METRIC_STACK_MIN,           ///< Gauge, lowest stack watermark of the watched tasks.
+    APP_METRIC_MAX,
+} app_metric_t;
 
 extern esp_rmaker_device_t *fan_device;
 extern esp_rmaker_param_t *light_param;
@@ -45,6 +139,8 @@ extern esp_rmaker_param_t *light_param;
 extern esp_rmaker_device_t *thermostat_device;
 extern esp_rmaker_param_t *thermostat_enable_param;
 extern esp_rmaker_param_t *thermostat_slider_param;
+extern esp_rmaker_param_t *motor_temp_param;
+extern esp_rmaker_param_t *thermostat_calibrate_param;
 
 /**
  * @brief Initializes the encoder, the thermistor, the relays and the led.
@@ -52,6 +148,12 @@ extern esp_rmaker_param_t *thermostat_slider_param;
  */
 void app_driver_init(void);
 
+/**
+ * @brief Get the current fan state, after app_driver_init it's the restored one.
+ * @param state Pointer to store the state.
+ */
+void app_fan_get_state(app_state_t* state);
+
 /**
  * @brief Turn the ceiling fan on and off.
  * @param power True = ON.
@@ -78,13 +180,21 @@ esp_err_t app_fan_set_speed(uint8_t speed);
 esp_err_t app_fan_set_ligth(bool state);
 
 /**
- * @brief Get the current temperature..
+ * @brief Get the temperature of the last reading, it doesn't read the ADC.
  * @param void
  *  
  * @return Celsius degrees.
  */
 float app_get_current_temperature(void);
 
+/**
+ * @brief Get the motor temperature of the last reading.
+ * @param void
+ *  
+ * @return Celsius degrees.
+ */
+float app_get_motor_temperature(void);
+
 /**
  * @brief Enable temperature fan control.
  * @param enable True = Enabled
@@ -96,3 +206,246 @@ void app_temp_set_enable(bool enable);
  * @param level = 20 to 50 Celsius degree.
  */
 void app_temp_set_level(int level);
+
+/**
+ * @brief Capture a calibration point of the thermistor at the temperature of 
+ *        a reference thermometer. From the second point, the Steinhart-Hart 
+ *        coefficients are fitted with the last three points and stored in NVS.
+ *        The capture is deferred to the worker task, the errors are logged.
+ * @param celsius Temperature of the reference thermometer.
+ *
+ * @return ESP_OK if the capture was queued, ESP_ERR_NO_MEM if the work queue is full.
+ */
+esp_err_t app_temp_calibrate(float celsius);
+
+/**
+ * @brief Configures the relay GPIOs, all released, and the timer of the 
+ *        sequencer (and the zero-cross input when configured).
+ * @param void
+ *
+ * @return ESP_OK if successful
+ */
+esp_err_t app_relay_init(void);
+
+/**
+ * @brief Requests the relays of a speed, it returns at once. When the 
+ *        speed does not change during the settle window (RELAY_SETTLE_MS), 
+ *        the sequencer releases the old relays, waits the break-before-make 
+ *        gap and closes the new ones in background. Speed 0 is not delayed.
+ * @param speed Ceiling speed. 0 = turn off.
+ *
+ * @return ESP_OK if successful
+ */
+esp_err_t app_relay_set_speed(uint8_t speed);
+
+/**
+ * @brief Requests the relays of a speed without the settle window, used to 
+ *        restore the outputs at boot.
+ * @param speed Ceiling speed. 0 = turn off.
+ *
+ * @return ESP_OK if successful
+ */
+esp_err_t app_relay_restore(uint8_t speed);
+
+/**
+ * @brief Turn the light relay on and off.
+ * @param on True = ON
+ */
+void app_relay_set_light(bool on);
+
+/**
+ * @brief Reads the fan state from the RTC snapshot after a soft reset, else 
+ *        from NVS, or the defaults when there is none, and creates the 
+ *        timer of the lazy write.
+ * @param state Pointer to store the state.
+ *
+ * @return ESP_OK if restored, ESP_ERR_NVS_NOT_FOUND or ESP_ERR_* with the defaults.
+ */
+esp_err_t app_state_load(app_state_t* state);
+
+/**
+ * @brief Updates the cached state, it's written to NVS when it does not 
+ *        change during the quiet period (STATE_SAVE_QUIET_PERIOD) and only 
+ *        if it differs from the stored one.
+ * @param state New fan state.
+ */
+void app_state_save(const app_state_t* state);
+
+/**
+ * @brief Time stamps a boot stage for the boot profile.
+ * @param stage Name of the stage, it must be a literal.
+ */
+void app_boot_mark(const char* stage);
+
+/**
+ * @brief Prints the boot stages with their time stamps on the console.
+ * @param void
+ */
+void app_boot_report(void);
+
+/**
+ * @brief Reads the fan state retained in RTC memory by the last run.
+ * @param state Pointer to store the state.
+ *
+ * @return True if there is a valid snapshot (soft reset and APP_FAST_BOOT).
+ */
+bool app_boot_snapshot_load(app_state_t* state);
+
+/**
+ * @brief Retains the fan state in RTC memory for the next soft reset.
+ * @param state Fan state.
+ */
+void app_boot_snapshot_save(const app_state_t* state);
+
+/**
+ * @brief Creates the queue and the worker task of the deferred work.
+ * @param void
+ *
+ * @return ESP_OK if successful
+ */
+esp_err_t app_work_init(void);
+
+/**
+ * @brief Defers a function to the worker task, without blocking. The timer 
+ *        callbacks use it to keep the esp_timer task fast.
+ * @param fn Function to run.
+ * @param arg Argument of the function.
+ *
+ * @return ESP_OK if successful, ESP_ERR_NO_MEM if the queue is full.
+ */
+esp_err_t app_work_post(app_work_fn_t fn, void *arg);
+
+/**
+ * @brief Creates the timer of the report window.
+ * @param void
+ *
+ * @return ESP_OK if successful
+ */
+esp_err_t app_report_init(void);
+
+/**
+ * @brief Updates the value of a param at once, and reports it to the cloud 
+ *        at the end of the window (REPORT_COALESCE_MS); more changes of the 
+ *        same param during the window are reported only once, with the 
+ *        last value.
+ * @param param Param to update.
+ * @param val New value.
+ *
+ * @return ESP_OK if successful
+ */
+esp_err_t app_report_param(const esp_rmaker_param_t* param, esp_rmaker_param_val_t val);
+
+/**
+ * @brief Creates the periodic report of the latencies (APP_LATENCY).
+ * @param void
+ *
+ * @return ESP_OK if successful
+ */
+esp_err_t app_latency_init(void);
+
+/**
+ * @brief Takes the stamp of the start of a control path.
+ * @param void
+ *
+ * @return CPU cycle count, 0 if APP_LATENCY is disabled.
+ */
+uint32_t app_latency_stamp(void);
+
+/**
+ * @brief Records the latency of a path from its stamp, safe from an ISR.
+ * @param path Measured path.
+ * @param stamp Stamp taken at the start, 0 is ignored.
+ */
+void app_latency_record(app_latency_path_t path, uint32_t stamp);
+
+/**
+ * @brief Records the latency of a path between two stamps, safe from an ISR.
+ * @param path Measured path.
+ * @param start Stamp taken at the start, 0 is ignored.
+ * @param end Stamp taken at the end.
+ */
+void app_latency_record_span(app_latency_path_t path, uint32_t start, uint32_t end);
+
+/**
+ * @brief Copies the histogram of a path.
+ * @param path Measured path.
+ * @param hist Pointer to store the histogram.
+ *
+ * @return ESP_OK if successful, ESP_ERR_INVALID_ARG for an unknown path, 
+ *         ESP_ERR_NOT_SUPPORTED if APP_LATENCY is disabled.
+ */
+esp_err_t app_latency_get(app_latency_path_t path, app_latency_hist_t* hist);
+
+/**
+ * @brief Name of a path, as printed in the reports.
+ * @param path Measured path.
+ * @return Name, "?" for an unknown path.
+ */
+const char* app_latency_name(app_latency_path_t path);
+
+/**
+ * @brief Largest sample that falls in a bucket.
+ * @param index Bucket.
+ * @return CPU cycles.
+ */
+uint32_t app_latency_bucket_limit(uint32_t index);
+
+/**
+ * @brief Percentile of a histogram: the limit of the bucket that holds it, 
+ *        clamped to the exact maximum, so it's never below the real value 
+ *        and at most 25 % above it.
+ * @param hist Histogram.
+ * @param per_mille Percentile in thousandths, 990 for the p99.
+ * @return CPU cycles, 0 for an empty histogram.
+ */
+uint32_t app_latency_percentile(const app_latency_hist_t* hist, uint32_t per_mille);
+
+/**
+ * @brief Creates the timer of the periodic summary of the metrics.
+ * @param void
+ *
+ * @return ESP_OK if successful
+ */
+esp_err_t app_metrics_init(void);
+
+/**
+ * @brief Adds to a counter, constant time and safe from an ISR.
+ * @param metric Counter to increment.
+ * @param n Value to add.
+ */
+void app_metrics_add(app_metric_t metric, uint32_t n);
+
+/**
+ * @brief Sets a gauge, constant time and safe from an ISR.
+ * @param metric Gauge to set.
+ * @param value New value.
+ */
+void app_metrics_set(app_metric_t metric, uint32_t value);
+
+/**
+ * @brief Adds the calling task to the stack watermark (APP_METRIC_STACK_MIN).
+ * @param void
+ */
+void app_metrics_watch_task(void);
+
+/**
+ * @brief Creates the diagnostics device with a read-only param by metric, 
+ *        they are updated with each summary when they change enough.
+ * @param node RainMaker node.
+ *
+ * @return ESP_OK if successful
+ */
+esp_err_t app_metrics_create_device(const esp_rmaker_node_t* node);
+
+/**
+ * @brief Tells if a param belongs to the diagnostics device.
+ * @param param Param.
+ * @return true for a param of a metric.
+ */
+bool app_metrics_is_param(const esp_rmaker_param_t* param);
+
+/**
+ * @brief Prints the metrics and the stack of the watched tasks on the console.
+ * @param void
+ */
+void app_metrics_report(void);
@@ -0,0 +1,389 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file app_relay.c
+ * @brief Sequences the speed relays: each speed has a mask of relays, and a 
+ *        transition first releases the relays that are not in the new mask, 
+ *        waits the break-before-make gap, and then closes the new ones, so 
+ *        two capacitors are never connected at the same time. Optionally 
+ *        each switching waits for the zero-cross of the mains. The steps are 
+ *        driven by a timer, so the callers never block. The speed requests 
+ *        are coalesced during a settle window, so a slider drag or a knob 
+ *        spin switches only to the final speed; turning off is immediate.
+ */
+
+#include <sdkconfig.h>
+
+#include <freertos/FreeRTOS.h>
+#include <esp_timer.h>
+#include <esp_attr.h>
+#include <driver/gpio.h>
+#include <soc/soc.h>
+#include <soc/gpio_reg.h>
+#include <esp_rmaker_core.h>
+
+#include "app_priv.h"
+#include "trace.h"
+
+#include "esp_log.h"
+static const char* TAG = "app_relay";
+
+#define RELAY_CAP_LOW               (1 << 0)
+#define RELAY_CAP_HIGH              (1 << 1)
+#define RELAY_DIRECT                (1 << 2)
+
+#define GPIO_BIT(gpio)              (1UL << (gpio))
+#define RELAY_GPIO_CAP_LOW          GPIO_BIT(CONFIG_RELAY_SPEED_CAP_LOW_GPIO)
+#define RELAY_GPIO_CAP_HIGH         GPIO_BIT(CONFIG_RELAY_SPEED_CAP_HIGH_GPIO)
+#define RELAY_GPIO_DIRECT           GPIO_BIT(CONFIG_RELAY_SPEED_DIRECT_GPIO)
+
+/* The masks are written to the GPIO_OUT registers, only the first 32 GPIOs */
+#if (CONFIG_RELAY_SPEED_CAP_LOW_GPIO >= 32) || (CONFIG_RELAY_SPEED_CAP_HIGH_GPIO >= 32) || \
+    (CONFIG_RELAY_SPEED_DIRECT_GPIO >= 32)
+    #error "The speed relays must use GPIO0 to GPIO31"
+#endif
+
+#define RELAY_ZERO_CROSS_ENABLED    (CONFIG_RELAY_ZERO_CROSS_GPIO >= 0)
+#define ZERO_CROSS_TIMEOUT_US       (25 * 1000)    /* More than a half cycle of 50 Hz */
+
+/**
+ * @brief Relays closed by each speed, with 3 relays control the 4 speeds of 
+ *        the ceiling fan in AC.
+ */
+static const uint8_t speed_relays[MAX_CELING_SPEED + 1] = {
+    0,                                  /* Off */
+    RELAY_CAP_LOW,                      /* 1 */
+    RELAY_CAP_HIGH,                     /* 2 */
+    RELAY_CAP_LOW | RELAY_CAP_HIGH,     /* 3 */
+    RELAY_DIRECT,                       /* 4 */
+    RELAY_DIRECT,                       /* 5 */
+};
+
+/**
+ * @brief GPIO output bits of each combination of relays, so a step of the 
+ *        sequencer is a single register write.
+ */
+static const DRAM_ATTR uint32_t relay_gpio_bits[8] = {
+    0,
+    RELAY_GPIO_CAP_LOW,
+    RELAY_GPIO_CAP_HIGH,
+    RELAY_GPIO_CAP_LOW | RELAY_GPIO_CAP_HIGH,
+    RELAY_GPIO_DIRECT,
+    RELAY_GPIO_CAP_LOW | RELAY_GPIO_DIRECT,
+    RELAY_GPIO_CAP_HIGH | RELAY_GPIO_DIRECT,
+    RELAY_GPIO_CAP_LOW | RELAY_GPIO_CAP_HIGH | RELAY_GPIO_DIRECT,
+};
+
+static portMUX_TYPE relay_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t relay_timer;
+static esp_timer_handle_t settle_timer;
+static uint8_t relay_current = 0;   /* Relays closed now */
+static uint8_t relay_target = 0;    /* Relays of the transition in progress */
+static uint8_t relay_pending = 0;   /* Relays of the requested speed, waiting to settle */
+static uint8_t relay_speed = 0;     /* Last requested speed */
+static bool relay_busy = false;     /* A transition is in progress */
+static uint32_t relay_stamp = 0;    /* Latency stamp of the oldest request not started yet */
+static uint32_t switch_stamp = 0;   /* Latency stamp of the start of the transition in progress */
+#if RELAY_ZERO_CROSS_ENABLED
+static bool relay_wait_zc = false;  /* Waiting for the zero-cross to switch */
+#endif
+
+/**
+ * @brief Activates or turns off a relay and applies the configured logic.
+ */
+static void relay_write(gpio_num_t gpio_num, bool on)
+{
+#if CONFIG_ACTIVATE_RELAY_LOW
+    on = !on;
+#endif
+    gpio_set_level(gpio_num, on);
+}
+
+/**
+ * @brief Activates or turns off the speed relays of the mask at the same 
+ *        time, with a write to the set or clear register of the outputs.
+ */
+static void IRAM_ATTR relay_write_mask(uint8_t mask, bool on)
+{
+#if CONFIG_ACTIVATE_RELAY_LOW
+    on = !on;
+#endif
+    if (on) {
+        REG_WRITE(GPIO_OUT_W1TS_REG, relay_gpio_bits[mask]);
+    } else {
+        REG_WRITE(GPIO_OUT_W1TC_REG, relay_gpio_bits[mask]);
+    }
+}
+
+/**
+ * @brief Executes the next step of the transition to the target: release 
+ *        the relays that are not in the target and start the gap, or when 
+ *        there is nothing to release close the missing ones.
+ *        NOTE: must be called with relay_lock taken.
+ * @return Latency stamp of the transition that ends, to record it after 
+ *         the lock is released, 0 if it goes on.
+ */
+static uint32_t relay_step(void)
+{
+    uint32_t done = 0;
+    uint8_t brk = relay_current & ~relay_target;
+    uint8_t make = relay_target & ~relay_current;
+
+    if (brk) {
+        TRACE(APP_TRACE_RELAY_BREAK, brk);
+        relay_write_mask(brk, false);
+        relay_current &= ~brk;
+        esp_timer_start_once(relay_timer, CONFIG_RELAY_BREAK_BEFORE_MAKE_MS * 1000);
+    } else {
+        if (make) {
+            TRACE(APP_TRACE_RELAY_MAKE, make);
+            relay_write_mask(make, true);
+            relay_current |= make;
+        }
+        relay_busy = false;
+        app_metrics_add(APP_METRIC_RELAY_TRANSITIONS, 1);
+
+        done = switch_stamp;
+        switch_stamp = 0;
+    }
+    return done;
+}
+
+/**
+ * @brief Executes the next step at the zero-cross of the mains, when it's 
+ *        configured, or at once.
+ *        NOTE: must be called with relay_lock taken.
+ * @return Latency stamp of the transition that ends, see relay_step().
+ */
+static uint32_t relay_next_step(void)
+{
+#if RELAY_ZERO_CROSS_ENABLED
+    // The timeout keeps the relays working without mains detection.
+    relay_wait_zc = true;
+    gpio_intr_enable(CONFIG_RELAY_ZERO_CROSS_GPIO);
+    esp_timer_start_once(relay_timer, ZERO_CROSS_TIMEOUT_US);
+    return 0;
+#else
+    return relay_step();
+#endif
+}
+
+/**
+ * @brief Function invoked when the gap (or the zero-cross timeout) expires.
+ * @param priv
+ */
+static void relay_timer_cb(void *priv)
+{
+    uint32_t done;
+
+    portENTER_CRITICAL(&relay_lock);
+#if RELAY_ZERO_CROSS_ENABLED
+    if (relay_wait_zc) {
+        relay_wait_zc = false;
+        gpio_intr_disable(CONFIG_RELAY_ZERO_CROSS_GPIO);
+        done = relay_step();
+    } else {
+        done = relay_next_step();
+    }
+#else
+    done = relay_step();
+#endif
+    portEXIT_CRITICAL(&relay_lock);
+
+    app_latency_record(APP_LATENCY_RELAY_SWITCH, done);
+}
+
+#if RELAY_ZERO_CROSS_ENABLED
+/**
+ * @brief The mains crosses zero, executes the pending step. It's not in 
+ *        IRAM: the step calls the timer and gpio drivers from flash, so it 
+ *        does not run while the flash cache is disabled.
+ * @param arg
+ */
+static void relay_zero_cross_isr(void *arg)
+{
+    uint32_t done = 0;
+
+    portENTER_CRITICAL_ISR(&relay_lock);
+    gpio_intr_disable(CONFIG_RELAY_ZERO_CROSS_GPIO);
+    TRACE(APP_TRACE_RELAY_ZERO_CROSS, relay_wait_zc);
+    if (relay_wait_zc) {
+        relay_wait_zc = false;
+        esp_timer_stop(relay_timer);
+        done = relay_step();
+    }
+    portEXIT_CRITICAL_ISR(&relay_lock);
+
+    app_latency_record(APP_LATENCY_RELAY_SWITCH, done);
+}
+#endif
+
+/**
+ * @brief Starts the transition to the requested speed, when there is one 
+ *        in progress it picks up the new target in its next step.
+ */
+static void relay_start(void)
+{
+    uint32_t settled;
+    uint32_t done = 0;
+
+    portENTER_CRITICAL(&relay_lock);
+    relay_target = relay_pending;
+
+    // The settle window is measured apart, it's a configured delay.
+    settled = relay_stamp;
+    relay_stamp = 0;
+    if ((switch_stamp == 0) && (relay_busy || (relay_target != relay_current))) {
+        switch_stamp = app_latency_stamp();
+    }
+
+    if (!relay_busy && (relay_target != relay_current)) {
+        relay_busy = true;
+        done = relay_next_step();
+    }
+    portEXIT_CRITICAL(&relay_lock);
+
+    // Recorded out of the lock, it only guards the relays and the timers.
+    app_latency_record(APP_LATENCY_RELAY_SETTLE, settled);
+    app_latency_record(APP_LATENCY_RELAY_SWITCH, done);
+}
+
+/**
+ * @brief Function invoked when the requested speed did not change during 
+ *        the settle window.
+ * @param priv
+ */
+static void relay_settle_cb(void *priv)
+{
+    relay_start();
+}
+
+esp_err_t app_relay_init(void)
+{
+    // Already initialized by the fast boot, keeps the restored outputs.
+    if (relay_timer) {
+        return ESP_OK;
+    }
+
+    gpio_config_t io_conf = {
+        .mode = GPIO_MODE_OUTPUT,
+        .pull_up_en = 1,
+    };
+    io_conf.pin_bit_mask = (((uint64_t)1 << CONFIG_RELAY_SPEED_CAP_LOW_GPIO) | 
+                            ((uint64_t)1 << CONFIG_RELAY_SPEED_CAP_HIGH_GPIO) | 
+                            ((uint64_t)1 << CONFIG_RELAY_SPEED_DIRECT_GPIO) | 
+                            ((uint64_t)1 << CONFIG_RELAY_LIGHT_GPIO) );
+    esp_err_t err = gpio_config(&io_conf);
+
+    // Starts with every relay released.
+    relay_write_mask(RELAY_CAP_LOW | RELAY_CAP_HIGH | RELAY_DIRECT, false);
+    relay_write(CONFIG_RELAY_LIGHT_GPIO, false);
+
+    if (err == ESP_OK) {
+        esp_timer_create_args_t relay_timer_conf = {
+            .callback = relay_timer_cb,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "app_relay"
+        };
+        err = esp_timer_create(&relay_timer_conf, &relay_timer);
+    }
+
+    if (err == ESP_OK) {
+        esp_timer_create_args_t settle_timer_conf = {
+            .callback = relay_settle_cb,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "app_relay_settle"
+        };
+        err = esp_timer_create(&settle_timer_conf, &settle_timer);
+    }
+
+#if RELAY_ZERO_CROSS_ENABLED
+    if (err == ESP_OK) {
+        gpio_reset_pin(CONFIG_RELAY_ZERO_CROSS_GPIO);
+        gpio_set_direction(CONFIG_RELAY_ZERO_CROSS_GPIO, GPIO_MODE_INPUT);
+        gpio_set_intr_type(CONFIG_RELAY_ZERO_CROSS_GPIO, GPIO_INTR_POSEDGE);
+        gpio_intr_disable(CONFIG_RELAY_ZERO_CROSS_GPIO);
+
+        // The isr service may already be installed by the encoder.
+        gpio_install_isr_service(ESP_INTR_FLAG_EDGE);
+        err = gpio_isr_handler_add(CONFIG_RELAY_ZERO_CROSS_GPIO, relay_zero_cross_isr, NULL);
+    }
+#endif
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "relay init failed: %d", err);
+    }
+    return err;
+}
+
+/**
+ * @brief Requests the relays of a speed.
+ * @param speed Ceiling speed. 0 = turn off.
+ * @param settle True to wait for the settle window, else it starts at once.
+ * @return ESP_OK if successful
+ */
+static esp_err_t relay_request(uint8_t speed, bool settle)
+{
+    if (speed > MAX_CELING_SPEED) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    TRACE(APP_TRACE_RELAY_REQUEST, speed);
+
+    portENTER_CRITICAL(&relay_lock);
+    if (speed != relay_speed) {
+        relay_speed = speed;
+        app_metrics_add(APP_METRIC_RELAY_REQUESTS, 1);
+        if (relay_stamp == 0) {
+            relay_stamp = app_latency_stamp();
+        }
+    }
+    relay_pending = speed_relays[speed];
+    portEXIT_CRITICAL(&relay_lock);
+
+    // Each request restarts the window, turning off is never delayed.
+    esp_timer_stop(settle_timer);
+    if (!settle || (speed == 0) || (CONFIG_RELAY_SETTLE_MS == 0)) {
+        relay_start();
+    } else {
+        esp_timer_start_once(settle_timer, CONFIG_RELAY_SETTLE_MS * 1000);
+    }
+    return ESP_OK;
+}
+
+esp_err_t app_relay_set_speed(uint8_t speed)
+{
+    return relay_request(speed, true);
+}
+
+esp_err_t app_relay_restore(uint8_t speed)
+{
+    return relay_request(speed, false);
+}
+
+void app_relay_set_light(bool on)
+{
+    relay_write(CONFIG_RELAY_LIGHT_GPIO, on);
+}
@@ -0,0 +1,152 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file app_report.c
+ * @brief Coalesces the reports of the params to the cloud: the value is 
+ *        updated locally at once, and the report is deferred to the end of 
+ *        a short window, so a burst of changes of the same param (a fast 
+ *        knob spin or a slider drag) is published only once.
+ */
+
+#include <sdkconfig.h>
+
+#include <freertos/FreeRTOS.h>
+#include <esp_timer.h>
+#include <esp_rmaker_core.h>
+
+#include "app_priv.h"
+#include "trace.h"
+
+#include "esp_log.h"
+static const char* TAG = "app_report";
+
+#define MAX_REPORT_PARAMS   (8 + APP_METRIC_MAX)   /* The devices and the diagnostics */
+
+static const esp_rmaker_param_t* dirty_params[MAX_REPORT_PARAMS];
+static uint8_t dirty_count = 0;
+static uint32_t dirty_stamp = 0;    /* Latency stamp of the first change of the window */
+static portMUX_TYPE report_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t report_timer;
+
+/**
+ * @brief Reports each dirty param once with its last value, it runs in the 
+ *        worker task because the publish can block.
+ * @param priv
+ */
+static void app_report_flush(void *priv)
+{
+    const esp_rmaker_param_t* params[MAX_REPORT_PARAMS];
+    uint8_t count;
+    uint32_t stamp;
+
+    portENTER_CRITICAL(&report_lock);
+    count = dirty_count;
+    for (uint8_t i = 0; i < count; i++) {
+        params[i] = dirty_params[i];
+    }
+    dirty_count = 0;
+    stamp = dirty_stamp;
+    dirty_stamp = 0;
+    portEXIT_CRITICAL(&report_lock);
+
+    TRACE(APP_TRACE_REPORT_FLUSH, count);
+    uint32_t sent = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        // The diagnostics are not counted, or each summary would change 
+        // the count and publish again.
+        if ((esp_rmaker_param_report(params[i]) == ESP_OK) && !app_metrics_is_param(params[i])) {
+            sent++;
+        }
+    }
+    app_metrics_add(APP_METRIC_REPORTS_SENT, sent);
+    app_latency_record(APP_LATENCY_REPORT, stamp);
+}
+
+/**
+ * @brief Function invoked when the window expires, defers the reports.
+ * @param priv
+ */
+static void app_report_timer_cb(void *priv)
+{
+    TRACE(APP_TRACE_REPORT_TIMER, 0);
+
+    // The params stay dirty when the queue is full, retries a window later.
+    if (app_work_post(app_report_flush, NULL) != ESP_OK) {
+        esp_timer_start_once(report_timer, CONFIG_REPORT_COALESCE_MS * 1000ULL);
+    }
+}
+
+esp_err_t app_report_init(void)
+{
+    esp_timer_create_args_t report_timer_conf = {
+        .callback = app_report_timer_cb,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "app_report_flush"
+    };
+
+    return esp_timer_create(&report_timer_conf, &report_timer);
+}
+
+esp_err_t app_report_param(const esp_rmaker_param_t* param, esp_rmaker_param_val_t val)
+{
+    bool found = false;
+
+    if (!param) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err = esp_rmaker_param_update(param, val);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    portENTER_CRITICAL(&report_lock);
+    for (uint8_t i = 0; i < dirty_count; i++) {
+        if (dirty_params[i] == param) {
+            found = true;
+            break;
+        }
+    }
+    if (!found && (dirty_count < MAX_REPORT_PARAMS)) {
+        dirty_params[dirty_count++] = param;
+        found = true;
+        if (dirty_stamp == 0) {
+            dirty_stamp = app_latency_stamp();
+        }
+    }
+    portEXIT_CRITICAL(&report_lock);
+
+    if (!found) {
+        ESP_LOGW(TAG, "too many params pending, reporting at once");
+        return esp_rmaker_param_report(param);
+    }
+
+    // The window starts with the first change, later ones don't extend it.
+    if (!esp_timer_is_active(report_timer)) {
+        esp_timer_start_once(report_timer, CONFIG_REPORT_COALESCE_MS * 1000ULL);
+    }
+
+    return ESP_OK;
+}
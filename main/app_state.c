@@ -0,0 +1,210 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file app_state.c
+ * @brief Keeps the fan state (power, speed, light, thermostat) in NVS so it 
+ *        is restored after a power cut. The writes are lazy: the controller 
+ *        updates a cache at every change, and the cache is stored only after 
+ *        a quiet period and when it differs from the content of the flash.
+ *        After a soft reset the state comes from the RTC snapshot, which is 
+ *        never older than NVS, and the flash is only read by the first flush.
+ */
+
+#include <string.h>
+#include <sdkconfig.h>
+
+#include <freertos/FreeRTOS.h>
+#include <esp_timer.h>
+#include <esp_rmaker_core.h>
+#include <nvs.h>
+
+#include "app_priv.h"
+
+#include "esp_log.h"
+static const char* TAG = "app_state";
+
+#define NVS_NAMESPACE       "app_state"
+#define NVS_KEY             "fan"
+
+static app_state_t state_cache;     /* Last state given by the controller */
+static app_state_t state_stored;    /* Content of the flash */
+static bool state_stored_valid = false; /* The flash holds state_stored */
+static bool state_flash_read = false;   /* The flash was read, by the load or the first flush */
+static uint32_t state_writes = 0;
+static portMUX_TYPE state_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t state_timer;
+
+/**
+ * @brief Reads the state stored in NVS.
+ * @param stored Pointer to store the state.
+ * @return ESP_OK if successful, ESP_ERR_NVS_NOT_FOUND if it was never 
+ *         stored, or ESP_ERR_INVALID_SIZE / ESP_ERR_INVALID_STATE if it's 
+ *         not valid.
+ */
+static esp_err_t app_state_read(app_state_t* stored)
+{
+    size_t size = sizeof(*stored);
+    nvs_handle_t handle;
+
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (err == ESP_OK) {
+        err = nvs_get_blob(handle, NVS_KEY, stored, &size);
+        nvs_close(handle);
+    }
+
+    if ((err == ESP_OK) && (size != sizeof(*stored))) {
+        err = ESP_ERR_INVALID_SIZE;
+    }
+    if ((err == ESP_OK) && (stored->speed > MAX_CELING_SPEED)) {
+        err = ESP_ERR_INVALID_STATE;
+    }
+    return err;
+}
+
+/**
+ * @brief Stores the cache when it differs from the flash. It runs in the 
+ *        worker task, the NVS commit can take several mS.
+ * @param priv
+ */
+static void app_state_flush(void *priv)
+{
+    app_state_t state;
+
+    portENTER_CRITICAL(&state_lock);
+    state = state_cache;
+    portEXIT_CRITICAL(&state_lock);
+
+    // Restored from the RTC snapshot, the flash was not read at boot.
+    if (!state_flash_read) {
+        app_state_t stored;
+        if (app_state_read(&stored) == ESP_OK) {
+            state_stored = stored;
+            state_stored_valid = true;
+        }
+        state_flash_read = true;
+    }
+
+    // The changes during the quiet period may have returned to the stored state.
+    if (state_stored_valid && (memcmp(&state, &state_stored, sizeof(state)) == 0)) {
+        return;
+    }
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(handle, NVS_KEY, &state, sizeof(state));
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+
+    if (err == ESP_OK) {
+        state_stored = state;
+        state_stored_valid = true;
+        state_writes++;
+        ESP_LOGI(TAG, "state stored, writes: %u", (unsigned)state_writes);
+    } else {
+        ESP_LOGW(TAG, "state not stored: %d", err);
+    }
+}
+
+/**
+ * @brief Function invoked when the quiet period expires without changes.
+ * @param priv
+ */
+static void app_state_timer_cb(void *priv)
+{
+    app_work_post(app_state_flush, NULL);
+}
+
+esp_err_t app_state_load(app_state_t* state)
+{
+    esp_err_t err = ESP_OK;
+
+    state->speed = DEFAULT_SPEED;
+    state->power = DEFAULT_POWER;
+    state->light = DEFAULT_LIGHT;
+    state->temp_enable = DEFAULT_THERMOSTAT_ENABLE;
+    state->temp_level = DEFAULT_THERMOSTAT_TEMPERATURE;
+
+    // The snapshot is written at every change, NVS only after the quiet 
+    // period: after a soft reset it's the newest state and NVS is skipped.
+    bool from_snapshot = app_boot_snapshot_load(state);
+    if (from_snapshot) {
+        ESP_LOGI(TAG, "state restored from RTC: power %d, speed %d, light %d", 
+                 state->power, state->speed, state->light);
+    } else {
+        app_state_t stored;
+        err = app_state_read(&stored);
+        state_flash_read = true;
+        if (err == ESP_OK) {
+            *state = stored;
+            state_stored = stored;
+            state_stored_valid = true;
+            ESP_LOGI(TAG, "state restored: power %d, speed %d, light %d", 
+                     state->power, state->speed, state->light);
+        } else if (err != ESP_ERR_NVS_NOT_FOUND) {
+            ESP_LOGW(TAG, "state not restored: %d", err);
+        }
+    }
+    state_cache = *state;
+
+    esp_timer_create_args_t state_timer_conf = {
+        .callback = app_state_timer_cb,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "app_state"
+    };
+    esp_err_t timer_err = esp_timer_create(&state_timer_conf, &state_timer);
+
+    // The snapshot may hold changes that did not reach the flash yet.
+    if ((timer_err == ESP_OK) && from_snapshot) {
+        esp_timer_start_once(state_timer, CONFIG_STATE_SAVE_QUIET_PERIOD * 1000000ULL);
+    }
+
+    return (timer_err == ESP_OK) ? err : timer_err;
+}
+
+void app_state_save(const app_state_t* state)
+{
+    portENTER_CRITICAL(&state_lock);
+    bool changed = memcmp(state, &state_cache, sizeof(*state)) != 0;
+    if (changed) {
+        state_cache = *state;
+    }
+    portEXIT_CRITICAL(&state_lock);
+
+    // The RTC copy costs nothing and restores the outputs after a soft reset,
+    // even if the quiet period did not expire.
+    if (changed) {
+        app_boot_snapshot_save(state);
+    }
+
+    // Each change restarts the quiet period, a burst is written once.
+    if (changed && state_timer) {
+        esp_timer_stop(state_timer);
+        esp_timer_start_once(state_timer, CONFIG_STATE_SAVE_QUIET_PERIOD * 1000000ULL);
+    }
+}
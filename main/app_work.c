@@ -0,0 +1,105 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2021 Juan Schiavoni
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file app_work.c
+ * @brief Deferred work dispatcher: the timer callbacks only post a 
+ *        function to a queue, and a worker task runs it, so the slow parts 
+ *        (ADC reads, cloud reports) never delay the esp_timer task.
+ */
+
+#include <sdkconfig.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <esp_rmaker_core.h>
+
+#include "app_priv.h"
+#include "trace.h"
+
+#include "esp_log.h"
+static const char* TAG = "app_work";
+
+#define WORK_QUEUE_LEN      8
+#define WORK_TASK_STACK     4096
+#define WORK_TASK_PRIORITY  4
+
+/**
+ * @brief Item of the work queue.
+ */
+typedef struct {
+    app_work_fn_t fn;       ///< Function to run in the worker task.
+    void *arg;              ///< Argument of the function.
+} app_work_t;
+
+static QueueHandle_t work_queue;
+static uint32_t work_lost = 0;
+
+/**
+ * @brief Worker task, runs the posted functions in order.
+ * @param arg
+ */
+static void app_work_task(void *arg)
+{
+    app_work_t work;
+
+    app_metrics_watch_task();
+
+    while (true) {
+        if (xQueueReceive(work_queue, &work, portMAX_DELAY) == pdTRUE) {
+            TRACE(APP_TRACE_WORK_BEGIN, (uintptr_t)work.fn);
+            work.fn(work.arg);
+            TRACE(APP_TRACE_WORK_END, (uintptr_t)work.fn);
+        }
+    }
+}
+
+esp_err_t app_work_init(void)
+{
+    work_queue = xQueueCreate(WORK_QUEUE_LEN, sizeof(app_work_t));
+    if (!work_queue) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (xTaskCreate(app_work_task, "app_work", WORK_TASK_STACK, NULL, 
+                    WORK_TASK_PRIORITY, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t app_work_post(app_work_fn_t fn, void *arg)
+{
+    app_work_t work = { .fn = fn, .arg = arg };
+
+    // Never blocks, the callers are timer callbacks.
+    if (!work_queue || (xQueueSend(work_queue, &work, 0) != pdTRUE)) {
+        work_lost++;
+        app_metrics_add(APP_METRIC_WORK_LOST, 1);
+        ESP_LOGW(TAG, "work queue full, lost: %u", (unsigned)work_lost);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
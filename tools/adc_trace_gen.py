@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+#
+# MIT License
+#
+# Copyright (c) 2021 Juan Schiavoni
+#
+# Generates a raw ADC trace of the thermistor for the replay of the host test
+# test_adc_replay: a constant temperature with the white noise of the ADC and
+# the bursts of the Wi-Fi transmissions, with the Kconfig defaults.
+#
+#   python tools/adc_trace_gen.py > host/data/adc_wifi_bursts.csv
+#
+# A trace captured on the board has the same format: one raw code per line,
+# and an optional "# celsius <value>" line with the real temperature.
+
+import argparse
+import math
+import random
+
+SERIE_RESISTANCE = 164000
+NOMINAL_RESISTANCE = 100000
+NOMINAL_TEMPERATURE = 25
+BETA = 4250
+VSOURCE_MV = 3330
+FULL_SCALE_MV = 3300    # Linear calibration of the host ADC mock
+
+
+def raw_code(celsius):
+    t0 = NOMINAL_TEMPERATURE + 273.15
+    rt = NOMINAL_RESISTANCE * math.exp(BETA * (1.0 / (celsius + 273.15) - 1.0 / t0))
+    vout = VSOURCE_MV * rt / (rt + SERIE_RESISTANCE)
+    return vout * 4095 / FULL_SCALE_MV
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generates a raw ADC trace of the thermistor")
+    parser.add_argument("--celsius", type=float, default=25.0)
+    parser.add_argument("--samples", type=int, default=64 * 100)
+    parser.add_argument("--noise", type=float, default=6.0, help="sigma of the noise in codes")
+    parser.add_argument("--burst-rate", type=float, default=0.01, help="bursts per sample")
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    center = raw_code(args.celsius)
+    burst_left = 0
+    burst_offset = 0
+
+    print("# Thermistor at %.1f C, sigma %.1f codes, Wi-Fi bursts %.3f per sample" %
+          (args.celsius, args.noise, args.burst_rate))
+    print("# celsius %.2f" % args.celsius)
+    for _ in range(args.samples):
+        if burst_left == 0 and rng.random() < args.burst_rate:
+            burst_left = rng.randint(2, 8)
+            burst_offset = rng.choice((-1, 1)) * rng.uniform(80, 300)
+        offset = 0
+        if burst_left:
+            burst_left -= 1
+            offset = burst_offset
+        code = round(center + rng.gauss(0, args.noise) + offset)
+        print(min(max(code, 0), 4095))
+
+
+if __name__ == "__main__":
+    main()
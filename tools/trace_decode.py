@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+#
+# MIT License
+#
+# Copyright (c) 2021 Juan Schiavoni
+#
+# Decodes the hot path trace dumped by trace_dump() (components/esp32-trace)
+# from a captured console log, e.g. idf.py monitor | tee monitor.log
+#
+#   python tools/trace_decode.py monitor.log
+#   python tools/trace_decode.py --id RELAY_MAKE --id RELAY_BREAK monitor.log
+#
+# The event names must be kept in sync with app_trace_id_t in main/app_priv.h.
+
+import argparse
+import base64
+import binascii
+import struct
+import sys
+
+BEGIN = "----- TRACE BEGIN -----"
+END = "----- TRACE END -----"
+MAGIC = 0x31435254
+
+HEADER = struct.Struct("<IIIHH")
+RECORD = struct.Struct("<IHHI")
+
+EVENTS = [
+    "NONE",
+    "ENC_STEP",
+    "ENC_OVERFLOW",
+    "RELAY_REQUEST",
+    "RELAY_BREAK",
+    "RELAY_MAKE",
+    "RELAY_ZERO_CROSS",
+    "CONTROL_BATCH",
+    "WORK_BEGIN",
+    "WORK_END",
+    "REPORT_TIMER",
+    "REPORT_FLUSH",
+    "TEMP_TIMER",
+]
+
+# The argument is printed in hex for these events.
+HEX_ARGS = {"RELAY_BREAK", "RELAY_MAKE", "CONTROL_BATCH", "WORK_BEGIN", "WORK_END"}
+
+
+def extract_dumps(lines):
+    """Yields the binary content of each dump found in the log."""
+    data = None
+    for line in lines:
+        line = line.strip()
+        if line == BEGIN:
+            data = bytearray()
+        elif line == END and data is not None:
+            yield bytes(data)
+            data = None
+        elif data is not None and line:
+            try:
+                data += base64.b64decode(line, validate=True)
+            except binascii.Error:
+                # A log line interleaved with the dump.
+                pass
+
+
+def decode(data, ids):
+    if len(data) < HEADER.size:
+        print("truncated dump", file=sys.stderr)
+        return
+
+    magic, cpu_hz, total, record_size, count = HEADER.unpack_from(data)
+    if magic != MAGIC or record_size != RECORD.size or cpu_hz == 0:
+        print("bad dump header", file=sys.stderr)
+        return
+
+    available = (len(data) - HEADER.size) // record_size
+    if available < count:
+        print("dump truncated: %d of %d records" % (available, count), file=sys.stderr)
+        count = available
+
+    print("%d records of %d written, cpu %d MHz" % (count, total, cpu_hz // 1000000))
+    print("%10s %10s %4s  %-18s %s" % ("time us", "delta us", "core", "event", "arg"))
+
+    elapsed = 0
+    first = prev = None
+    for i in range(count):
+        cycles, event_id, core, arg = RECORD.unpack_from(data, HEADER.size + i * record_size)
+        # The cycle counter wraps every 2^32 cycles.
+        delta = 0 if prev is None else ((cycles - prev) & 0xFFFFFFFF)
+        elapsed += delta
+        prev = cycles
+
+        name = EVENTS[event_id] if event_id < len(EVENTS) else "ID_%d" % event_id
+        if ids and name not in ids:
+            continue
+
+        if first is None:
+            first = elapsed
+        value = "0x%08x" % arg if name in HEX_ARGS else "%d" % struct.unpack("<i", struct.pack("<I", arg))[0]
+        print("%10.1f %10.1f %4d  %-18s %s" % ((elapsed - first) * 1e6 / cpu_hz, 
+                                              delta * 1e6 / cpu_hz, core, name, value))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode the trace dumps of a console log")
+    parser.add_argument("log", nargs="?", type=argparse.FileType("r", errors="replace"), 
+                        default=sys.stdin, help="captured console log, stdin by default")
+    parser.add_argument("--id", action="append", default=[], 
+                        help="only print this event, it can be repeated")
+    args = parser.parse_args()
+
+    found = False
+    for n, data in enumerate(extract_dumps(args.log)):
+        found = True
+        print("\ndump %d" % n)
+        decode(data, set(args.id))
+
+    if not found:
+        print("no trace dump found", file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())